@@ -0,0 +1,219 @@
+#!/bin/bash
+
+# Filnamn: bench.sh
+#
+# Prestandatester för alla tre verktygen på genererade indata:
+#   mdu    genomsökning av ett syntetiskt träd med 1 och N trådar
+#   mexec  starttid per pipeline och genomströmning (GB/s) genom K steg
+#   mmake  full, oförändrad och inkrementell byggning av en genererad mmakefile
+#          med T mål, med och utan cachen för den tolkade grafen
+#
+# Varje mätning körs en gång för uppvärmning och sedan R gånger. Resultatet
+# sparas som CSV med median, minsta och största värde. Med -b jämförs
+# medianerna med en sparad baslinje, och skriptet avslutas med status 1 om
+# någon mätning saknas eller är mer än P procent sämre. En baslinje skapas
+# genom att spara en körning med -o, till exempel: ./bench.sh -o baseline.csv
+#
+# Användning: ./bench.sh [-r körningar] [-j trådar] [-t mål] [-s megabyte]
+#                        [-k "1 4 16"] [-o fil.csv] [-b baslinje.csv]
+#                        [-p procent] [-w arbetskatalog] [verktyg ...]
+
+runs=5
+threads=$(nproc)
+targets=10000
+megabytes=1024
+stages="1 4 16"
+output=results.csv
+baseline=""
+threshold=10
+workdir=""
+
+while getopts "r:j:t:s:k:o:b:p:w:" opt
+do
+    case $opt in
+        r) runs=$OPTARG ;;
+        j) threads=$OPTARG ;;
+        t) targets=$OPTARG ;;
+        s) megabytes=$OPTARG ;;
+        k) stages=$OPTARG ;;
+        o) output=$OPTARG ;;
+        b) baseline=$OPTARG ;;
+        p) threshold=$OPTARG ;;
+        w) workdir=$OPTARG ;;
+        *) sed -n '17,19p' "$0" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+# Mätningarna av mmake körs i arbetskatalogen, så filnamnen görs absoluta
+output=$(realpath -m "$output")
+[ -n "$baseline" ] && baseline=$(realpath -m "$baseline")
+tools=${*:-"mdu mexec mmake"}
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+mdu=$root/mdu/mdu
+mktree=$root/mdu/mktree
+mexec=$root/mexec/mexec
+mmake=$root/mmake/mmake
+
+# Bygg verktygen så att mätningarna alltid gäller den aktuella koden
+make -s -C "$root/mdu" mdu mktree || exit 1
+make -s -C "$root/mexec" || exit 1
+make -s -C "$root/mmake" || exit 1
+
+# Indata skapas i en tillfällig katalog som tas bort efteråt
+if [ -z "$workdir" ]
+then
+    workdir=$(mktemp -d) || exit 1
+    trap 'rm -rf "$workdir"' EXIT
+fi
+mkdir -p "$workdir" || exit 1
+
+echo "benchmark,unit,better,runs,median,min,max" > "$output"
+
+# Skriver en rad med median, minsta och största värde av värdena på stdin
+summarize() {
+    sort -g | awk -v name="$1" -v unit="$2" -v better="$3" '
+        { v[NR] = $1 }
+        END {
+            median = NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2
+            printf "%s,%s,%s,%d,%.6f,%.6f,%.6f\n", name, unit, better, NR, median, v[1], v[NR]
+        }' >> "$output"
+}
+
+# Mäter väggtiden i sekunder för ett kommando. Funktionen prep, om den anges
+# med -P, körs före varje körning utan att räknas in i tiden.
+# Med -S anges antalet gigabyte som kommandot flyttar, och genomströmningen
+# sparas också. Med -L anges antalet pipelines, och tiden per pipeline sparas.
+# Användning: measure [-P prep] [-S gigabyte] [-L antal] namn kommando ...
+measure() {
+    local prep="" bytes="" launches="" name start end i
+    while [ "${1:0:1}" = "-" ]
+    do
+        case $1 in
+            -P) prep=$2 ;;
+            -S) bytes=$2 ;;
+            -L) launches=$2 ;;
+        esac
+        shift 2
+    done
+    name=$1
+    shift
+
+    local times=()
+    for i in $(seq 0 "$runs")
+    do
+        [ -n "$prep" ] && $prep
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1 || { echo "$name: kommandot misslyckades: $*" >&2; exit 1; }
+        end=$(date +%s%N)
+        # Den första körningen är uppvärmning
+        [ "$i" -gt 0 ] && times+=($((end - start)))
+    done
+
+    printf "%s\n" "${times[@]}" | awk '{ printf "%.6f\n", $1 / 1e9 }' | summarize "$name" s lower
+    if [ -n "$bytes" ]
+    then
+        printf "%s\n" "${times[@]}" | awk -v b="$bytes" '{ printf "%.6f\n", b / ($1 / 1e9) }' \
+            | summarize "${name%_time}_throughput" GB/s higher
+    fi
+    if [ -n "$launches" ]
+    then
+        printf "%s\n" "${times[@]}" | awk -v n="$launches" '{ printf "%.3f\n", $1 / 1e3 / n }' \
+            | summarize "${name}_per_pipeline" us lower
+    fi
+    echo "$name klar"
+}
+
+bench_mdu() {
+    local tree=$workdir/mdu_tree
+    [ -d "$tree" ] || "$mktree" -f 8 -d 4 -n 32 "$tree" > /dev/null || exit 1
+    measure mdu_scan_j1 "$mdu" -j 1 "$tree"
+    [ "$threads" -gt 1 ] && measure "mdu_scan_j$threads" "$mdu" -j "$threads" "$tree"
+}
+
+bench_mexec() {
+    local i k
+    # Starttid: många pipelines med ett respektive tre steg som inte gör något
+    for i in $(seq 1 1000); do printf 'true\n\n'; done > "$workdir/launch1"
+    for i in $(seq 1 1000); do printf 'true\ntrue\ntrue\n\n'; done > "$workdir/launch3"
+    measure -L 1000 mexec_launch_1000x1 "$mexec" -b -j 1 "$workdir/launch1"
+    measure -L 1000 mexec_launch_1000x3 "$mexec" -b -j 1 "$workdir/launch3"
+
+    # Genomströmning: nollor genom K steg av cat
+    local bytes=$((megabytes * 1024 * 1024))
+    for k in $stages
+    do
+        {
+            echo "head -c $bytes /dev/zero"
+            for i in $(seq 1 "$k"); do echo "cat"; done
+        } > "$workdir/stream$k"
+        measure -S "$(awk -v b=$bytes 'BEGIN { print b / 1e9 }')" "mexec_stream_${k}_time" \
+            "$mexec" "$workdir/stream$k"
+    done
+}
+
+# Hjälpfunktioner som förbereder varje mmake-körning
+mmake_clean() { rm -f "$workdir"/mmake/out_* "$workdir"/mmake/all "$workdir/mmake/.mmake_graph"; }
+mmake_cold() { rm -f "$workdir/mmake/.mmake_graph"; }
+mmake_touch() { touch "$workdir"/mmake/src_*7; }
+
+bench_mmake() {
+    local dir=$workdir/mmake i
+    mkdir -p "$dir"
+    # T mål som vart och ett kopierar sin källfil, och ett mål som beror på alla
+    awk -v n="$targets" 'BEGIN {
+        printf "all:"
+        for (i = 0; i < n; i++) printf " out_%d", i
+        printf "\n\ttouch all\n\n"
+        for (i = 0; i < n; i++) printf "out_%d: src_%d\n\tcp src_%d out_%d\n\n", i, i, i, i
+    }' > "$dir/mmakefile"
+    (cd "$dir" && awk -v n="$targets" 'BEGIN { for (i = 0; i < n; i++) printf "" > ("src_" i) }')
+
+    cd "$dir" || exit 1
+    measure -P mmake_clean "mmake_full_t${targets}_j$threads" "$mmake" -s -j "$threads"
+    "$mmake" -s -j "$threads"
+    measure -P mmake_cold "mmake_noop_t${targets}_uncached" "$mmake" -s
+    measure "mmake_noop_t${targets}" "$mmake" -s
+    # Var tionde källfil ändras
+    measure -P mmake_touch "mmake_incremental_t${targets}_j$threads" "$mmake" -s -j "$threads"
+    cd - > /dev/null || exit 1
+}
+
+for tool in $tools
+do
+    case $tool in
+        mdu) bench_mdu ;;
+        mexec) bench_mexec ;;
+        mmake) bench_mmake ;;
+        *) echo "Okänt verktyg: $tool" >&2; exit 1 ;;
+    esac
+done
+
+# Jämför med baslinjen. En mätning i baslinjen som saknas i resultatet räknas
+# också som sämre.
+if [ -n "$baseline" ]
+then
+    awk -F, -v limit="$threshold" '
+        NR == 1 { printf "%-40s %12s %12s %-5s %8s\n", "benchmark", "baseline", "median", "unit", "change" }
+        FNR == 1 { next }
+        FNR == NR { base[$1] = $5; next }
+        { seen[$1] = 1 }
+        $1 in base && base[$1] > 0 {
+            change = ($3 == "lower" ? $5 - base[$1] : base[$1] - $5) / base[$1] * 100
+            status = change > limit ? "SÄMRE" : (change < -limit ? "bättre" : "ok")
+            if (change > limit) worse++
+            printf "%-40s %12.6f %12.6f %-5s %+7.1f%%  %s\n", $1, base[$1], $5, $2, ($5 - base[$1]) / base[$1] * 100, status
+        }
+        END {
+            for (name in base) {
+                if (!(name in seen)) {
+                    printf "%-40s %12.6f %12s %-5s %8s  %s\n", name, base[name], "-", "", "", "SAKNAS"
+                    worse++
+                }
+            }
+            exit worse > 0
+        }' "$baseline" "$output"
+    status=$?
+    [ $status -ne 0 ] && echo "Minst en mätning saknas eller är mer än $threshold % sämre än baslinjen" >&2
+    exit $status
+fi
@@ -0,0 +1,73 @@
+/**
+ * @file arena.c
+ * @brief Bump allocator for objects that are all freed at the same time.
+ *
+ * Chunks start small and double in size up to ARENA_MAX_CHUNK, so an arena
+ * that is barely used stays cheap. Requests larger than a chunk get a chunk
+ * of their own.
+ *
+ * Error handling: `arena_alloc` returns NULL if a new chunk cannot be allocated.
+ *
+ * Memory management: All chunks are released by `arena_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "arena.h"
+#include <stdalign.h>
+#include <stdlib.h>
+
+#define ARENA_MIN_CHUNK (4 * 1024)
+#define ARENA_MAX_CHUNK (1024 * 1024)
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;
+    alignas(max_align_t) char data[];
+};
+
+void arena_init(struct Arena *arena) {
+    arena->chunks = NULL;
+    arena->ptr = NULL;
+    arena->left = 0;
+}
+
+void *arena_alloc(struct Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (size > arena->left) {
+        size_t chunk_size = arena->chunks ? arena->chunks->size * 2 : ARENA_MIN_CHUNK;
+        if (chunk_size > ARENA_MAX_CHUNK) {
+            chunk_size = ARENA_MAX_CHUNK;
+        }
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+
+        struct ArenaChunk *chunk = malloc(sizeof(struct ArenaChunk) + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        chunk->size = chunk_size;
+        arena->chunks = chunk;
+        arena->ptr = chunk->data;
+        arena->left = chunk_size;
+    }
+
+    void *mem = arena->ptr;
+    arena->ptr += size;
+    arena->left -= size;
+    return mem;
+}
+
+void arena_destroy(struct Arena *arena) {
+    while (arena->chunks) {
+        struct ArenaChunk *next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    arena_init(arena);
+}
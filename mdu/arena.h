@@ -0,0 +1,53 @@
+/**
+ * @file arena.h
+ * @brief Bump allocator for objects that are all freed at the same time.
+ *
+ * An arena hands out memory from large chunks and never frees individual
+ * objects; everything is released at once by `arena_destroy`. Each worker
+ * owns its own arena, so allocations take no locks.
+ *
+ * Error handling: `arena_alloc` returns NULL if a new chunk cannot be allocated.
+ *
+ * Memory management: All memory handed out is released by `arena_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct ArenaChunk;
+
+struct Arena {
+    struct ArenaChunk *chunks;
+    char *ptr;
+    size_t left;
+};
+
+/**
+ * @brief Initializes an empty arena. No memory is allocated until first use.
+ *
+ * @param arena The arena to initialize.
+ */
+void arena_init(struct Arena *arena);
+
+/**
+ * @brief Allocates memory aligned for any type.
+ *
+ * @param arena The arena to allocate from.
+ * @param size Number of bytes.
+ * @return The memory, or NULL if it could not be allocated.
+ */
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/**
+ * @brief Frees every chunk of an arena and leaves it empty.
+ *
+ * @param arena The arena to destroy.
+ */
+void arena_destroy(struct Arena *arena);
+
+#endif // ARENA_H
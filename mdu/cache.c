@@ -0,0 +1,364 @@
+/**
+ * @file cache.c
+ * @brief Persistent cache of directory contents, used to skip unchanged directories.
+ *
+ * Lookups binary-search the mapped records by device and inode and then compare the
+ * timestamps. Each worker collects its records and their links and names in its own
+ * writer; the writers are concatenated, sorted and written out once the traversal is done.
+ *
+ * Error handling: Functions return -1 on failure. An unreadable or corrupt cache file
+ * is reported and treated as empty.
+ *
+ * Memory management: The mapping is released by `cache_close`, the buffers of builders
+ * and writers by `cache_builder_destroy` and `cache_writer_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "cache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "MDUCACHE"
+#define CACHE_VERSION 1
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t count;
+    uint64_t blob_size;
+};
+
+static int validate(struct Cache *cache);
+static int stamp_equal(const struct DirStamp *a, const struct DirStamp *b);
+static int compare_records(const void *a, const void *b);
+static int reserve(void **buffer, size_t *capacity, size_t needed, size_t element);
+static int write_file(FILE *file, const struct CacheRecord *records, size_t count,
+                      struct CacheWriter *const *writers, int num_writers, size_t blob_size);
+
+void cache_open(struct Cache *cache, const char *path) {
+    memset(cache, 0, sizeof(struct Cache));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "du: cannot read cache '%s': %s\n", path, strerror(errno));
+        }
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "du: cannot read cache '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "du: cannot read cache '%s': %s\n", path, strerror(errno));
+        return;
+    }
+    cache->map = map;
+    cache->map_size = st.st_size;
+
+    if (validate(cache) != 0) {
+        fprintf(stderr, "du: ignoring invalid cache '%s'\n", path);
+        cache_close(cache);
+    }
+}
+
+void cache_close(struct Cache *cache) {
+    if (cache->map) {
+        munmap(cache->map, cache->map_size);
+    }
+    memset(cache, 0, sizeof(struct Cache));
+}
+
+int cache_lookup(const struct Cache *cache, const struct DirStamp *stamp, struct CacheDir *dir) {
+    if (stamp->ino == 0) {
+        return 0;
+    }
+
+    size_t low = 0;
+    size_t high = cache->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const struct CacheRecord *record = &cache->records[mid];
+        if (record->stamp.dev < stamp->dev ||
+            (record->stamp.dev == stamp->dev && record->stamp.ino < stamp->ino)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == cache->count || !stamp_equal(&cache->records[low].stamp, stamp)) {
+        return 0;
+    }
+
+    const struct CacheRecord *record = &cache->records[low];
+    size_t links_size = (size_t)record->num_links * sizeof(struct CacheLink);
+    if (record->offset > cache->blob_size || links_size > cache->blob_size - record->offset ||
+        record->names_len > cache->blob_size - record->offset - links_size) {
+        return 0;
+    }
+    const char *names = cache->blob + record->offset + links_size;
+    if (record->names_len > 0 && names[record->names_len - 1] != '\0') {
+        return 0;
+    }
+
+    dir->size = record->size;
+    dir->links = (const struct CacheLink *)(cache->blob + record->offset);
+    dir->num_links = record->num_links;
+    dir->names = names;
+    dir->names_len = record->names_len;
+    return 1;
+}
+
+void cache_builder_reset(struct CacheBuilder *builder) {
+    builder->size = 0;
+    builder->num_links = 0;
+    builder->names_len = 0;
+    builder->num_dirs = 0;
+}
+
+int cache_builder_add_link(struct CacheBuilder *builder, const struct CacheLink *link) {
+    if (reserve((void **)&builder->links, &builder->links_capacity, builder->num_links + 1,
+                sizeof(struct CacheLink)) != 0) {
+        return -1;
+    }
+    builder->links[builder->num_links++] = *link;
+    return 0;
+}
+
+int cache_builder_add_dir(struct CacheBuilder *builder, const char *name) {
+    size_t len = strlen(name) + 1;
+    if (reserve((void **)&builder->names, &builder->names_capacity, builder->names_len + len, 1) != 0) {
+        return -1;
+    }
+    memcpy(builder->names + builder->names_len, name, len);
+    builder->names_len += len;
+    builder->num_dirs++;
+    return 0;
+}
+
+void cache_builder_destroy(struct CacheBuilder *builder) {
+    free(builder->links);
+    free(builder->names);
+    memset(builder, 0, sizeof(struct CacheBuilder));
+}
+
+int cache_writer_add(struct CacheWriter *writer, const struct DirStamp *stamp, const struct CacheBuilder *builder) {
+    size_t links_size = builder->num_links * sizeof(struct CacheLink);
+    /* Keep every record's links 8-byte aligned in the blob. */
+    size_t padded = (links_size + builder->names_len + 7) & ~(size_t)7;
+
+    if (reserve((void **)&writer->records, &writer->capacity, writer->count + 1, sizeof(struct CacheRecord)) != 0 ||
+        reserve((void **)&writer->blob, &writer->blob_capacity, writer->blob_len + padded, 1) != 0) {
+        return -1;
+    }
+
+    struct CacheRecord *record = &writer->records[writer->count++];
+    record->stamp = *stamp;
+    record->size = builder->size;
+    record->offset = writer->blob_len;
+    record->names_len = builder->names_len;
+    record->num_links = (uint32_t)builder->num_links;
+    record->num_dirs = builder->num_dirs;
+
+    char *dst = writer->blob + writer->blob_len;
+    memcpy(dst, builder->links, links_size);
+    memcpy(dst + links_size, builder->names, builder->names_len);
+    memset(dst + links_size + builder->names_len, 0, padded - links_size - builder->names_len);
+    writer->blob_len += padded;
+    return 0;
+}
+
+void cache_writer_destroy(struct CacheWriter *writer) {
+    free(writer->records);
+    free(writer->blob);
+    memset(writer, 0, sizeof(struct CacheWriter));
+}
+
+int cache_write(const char *path, struct CacheWriter *const *writers, int count) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += writers[i]->count;
+    }
+
+    struct CacheRecord *records = malloc((total ? total : 1) * sizeof(struct CacheRecord));
+    if (!records) {
+        perror("malloc");
+        return -1;
+    }
+    size_t n = 0;
+    size_t blob_size = 0;
+    for (int i = 0; i < count; i++) {
+        for (size_t j = 0; j < writers[i]->count; j++) {
+            records[n] = writers[i]->records[j];
+            records[n].offset += blob_size;
+            n++;
+        }
+        blob_size += writers[i]->blob_len;
+    }
+    qsort(records, total, sizeof(struct CacheRecord), compare_records);
+
+    size_t tmp_len = strlen(path) + sizeof(".XXXXXX");
+    char *tmp_path = malloc(tmp_len);
+    if (!tmp_path) {
+        perror("malloc");
+        free(records);
+        return -1;
+    }
+    snprintf(tmp_path, tmp_len, "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "wb");
+    if (!file) {
+        fprintf(stderr, "du: cannot write cache '%s': %s\n", path, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+            unlink(tmp_path);
+        }
+        free(tmp_path);
+        free(records);
+        return -1;
+    }
+
+    int ret = write_file(file, records, total, writers, count, blob_size);
+    if (fclose(file) != 0) {
+        ret = -1;
+    }
+    if (ret == 0 && rename(tmp_path, path) != 0) {
+        ret = -1;
+    }
+    if (ret != 0) {
+        fprintf(stderr, "du: cannot write cache '%s': %s\n", path, strerror(errno));
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(records);
+    return ret;
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Checks the header of a mapped cache file and locates its records and blob.
+ *
+ * @return 0 if the file is a valid cache, -1 otherwise.
+ */
+static int validate(struct Cache *cache) {
+    if (cache->map_size < sizeof(struct CacheHeader)) {
+        return -1;
+    }
+
+    const struct CacheHeader *header = cache->map;
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 || header->version != CACHE_VERSION ||
+        header->record_size != sizeof(struct CacheRecord)) {
+        return -1;
+    }
+
+    size_t available = cache->map_size - sizeof(struct CacheHeader);
+    if (header->count > available / sizeof(struct CacheRecord) ||
+        header->blob_size != available - header->count * sizeof(struct CacheRecord)) {
+        return -1;
+    }
+
+    cache->records = (const struct CacheRecord *)(header + 1);
+    cache->count = header->count;
+    cache->blob = (const char *)(cache->records + cache->count);
+    cache->blob_size = header->blob_size;
+    return 0;
+}
+
+/**
+ * @brief Compares the identity and timestamps of two directories.
+ */
+static int stamp_equal(const struct DirStamp *a, const struct DirStamp *b) {
+    return a->dev == b->dev && a->ino == b->ino && a->mtime_sec == b->mtime_sec &&
+           a->mtime_nsec == b->mtime_nsec && a->ctime_sec == b->ctime_sec && a->ctime_nsec == b->ctime_nsec;
+}
+
+/**
+ * @brief Orders records by device, then inode.
+ */
+static int compare_records(const void *a, const void *b) {
+    const struct DirStamp *x = &((const struct CacheRecord *)a)->stamp;
+    const struct DirStamp *y = &((const struct CacheRecord *)b)->stamp;
+    if (x->dev != y->dev) {
+        return x->dev < y->dev ? -1 : 1;
+    }
+    if (x->ino != y->ino) {
+        return x->ino < y->ino ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Grows a buffer so that it holds at least needed elements.
+ *
+ * @param buffer The buffer, reallocated when needed.
+ * @param capacity The buffer's capacity in elements.
+ * @param needed The number of elements needed.
+ * @param element The size of an element.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int reserve(void **buffer, size_t *capacity, size_t needed, size_t element) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+
+    size_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    void *tmp = realloc(*buffer, new_capacity * element);
+    if (!tmp) {
+        return -1;
+    }
+    *buffer = tmp;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * @brief Writes the header, the sorted records and the blobs of all writers.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int write_file(FILE *file, const struct CacheRecord *records, size_t count,
+                      struct CacheWriter *const *writers, int num_writers, size_t blob_size) {
+    struct CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.record_size = sizeof(struct CacheRecord);
+    header.count = count;
+    header.blob_size = blob_size;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(records, sizeof(struct CacheRecord), count, file) != count) {
+        return -1;
+    }
+    for (int i = 0; i < num_writers; i++) {
+        if (fwrite(writers[i]->blob, 1, writers[i]->blob_len, file) != writers[i]->blob_len) {
+            return -1;
+        }
+    }
+    return 0;
+}
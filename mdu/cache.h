@@ -0,0 +1,191 @@
+/**
+ * @file cache.h
+ * @brief Persistent cache of directory contents, used to skip unchanged directories.
+ *
+ * For every directory read, the cache records its timestamps, the size of the files
+ * directly in it, the files in it with several hard links, and the names of its
+ * subdirectories. A directory's mtime changes whenever an entry is added, removed or
+ * renamed, but not when something deeper in its subtree changes, so a later run can
+ * skip readdir and the stat of every file in a directory with unchanged timestamps,
+ * but still has to look at each of its subdirectories. Files modified in place, or given
+ * a new hard link elsewhere, do not change their directory's timestamps and are not
+ * noticed until the directory changes.
+ *
+ * The file is memory-mapped read-only: a header, then the records sorted by device
+ * and inode, then a blob holding each record's links and names. It is written in
+ * native byte order and is only meant to be read on the machine that wrote it.
+ *
+ * Error handling: Functions return -1 on failure. An unreadable or corrupt cache file
+ * is reported and treated as empty.
+ *
+ * Memory management: A cache must be released with `cache_close`, builders with
+ * `cache_builder_destroy` and writers with `cache_writer_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Identity and timestamps of a directory. An inode number of zero means unknown. */
+struct DirStamp {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t ctime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+};
+
+/* A file with several hard links, counted through the inode set when replayed. */
+struct CacheLink {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+};
+
+/* On-disk record of a directory. offset points into the blob, at num_links links followed by the names. */
+struct CacheRecord {
+    struct DirStamp stamp;
+    int64_t size;
+    uint64_t offset;
+    uint64_t names_len;
+    uint32_t num_links;
+    uint32_t num_dirs;
+};
+
+struct Cache {
+    void *map;
+    size_t map_size;
+    const struct CacheRecord *records;
+    size_t count;
+    const char *blob;
+    size_t blob_size;
+};
+
+/* Contents of an unchanged directory. names holds names_len bytes of NUL-terminated names. */
+struct CacheDir {
+    off_t size;
+    const struct CacheLink *links;
+    size_t num_links;
+    const char *names;
+    size_t names_len;
+};
+
+/* Contents of a directory as it is being read, to be added to a writer once complete. */
+struct CacheBuilder {
+    off_t size;
+    struct CacheLink *links;
+    size_t num_links;
+    size_t links_capacity;
+    char *names;
+    size_t names_len;
+    size_t names_capacity;
+    uint32_t num_dirs;
+};
+
+/* Records collected by one worker for the next cache file. */
+struct CacheWriter {
+    struct CacheRecord *records;
+    size_t count;
+    size_t capacity;
+    char *blob;
+    size_t blob_len;
+    size_t blob_capacity;
+};
+
+/**
+ * @brief Maps a cache file.
+ *
+ * A missing, unreadable or corrupt file gives an empty cache.
+ *
+ * @param cache The cache to open.
+ * @param path Path of the cache file.
+ */
+void cache_open(struct Cache *cache, const char *path);
+
+/**
+ * @brief Unmaps a cache file.
+ *
+ * @param cache The cache to close.
+ */
+void cache_close(struct Cache *cache);
+
+/**
+ * @brief Looks up a directory whose timestamps have not changed since it was cached.
+ *
+ * @param cache The cache.
+ * @param stamp The directory's current identity and timestamps.
+ * @param dir Filled in with the directory's cached contents on a hit.
+ * @return 1 on a hit, 0 if the directory is not cached or has changed.
+ */
+int cache_lookup(const struct Cache *cache, const struct DirStamp *stamp, struct CacheDir *dir);
+
+/**
+ * @brief Empties a builder, keeping its buffers.
+ *
+ * @param builder The builder.
+ */
+void cache_builder_reset(struct CacheBuilder *builder);
+
+/**
+ * @brief Adds a file with several hard links to a builder.
+ *
+ * @param builder The builder.
+ * @param link The file's device, inode and size.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int cache_builder_add_link(struct CacheBuilder *builder, const struct CacheLink *link);
+
+/**
+ * @brief Adds a subdirectory to a builder.
+ *
+ * @param builder The builder.
+ * @param name The subdirectory's name.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int cache_builder_add_dir(struct CacheBuilder *builder, const char *name);
+
+/**
+ * @brief Frees the buffers of a builder.
+ *
+ * @param builder The builder.
+ */
+void cache_builder_destroy(struct CacheBuilder *builder);
+
+/**
+ * @brief Adds the contents of a completely read directory to a writer.
+ *
+ * @param writer The writer.
+ * @param stamp The directory's identity and timestamps, as they were before it was read.
+ * @param builder The directory's contents.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int cache_writer_add(struct CacheWriter *writer, const struct DirStamp *stamp, const struct CacheBuilder *builder);
+
+/**
+ * @brief Frees the buffers of a writer.
+ *
+ * @param writer The writer.
+ */
+void cache_writer_destroy(struct CacheWriter *writer);
+
+/**
+ * @brief Writes the records of several writers to a new cache file.
+ *
+ * The file is written next to path and renamed over it, so a concurrent run
+ * never maps a partly written cache.
+ *
+ * @param path Path of the cache file.
+ * @param writers The writers.
+ * @param count Number of writers.
+ * @return 0 on success, -1 on failure.
+ */
+int cache_write(const char *path, struct CacheWriter *const *writers, int count);
+
+#endif // CACHE_H
@@ -0,0 +1,216 @@
+/**
+ * @file dirtree.c
+ * @brief Tree of the directories visited during a traversal.
+ *
+ * This file implements node creation and recycling, the bottom-up roll-up of subtotals as
+ * subtrees complete, and rebuilding of full paths from the parent chain.
+ *
+ * Error handling: Allocation failures are reported by returning NULL, except while
+ * printing, where they end the program.
+ *
+ * Memory management: Nodes are allocated from the caller's pool. A recycled node is linked
+ * into its free list through its next pointer. Paths built by `node_path` must be freed by
+ * the caller.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "dirtree.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int size_class(size_t name_len);
+static size_t path_length(const struct DirNode *node, const char *entry_name);
+static void fill_path(char *path, size_t len, const struct DirNode *node, const char *entry_name);
+
+void node_pool_init(struct NodePool *pool) {
+    arena_init(&pool->arena);
+    for (int i = 0; i < NODE_SIZE_CLASSES; i++) {
+        pool->free_lists[i] = NULL;
+    }
+    pool->path = NULL;
+    pool->path_capacity = 0;
+}
+
+void node_pool_destroy(struct NodePool *pool) {
+    arena_destroy(&pool->arena);
+    free(pool->path);
+    node_pool_init(pool);
+}
+
+struct DirNode *create_node(struct NodePool *pool, struct Root *root, struct DirNode *parent, const char *name,
+                            off_t size) {
+    size_t name_len = strlen(name);
+    int class = size_class(name_len);
+    struct DirNode *node;
+
+    if (class < NODE_SIZE_CLASSES && pool->free_lists[class]) {
+        node = pool->free_lists[class];
+        pool->free_lists[class] = node->next;
+    } else if (class < NODE_SIZE_CLASSES) {
+        node = arena_alloc(&pool->arena, (size_t)(class + 1) * NODE_SIZE_STEP);
+    } else {
+        node = arena_alloc(&pool->arena, sizeof(struct DirNode) + name_len + 1);
+    }
+    if (!node) {
+        return NULL;
+    }
+    node->root = parent ? parent->root : root;
+    node->parent = parent;
+    node->prev = NULL;
+    node->next = NULL;
+    atomic_init(&node->subtotal, size);
+    node->depth = parent ? parent->depth + 1 : 0;
+    node->fd = -1;
+    memset(&node->stamp, 0, sizeof(struct DirStamp));
+    atomic_init(&node->fd_users, 0);
+    atomic_init(&node->remaining, 1);
+    memcpy(node->name, name, name_len + 1);
+
+    if (parent) {
+        atomic_fetch_add(&parent->remaining, 1);
+    }
+    return node;
+}
+
+void release_node(struct NodePool *pool, struct DirNode *node, int print_depth) {
+    while (node && atomic_fetch_sub(&node->remaining, 1) == 1) {
+        struct DirNode *parent = node->parent;
+        if (node->fd != -1) {
+            close(node->fd);
+            node->fd = -1;
+        }
+        if (parent) {
+            off_t subtotal = atomic_load(&node->subtotal);
+            atomic_fetch_add(&parent->subtotal, subtotal);
+            if (node->depth <= print_depth) {
+                print_entry(pool, subtotal, node, NULL);
+            }
+
+            int class = size_class(strlen(node->name));
+            if (class < NODE_SIZE_CLASSES) {
+                node->next = pool->free_lists[class];
+                pool->free_lists[class] = node;
+            }
+        }
+        node = parent;
+    }
+}
+
+void release_node_fd(struct DirNode *node) {
+    if (atomic_fetch_sub(&node->fd_users, 1) == 1) {
+        if (close(node->fd) != 0) {
+            fprintf(stderr, "close failed: %s\n", strerror(errno));
+        }
+        node->fd = -1;
+    }
+}
+
+char *node_path(const struct DirNode *node, const char *entry_name) {
+    size_t len = path_length(node, entry_name);
+    char *path = malloc(len + 1);
+    if (!path) {
+        return NULL;
+    }
+    fill_path(path, len, node, entry_name);
+    return path;
+}
+
+void print_size(FILE *out, off_t size, const struct DirNode *node, const char *entry_name) {
+    char *path = node_path(node, entry_name);
+    if (!path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(out, "%ld\t%s\n", (long)((size + 511) / 512), path);
+    free(path);
+}
+
+void print_entry(struct NodePool *pool, off_t size, const struct DirNode *node, const char *entry_name) {
+    size_t len = path_length(node, entry_name);
+    if (len + 1 > pool->path_capacity) {
+        size_t capacity = pool->path_capacity ? pool->path_capacity : 256;
+        while (len + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *tmp = realloc(pool->path, capacity);
+        if (!tmp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        pool->path = tmp;
+        pool->path_capacity = capacity;
+    }
+    fill_path(pool->path, len, node, entry_name);
+
+    struct Root *root = node->root;
+    int ret = pthread_mutex_lock(&root->mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    fprintf(root->out, "%ld\t%s\n", (long)((size + 511) / 512), pool->path);
+    ret = pthread_mutex_unlock(&root->mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Returns the size class of a node with a name of the given length.
+ *
+ * @return The class, or NODE_SIZE_CLASSES if the node is too large to be recycled.
+ */
+static int size_class(size_t name_len) {
+    size_t size = sizeof(struct DirNode) + name_len + 1;
+    size_t class = (size - 1) / NODE_SIZE_STEP;
+    return class < NODE_SIZE_CLASSES ? (int)class : NODE_SIZE_CLASSES;
+}
+
+/**
+ * @brief Returns the length of the full path of a node or entry, without the terminator.
+ */
+static size_t path_length(const struct DirNode *node, const char *entry_name) {
+    size_t len = 0;
+    if (entry_name) {
+        len = strlen(entry_name) + 1;
+    }
+    for (const struct DirNode *n = node; n; n = n->parent) {
+        len += strlen(n->name) + (n->parent ? 1 : 0);
+    }
+    return len;
+}
+
+/**
+ * @brief Writes the full path of a node or entry, from its last component backwards.
+ *
+ * @param path Buffer of at least len + 1 bytes.
+ * @param len The length returned by `path_length`.
+ * @param node The node.
+ * @param entry_name Name of an entry within the node, or NULL for the node itself.
+ */
+static void fill_path(char *path, size_t len, const struct DirNode *node, const char *entry_name) {
+    char *end = path + len;
+    *end = '\0';
+    if (entry_name) {
+        size_t name_len = strlen(entry_name);
+        end -= name_len;
+        memcpy(end, entry_name, name_len);
+        *--end = '/';
+    }
+    for (const struct DirNode *n = node; n; n = n->parent) {
+        size_t name_len = strlen(n->name);
+        end -= name_len;
+        memcpy(end, n->name, name_len);
+        if (n->parent) {
+            *--end = '/';
+        }
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * @file dirtree.h
+ * @brief Tree of the directories visited during a traversal.
+ *
+ * Every directory found gets a node linked to its parent. A node counts the
+ * references that keep it open: itself while it is being read, plus each
+ * subdirectory whose subtree is not finished yet. When that count drops to
+ * zero the subtree is complete, and its size is added to the parent's. This
+ * gives a subtotal for every directory in a single parallel pass.
+ *
+ * Error handling: Allocation failures are reported by returning NULL.
+ *
+ * Memory management: Nodes come from a per-worker pool. A completed node is put back on the
+ * free list of the worker that completed it, so memory stays proportional to the directories
+ * in flight rather than to the size of the tree. The pool's arena is freed in one go.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef DIRTREE_H
+#define DIRTREE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include "arena.h"
+#include "cache.h"
+
+/* Node sizes are rounded up to multiples of NODE_SIZE_STEP; larger nodes are not recycled. */
+#define NODE_SIZE_STEP 64
+#define NODE_SIZE_CLASSES 6
+
+struct DirNode;
+
+/*
+ * Allocation state owned by one worker: recycled nodes by size class, and a buffer reused
+ * for the paths printed by the worker.
+ */
+struct NodePool {
+    struct Arena arena;
+    struct DirNode *free_lists[NODE_SIZE_CLASSES];
+    char *path;
+    size_t path_capacity;
+};
+
+/*
+ * A path given on the command line. The lines printed for the directories and files below it
+ * go to out, which is stdout or an in-memory stream when several roots are traversed together,
+ * so that the output of each root can be printed in argument order. node is the root's node,
+ * and index the position of the path among the arguments. The mutex serializes the lines
+ * written by different workers.
+ */
+struct Root {
+    struct DirNode *node;
+    int index;
+    pthread_mutex_t mutex;
+    FILE *out;
+    char *buffer;
+    size_t buffer_size;
+};
+
+/*
+ * Children are opened relative to their parent's descriptor, so a node keeps
+ * its directory open until every child has done its openat(). Full paths are
+ * only rebuilt from the parent chain when they have to be printed. A root
+ * node has no parent and its name is the path given on the command line.
+ * prev and next link the node into a work deque while it is queued. stamp
+ * identifies the directory in the cache.
+ */
+struct DirNode {
+    struct Root *root;
+    struct DirNode *parent;
+    struct DirNode *prev;
+    struct DirNode *next;
+    atomic_llong subtotal;
+    int depth;
+    int fd;
+    atomic_int fd_users;
+    atomic_int remaining;
+    struct DirStamp stamp;
+    char name[];
+};
+
+/**
+ * @brief Initializes an empty node pool.
+ *
+ * @param pool The pool to initialize.
+ */
+void node_pool_init(struct NodePool *pool);
+
+/**
+ * @brief Frees every node allocated from a pool, in use or not.
+ *
+ * @param pool The pool to destroy.
+ */
+void node_pool_destroy(struct NodePool *pool);
+
+/**
+ * @brief Creates a node for a directory.
+ *
+ * The parent's child-remaining count is incremented, and the node belongs to the parent's root.
+ *
+ * @param pool The pool to allocate the node from.
+ * @param root The root the node belongs to. Only used when parent is NULL.
+ * @param parent The parent directory, or NULL for a root.
+ * @param name The entry name, or the path for a root.
+ * @param size The size of the directory entry itself.
+ * @return The node, or NULL if it could not be allocated.
+ */
+struct DirNode *create_node(struct NodePool *pool, struct Root *root, struct DirNode *parent, const char *name,
+                            off_t size);
+
+/**
+ * @brief Drops one reference to a node.
+ *
+ * When the last reference goes the subtree is complete: its subtotal is added
+ * to the parent, the line for the directory is printed if its depth is at most
+ * print_depth, and the parent's reference is dropped in turn. The completed node
+ * is then returned to the pool. Roots are neither printed nor returned here,
+ * since their totals are read once the traversal is done.
+ *
+ * @param pool The calling worker's pool.
+ * @param node The node.
+ * @param print_depth Deepest directory level to print, or -1 to print none.
+ */
+void release_node(struct NodePool *pool, struct DirNode *node, int print_depth);
+
+/**
+ * @brief Marks that one child has opened itself relative to the node's descriptor.
+ *
+ * The descriptor is closed once every child has done so.
+ *
+ * @param node The parent node.
+ */
+void release_node_fd(struct DirNode *node);
+
+/**
+ * @brief Builds the full path of a node, or of an entry within it.
+ *
+ * @param node The node.
+ * @param entry_name Name of an entry within the node, or NULL for the node itself.
+ * @return A dynamically allocated path, or NULL if it could not be allocated.
+ */
+char *node_path(const struct DirNode *node, const char *entry_name);
+
+/**
+ * @brief Prints a size in 512-byte blocks followed by the path of a node or entry.
+ *
+ * @param out The stream to print to.
+ * @param size The size in bytes.
+ * @param node The node.
+ * @param entry_name Name of an entry within the node, or NULL for the node itself.
+ */
+void print_size(FILE *out, off_t size, const struct DirNode *node, const char *entry_name);
+
+/**
+ * @brief Prints a size and path to the output of the root a node belongs to.
+ *
+ * @param pool The calling worker's pool, whose buffer is used to build the path.
+ * @param size The size in bytes.
+ * @param node The node.
+ * @param entry_name Name of an entry within the node, or NULL for the node itself.
+ */
+void print_entry(struct NodePool *pool, off_t size, const struct DirNode *node, const char *entry_name);
+
+#endif // DIRTREE_H
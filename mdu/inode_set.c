@@ -0,0 +1,170 @@
+/**
+ * @file inode_set.c
+ * @brief Concurrent set of inodes used to count hard-linked files once.
+ *
+ * The shard is picked from the high bits of the key's hash and the slot from
+ * its low bits. Each shard uses linear probing and doubles its table when it
+ * becomes more than half full. A zero inode number marks an empty slot.
+ * Lookups only compare the device and inode of an entry.
+ *
+ * Error handling: Functions return -1 on failure.
+ *
+ * Memory management: The shard tables are freed by `inode_set_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "inode_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SHARD_CAPACITY 64
+
+static uint64_t hash_key(uint64_t dev, uint64_t ino);
+static struct InodeEntry *shard_find(const struct InodeShard *shard, uint64_t hash, struct InodeEntry key);
+static int grow_shard(struct InodeShard *shard);
+static void insert_slot(struct InodeEntry *slots, size_t capacity, uint64_t hash, struct InodeEntry key);
+
+int inode_set_init(struct InodeSet *set) {
+    for (int i = 0; i < INODE_SET_SHARDS; i++) {
+        struct InodeShard *shard = &set->shards[i];
+        int ret = pthread_mutex_init(&shard->mutex, NULL);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(ret));
+            for (int j = 0; j < i; j++) {
+                pthread_mutex_destroy(&set->shards[j].mutex);
+            }
+            return -1;
+        }
+        shard->slots = NULL;
+        shard->capacity = 0;
+        shard->count = 0;
+    }
+    return 0;
+}
+
+void inode_set_destroy(struct InodeSet *set) {
+    for (int i = 0; i < INODE_SET_SHARDS; i++) {
+        pthread_mutex_destroy(&set->shards[i].mutex);
+        free(set->shards[i].slots);
+    }
+}
+
+int inode_set_insert(struct InodeSet *set, uint64_t dev, uint64_t ino, int64_t size, int root) {
+    uint64_t hash = hash_key(dev, ino);
+    struct InodeShard *shard = &set->shards[hash >> 56];
+    struct InodeEntry key = {dev, ino, size, root, root};
+    struct InodeEntry *found;
+    int inserted = 1;
+
+    int ret = pthread_mutex_lock(&shard->mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+
+    if ((found = shard_find(shard, hash, key)) != NULL) {
+        if (root < found->first_root) {
+            found->first_root = root;
+        }
+        inserted = 0;
+    } else if ((shard->count + 1) * 2 > shard->capacity && grow_shard(shard) != 0) {
+        inserted = -1;
+    } else {
+        insert_slot(shard->slots, shard->capacity, hash, key);
+        shard->count++;
+    }
+
+    ret = pthread_mutex_unlock(&shard->mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    return inserted;
+}
+
+void inode_set_for_each(const struct InodeSet *set, void (*fn)(const struct InodeEntry *entry, void *arg),
+                        void *arg) {
+    for (int i = 0; i < INODE_SET_SHARDS; i++) {
+        const struct InodeShard *shard = &set->shards[i];
+        for (size_t j = 0; j < shard->capacity; j++) {
+            if (shard->slots[j].ino != 0) {
+                fn(&shard->slots[j], arg);
+            }
+        }
+    }
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Mixes a device and inode number into a well-distributed 64-bit hash.
+ */
+static uint64_t hash_key(uint64_t dev, uint64_t ino) {
+    uint64_t x = ino ^ (dev * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief Finds the entry of a key in a shard.
+ *
+ * @return The entry, or NULL if the shard does not hold the key.
+ */
+static struct InodeEntry *shard_find(const struct InodeShard *shard, uint64_t hash, struct InodeEntry key) {
+    if (shard->capacity == 0) {
+        return NULL;
+    }
+
+    size_t mask = shard->capacity - 1;
+    for (size_t i = hash & mask; shard->slots[i].ino != 0; i = (i + 1) & mask) {
+        if (shard->slots[i].ino == key.ino && shard->slots[i].dev == key.dev) {
+            return &shard->slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Doubles the table of a shard and rehashes its keys.
+ *
+ * @param shard The shard, locked by the caller.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int grow_shard(struct InodeShard *shard) {
+    size_t capacity = shard->capacity ? shard->capacity * 2 : INITIAL_SHARD_CAPACITY;
+    struct InodeEntry *slots = calloc(capacity, sizeof(struct InodeEntry));
+    if (!slots) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < shard->capacity; i++) {
+        struct InodeEntry key = shard->slots[i];
+        if (key.ino != 0) {
+            insert_slot(slots, capacity, hash_key(key.dev, key.ino), key);
+        }
+    }
+
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Stores a key in the first free slot of its probe sequence.
+ */
+static void insert_slot(struct InodeEntry *slots, size_t capacity, uint64_t hash, struct InodeEntry key) {
+    size_t mask = capacity - 1;
+    size_t i = hash & mask;
+    while (slots[i].ino != 0) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = key;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file inode_set.h
+ * @brief Concurrent set of inodes used to count hard-linked files once.
+ *
+ * The set is split into independently locked shards, so threads inserting
+ * different inodes rarely contend for the same lock. Each shard is an
+ * open-addressing hash table that grows when it gets too full.
+ *
+ * Each inode remembers the root it was counted under and the lowest root any of
+ * its links was found under. Which root sees a link first depends on the
+ * scheduling of the workers, so once the traversal is done the size of an inode
+ * shared by several roots is moved to the lowest one, like du charges it to the
+ * first argument.
+ *
+ * Error handling: Functions return -1 on failure.
+ *
+ * Memory management: A set must be released with `inode_set_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef INODE_SET_H
+#define INODE_SET_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define INODE_SET_SHARDS 256
+
+struct InodeEntry {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int counted_root;
+    int first_root;
+};
+
+struct InodeShard {
+    _Alignas(64) pthread_mutex_t mutex;
+    struct InodeEntry *slots;
+    size_t capacity;
+    size_t count;
+};
+
+struct InodeSet {
+    struct InodeShard shards[INODE_SET_SHARDS];
+};
+
+/**
+ * @brief Initializes an empty set.
+ *
+ * @param set The set to initialize.
+ * @return 0 on success, -1 on failure.
+ */
+int inode_set_init(struct InodeSet *set);
+
+/**
+ * @brief Releases all memory held by a set.
+ *
+ * @param set The set to destroy.
+ */
+void inode_set_destroy(struct InodeSet *set);
+
+/**
+ * @brief Adds an inode to the set, or records another root it was found under.
+ *
+ * @param set The set.
+ * @param dev Device the inode lives on.
+ * @param ino Inode number.
+ * @param size The size counted for the inode when it is added.
+ * @param root Index of the root the link was found under.
+ * @return 1 if the inode was added, 0 if it was already present, -1 if memory ran out.
+ */
+int inode_set_insert(struct InodeSet *set, uint64_t dev, uint64_t ino, int64_t size, int root);
+
+/**
+ * @brief Calls a function for every inode in the set.
+ *
+ * Must not run concurrently with `inode_set_insert`.
+ *
+ * @param set The set.
+ * @param fn The function to call with each inode.
+ * @param arg Passed on to fn.
+ */
+void inode_set_for_each(const struct InodeSet *set, void (*fn)(const struct InodeEntry *entry, void *arg),
+                        void *arg);
+
+#endif // INODE_SET_H
@@ -4,7 +4,17 @@
  *
  * This file contains the main function which parses the command-line arguments,
  * initializes the necessary worker threads, and manages the disk usage calculation.
- * It supports parallel processing using the `-j` flag to specify the number of threads.
+ * It supports parallel processing using the `-j` flag to specify the number of threads, or
+ * `-j auto` to let a tuner grow and shrink the set of active threads while the traversal runs, and
+ * `--engine=uring` to let each thread keep many metadata requests in flight through io_uring.
+ * Like du, a file with several hard links is counted once per invocation unless `-l` is given,
+ * in the total of the first argument it is found under.
+ * With `-d N` the subtotal of every directory at most N levels below an argument is printed as
+ * well, and `-a` also prints files. The subtotals are computed in the same parallel pass.
+ * All paths are traversed together by one pool of threads, and printed in argument order.
+ * With `--cache=FILE`, directories whose timestamps are unchanged since the previous run are
+ * not read again; only their subdirectories are looked at. `--stats=csv|json` prints per-worker
+ * counters, lock and idle times and queue depth samples to stderr once the traversal is done.
  * 
  * Memory management: Memory for paths and thread data is dynamically allocated and cleaned up.
  * 
@@ -19,94 +29,194 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
+#include <limits.h>
+#include <time.h>
 #include "thread.h"
 #include "worker.h"
+#include "uring.h"
+#include "cache.h"
+#include "stats.h"
+#include "tuner.h"
 
 static char **parse_paths(int argc, char *argv[], int *num_paths, int *exit_code);
+static struct Root *create_roots(char **paths, int num_paths, struct ThreadData *data);
+static void charge_first_root(const struct InodeEntry *entry, void *arg);
+static void print_root(struct Root *root);
 static int start_worker_threads(int num_threads, pthread_t **threads, struct ThreadData *data);
+static int save_cache(const char *path, struct ThreadData *data);
+static void monitor_traversal(struct ThreadData *data, struct QueueSamples *samples, struct Tuner *tuner,
+                              uint64_t start);
 
 int main(int argc, char *argv[]) {
     int num_threads = 1;
+    int auto_threads = 0;
+    int use_uring = 0;
+    int count_links = 0;
+    int print_depth = -1;
+    int all_files = 0;
+    const char *cache_path = NULL;
+    enum StatsFormat stats = STATS_NONE;
     int opt;
     int exit_code = EXIT_SUCCESS;
 
-    while ((opt = getopt(argc, argv, "j:")) != -1) {
-        if (opt == 'j') {
+    static const struct option long_options[] = {
+        {"engine", required_argument, NULL, 'e'},
+        {"cache", required_argument, NULL, 'c'},
+        {"stats", required_argument, NULL, 'S'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((opt = getopt_long(argc, argv, "ad:j:l", long_options, NULL)) != -1) {
+        if (opt == 'j' && strcmp(optarg, "auto") == 0) {
+            auto_threads = 1;
+            num_threads = tuner_max_workers();
+        } else if (opt == 'j') {
+            auto_threads = 0;
             num_threads = atoi(optarg);
             if (num_threads < 1) {
                 fprintf(stderr, "Invalid number of threads: %s\n", optarg);
                 exit(EXIT_FAILURE);
             }
+        } else if (opt == 'a') {
+            all_files = 1;
+        } else if (opt == 'd') {
+            char *end;
+            long depth = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || depth < 0 || depth > INT_MAX) {
+                fprintf(stderr, "Invalid depth: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            print_depth = (int)depth;
+        } else if (opt == 'l') {
+            count_links = 1;
+        } else if (opt == 'c') {
+            cache_path = optarg;
+        } else if (opt == 'S' && stats_format(optarg) != STATS_NONE) {
+            stats = stats_format(optarg);
+        } else if (opt == 'e' && strcmp(optarg, "threads") == 0) {
+            use_uring = 0;
+        } else if (opt == 'e' && strcmp(optarg, "uring") == 0) {
+            use_uring = 1;
         } else {
-            fprintf(stderr, "Usage: %s [-j num_threads] file ...\n", argv[0]);
+            fprintf(stderr, "Usage: %s [-a] [-d depth] [-j num_threads|auto] [-l] [--engine=threads|uring] [--cache=file] [--stats=csv|json] file ...\n", argv[0]);
             exit(EXIT_FAILURE);
         }
     }
 
-    int num_paths = 0;
-    char **paths = parse_paths(argc, argv, &num_paths, &exit_code);
-    if (!paths) {
-        exit(exit_code);
+    if (all_files && print_depth == -1) {
+        print_depth = INT_MAX;
     }
 
-    for (int i = 0; i < num_paths; i++) {
-        struct ThreadData *data = malloc(sizeof(struct ThreadData));
-        if (!data) {
+    if (use_uring && !uring_supported()) {
+        fprintf(stderr, "du: io_uring is not available, using blocking calls\n");
+        use_uring = 0;
+    }
+
+    struct InodeSet *inodes = NULL;
+    if (!count_links) {
+        inodes = malloc(sizeof(struct InodeSet));
+        if (!inodes) {
             perror("malloc");
             exit(EXIT_FAILURE);
         }
-        if (thread_data_init(data) != 0) {
-            free(data);
+        if (inode_set_init(inodes) != 0) {
             exit(EXIT_FAILURE);
         }
+    }
 
-        data->pending = 1;
-        char *path = strdup(paths[i]);
-        if (!path) {
-            perror("strdup");
-            thread_data_destroy(data);
-            free(data);
-            exit(EXIT_FAILURE);
-        }
+    int num_paths = 0;
+    char **paths = parse_paths(argc, argv, &num_paths, &exit_code);
+    if (!paths) {
+        exit(exit_code);
+    }
 
-        if (enqueue(data, path) != 0) {
-            perror("enqueue");
-            free(path);
-            thread_data_destroy(data);
-            free(data);
-            exit(EXIT_FAILURE);
-        }
+    struct ThreadData *data = malloc(sizeof(struct ThreadData));
+    if (!data) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    if (thread_data_init(data, num_threads) != 0) {
+        free(data);
+        exit(EXIT_FAILURE);
+    }
+    data->use_uring = use_uring;
+    data->inodes = inodes;
+    data->print_depth = print_depth;
+    data->all_files = all_files;
+    data->collect_stats = stats != STATS_NONE;
+
+    /* Files in cached directories are not known by name, so -a always reads every directory. */
+    struct Cache cache;
+    if (cache_path) {
+        cache_open(&cache, cache_path);
+        data->cache = all_files ? NULL : &cache;
+        data->write_cache = 1;
+    }
+
+    struct Root *roots = create_roots(paths, num_paths, data);
 
-        pthread_t *threads = NULL;
-        if (start_worker_threads(num_threads, &threads, data) != 0) {
-            thread_data_destroy(data);
-            free(data);
+    struct QueueSamples samples = {NULL, 0, 0};
+    struct Tuner tuner;
+    uint64_t start = stats_now();
+    if (auto_threads) {
+        tuner_init(&tuner, data, start);
+    }
+    pthread_t *threads = NULL;
+    if (start_worker_threads(num_threads, &threads, data) != 0) {
+        thread_data_destroy(data);
+        free(data);
+        exit(EXIT_FAILURE);
+    }
+    if (stats != STATS_NONE || auto_threads) {
+        monitor_traversal(data, stats != STATS_NONE ? &samples : NULL, auto_threads ? &tuner : NULL, start);
+    }
+
+    for (int t = 0; t < num_threads; t++) {
+        int ret = pthread_join(threads[t], NULL);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_join failed: %s\n", strerror(ret));
             exit(EXIT_FAILURE);
         }
+    }
 
-        for (int t = 0; t < num_threads; t++) {
-            int ret = pthread_join(threads[t], NULL);
-            if (ret != 0) {
-                fprintf(stderr, "pthread_join failed: %s\n", strerror(ret));
-                exit(EXIT_FAILURE);
-            }
-        }
+    uint64_t elapsed = stats_now() - start;
 
-        if (data->error_occurred) {
+    thread_data_merge(data);
+    if (data->error_occurred) {
+        exit_code = EXIT_FAILURE;
+    }
+    if (cache_path) {
+        if (save_cache(cache_path, data) != 0) {
             exit_code = EXIT_FAILURE;
         }
+        cache_close(&cache);
+    }
 
-        long total_blocks = (data->total_size + 511) / 512;
-        printf("%ld\t%s\n", total_blocks, paths[i]);
-
-        free(threads);
-        thread_data_destroy(data);
-        free(data);
+    if (inodes && num_paths > 1) {
+        inode_set_for_each(inodes, charge_first_root, roots);
     }
+    for (int i = 0; i < num_paths; i++) {
+        print_root(&roots[i]);
+    }
+    if (stats != STATS_NONE) {
+        fflush(stdout);
+        stats_print(stderr, stats, data, &samples, elapsed);
+        queue_samples_destroy(&samples);
+    }
+
+    free(roots);
+    free(threads);
+    thread_data_destroy(data);
+    free(data);
 
     if (paths != argv + optind) {
         free(paths);
     }
+    if (inodes) {
+        inode_set_destroy(inodes);
+        free(inodes);
+    }
 
     return exit_code;
 }
@@ -164,12 +274,92 @@ static char **parse_paths(int argc, char *argv[], int *num_paths, int *exit_code
     return paths;
 }
 
+/**
+ * @brief Creates a root for every path and spreads them over the workers' deques.
+ *
+ * With a single path, lines below it are printed directly. With several, and subtotals
+ * or files to print, each root collects its lines in memory until it is printed.
+ *
+ * @param paths The paths given on the command line.
+ * @param num_paths The number of paths.
+ * @param data Pointer to the thread data structure.
+ * @return A dynamically allocated array of roots, one per path.
+ */
+static struct Root *create_roots(char **paths, int num_paths, struct ThreadData *data) {
+    struct Root *roots = calloc(num_paths, sizeof(struct Root));
+    if (!roots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < num_paths; i++) {
+        struct Worker *worker = &data->workers[i % data->num_workers];
+        int ret = pthread_mutex_init(&roots[i].mutex, NULL);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+        roots[i].index = i;
+        roots[i].out = stdout;
+        if (num_paths > 1 && data->print_depth >= 0) {
+            roots[i].out = open_memstream(&roots[i].buffer, &roots[i].buffer_size);
+            if (!roots[i].out) {
+                perror("open_memstream");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        roots[i].node = create_node(&worker->nodes, &roots[i], NULL, paths[i], 0);
+        if (!roots[i].node) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        enqueue(worker, roots[i].node);
+    }
+    return roots;
+}
+
+/**
+ * @brief Moves the size of a hard-linked file to the first root it was found under.
+ *
+ * The workers count a file under whichever root reaches one of its links first, so
+ * without this the totals of roots sharing files would depend on scheduling.
+ *
+ * @param entry The file's entry in the inode set.
+ * @param arg The array of roots.
+ */
+static void charge_first_root(const struct InodeEntry *entry, void *arg) {
+    struct Root *roots = arg;
+    if (entry->counted_root != entry->first_root) {
+        atomic_fetch_sub(&roots[entry->counted_root].node->subtotal, entry->size);
+        atomic_fetch_add(&roots[entry->first_root].node->subtotal, entry->size);
+    }
+}
+
+/**
+ * @brief Prints the collected lines and the total of a root.
+ *
+ * @param root The root, whose traversal has completed.
+ */
+static void print_root(struct Root *root) {
+    if (root->out != stdout) {
+        if (fclose(root->out) != 0) {
+            perror("fclose");
+            exit(EXIT_FAILURE);
+        }
+        fwrite(root->buffer, 1, root->buffer_size, stdout);
+        free(root->buffer);
+    }
+    print_size(stdout, atomic_load(&root->node->subtotal), root->node, NULL);
+    pthread_mutex_destroy(&root->mutex);
+}
+
 /**
  * @brief Starts the worker threads for parallel processing.
  *
  * This function initializes and starts the worker threads based on the specified
- * number of threads. Each thread will process a portion of the file paths to calculate
- * the disk usage.
+ * number of threads. Each thread is given its own worker deque and will process a
+ * portion of the file paths to calculate the disk usage.
  * 
  * @param num_threads The number of threads to create.
  * @param threads Pointer to an array of thread handles.
@@ -184,7 +374,7 @@ static int start_worker_threads(int num_threads, pthread_t **threads, struct Thr
     }
 
     for (int t = 0; t < num_threads; t++) {
-        int ret = pthread_create(&(*threads)[t], NULL, worker_thread, data);
+        int ret = pthread_create(&(*threads)[t], NULL, worker_thread, &data->workers[t]);
         if (ret != 0) {
             fprintf(stderr, "pthread_create failed: %s\n", strerror(ret));
             free(*threads);
@@ -193,3 +383,55 @@ static int start_worker_threads(int num_threads, pthread_t **threads, struct Thr
     }
     return 0;
 }
+
+/**
+ * @brief Writes the directories read by all workers to a new cache file.
+ *
+ * @param path Path of the cache file.
+ * @param data Pointer to the thread data structure.
+ * @return 0 on success, -1 on failure.
+ */
+static int save_cache(const char *path, struct ThreadData *data) {
+    struct CacheWriter **writers = malloc(data->num_workers * sizeof(struct CacheWriter *));
+    if (!writers) {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < data->num_workers; i++) {
+        writers[i] = &data->workers[i].cache_writer;
+    }
+
+    int ret = cache_write(path, writers, data->num_workers);
+    free(writers);
+    return ret;
+}
+
+/**
+ * @brief Samples the queues and runs the tuner until the traversal is done.
+ *
+ * The deque sizes are read without their locks, so a sample may be off by the
+ * nodes that are being moved at that moment.
+ *
+ * @param data Pointer to the thread data structure.
+ * @param samples The samples to add to, or NULL.
+ * @param tuner The tuner for `-j auto`, or NULL.
+ * @param start Time the traversal started.
+ */
+static void monitor_traversal(struct ThreadData *data, struct QueueSamples *samples, struct Tuner *tuner,
+                              uint64_t start) {
+    struct timespec interval = {0, STATS_SAMPLE_NS};
+    while (atomic_load(&data->idle) != data->num_workers) {
+        uint64_t now = stats_now();
+        if (tuner) {
+            tuner_update(tuner, now);
+        }
+        if (samples) {
+            size_t depth = 0;
+            for (int i = 0; i < data->num_workers; i++) {
+                depth += atomic_load(&data->workers[i].deque.size);
+            }
+            queue_samples_add(samples, now - start, depth, atomic_load(&data->active));
+        }
+        nanosleep(&interval, NULL);
+    }
+}
@@ -1,29 +1,71 @@
 #!/bin/bash
 
 # Filnamn: mdu_benchmark.sh
+#
+# Mäter mdu på ett syntetiskt träd (eller en befintlig katalog) för varje
+# kombination av motor och antal trådar, och sparar väggtid tillsammans med
+# mdu:s egna mätvärden från --stats=csv.
+#
+# Användning: ./mdu_benchmark.sh [-f fanout] [-d djup] [-n filer] [-j "1 2 4 8"]
+#                                [-e "threads uring"] [-r körningar] [-o fil.csv] [katalog]
 
-# Skapa eller tömma filen som kommer att innehålla resultaten
-echo "Threads,RealTime,UserTime,SystemTime" > mdu_times.csv
+fanout=8
+depth=4
+files=32
+threads="1 2 4 8 16"
+engines="threads uring"
+runs=3
+output=mdu_times.csv
+tree=""
 
-for t in {1..100}
+while getopts "f:d:n:j:e:r:o:" opt
 do
-    # Använd Bashs inbyggda 'time' kommando och fånga upp tiderna
-    { time ./mdu -j $t /pkg/ > /dev/null 2>&1; } 2> temp_time.txt
-
-    # Extrahera real, user och sys tider från utdata
-    real_time=$(grep real temp_time.txt | awk '{print $2}')
-    user_time=$(grep user temp_time.txt | awk '{print $2}')
-    sys_time=$(grep sys temp_time.txt | awk '{print $2}')
-
-    # Konvertera tiderna till sekunder i decimalformat
-    real_sec=$(echo $real_time | awk -Fm '{split($2, s, "s"); print ($1 * 60) + s[1]}')
-    user_sec=$(echo $user_time | awk -Fm '{split($2, s, "s"); print ($1 * 60) + s[1]}')
-    sys_sec=$(echo $sys_time | awk -Fm '{split($2, s, "s"); print ($1 * 60) + s[1]}')
-
-    # Lägg till tiden till resultatfilen
-    echo "$t,$real_sec,$user_sec,$sys_sec" >> mdu_times.csv
-    echo "Körning med $t tråd(ar) klar"
+    case $opt in
+        f) fanout=$OPTARG ;;
+        d) depth=$OPTARG ;;
+        n) files=$OPTARG ;;
+        j) threads=$OPTARG ;;
+        e) engines=$OPTARG ;;
+        r) runs=$OPTARG ;;
+        o) output=$OPTARG ;;
+        *) sed -n '9,10p' "$0" >&2; exit 1 ;;
+    esac
 done
+shift $((OPTIND - 1))
+
+# Skapa det syntetiska trädet om ingen katalog angavs
+if [ $# -gt 0 ]
+then
+    # Ett befintligt träd har ingen känd form
+    tree=$1
+    fanout=
+    depth=
+    files=
+else
+    tree=bench_tree_f${fanout}_d${depth}_n${files}
+    ./mktree -f "$fanout" -d "$depth" -n "$files" "$tree" || exit 1
+fi
+
+# Skapa eller tömma filen som kommer att innehålla resultaten
+echo "engine,threads,run,fanout,depth,files,real_sec,$(./mdu --stats=csv /dev/null 2>&1 >/dev/null | head -n 1 | cut -d, -f2-)" > "$output"
 
-# Ta bort temporär fil
-rm temp_time.txt
+for engine in $engines
+do
+    for t in $threads
+    do
+        for run in $(seq 1 "$runs")
+        do
+            # Mät väggtiden och fånga upp totalraden från --stats
+            start=$(date +%s%N)
+            total=$(./mdu -j "$t" --engine="$engine" --stats=csv "$tree" 2>&1 >/dev/null | grep '^total,')
+            end=$(date +%s%N)
+
+            # Konvertera tiden till sekunder i decimalformat
+            real_sec=$(awk -v ns=$((end - start)) 'BEGIN {printf "%.4f", ns / 1e9}')
+
+            # Lägg till resultatet till resultatfilen
+            echo "$engine,$t,$run,$fanout,$depth,$files,$real_sec,${total#total,}" >> "$output"
+        done
+        echo "Körning med $engine och $t tråd(ar) klar"
+    done
+done
@@ -0,0 +1,145 @@
+/**
+ * @file mktree.c
+ * @brief Generates a synthetic directory tree for benchmarking mdu.
+ *
+ * Every directory above the given depth gets `fanout` subdirectories, and every
+ * directory gets `files` regular files of `size` bytes. The files are extended
+ * with ftruncate rather than written, so large trees are quick to create and take
+ * little space on file systems that support sparse files. Running it again on an
+ * existing tree is harmless.
+ *
+ * Usage: mktree [-f fanout] [-d depth] [-n files] [-s size] dir
+ *
+ * Error handling: Any failure to create a directory or file is reported and ends
+ * the program.
+ *
+ * Memory management: The path is built in a single fixed-size buffer.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct TreeShape {
+    long fanout;
+    long depth;
+    long files;
+    long size;
+};
+
+static long parse_number(const char *arg, const char *what);
+static void make_directory(const char *path);
+static void make_tree(char *path, size_t len, const struct TreeShape *shape, long depth);
+
+int main(int argc, char *argv[]) {
+    struct TreeShape shape = {4, 4, 16, 4096};
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:d:n:s:")) != -1) {
+        if (opt == 'f') {
+            shape.fanout = parse_number(optarg, "fan-out");
+        } else if (opt == 'd') {
+            shape.depth = parse_number(optarg, "depth");
+        } else if (opt == 'n') {
+            shape.files = parse_number(optarg, "number of files");
+        } else if (opt == 's') {
+            shape.size = parse_number(optarg, "file size");
+        } else {
+            fprintf(stderr, "Usage: %s [-f fanout] [-d depth] [-n files] [-s size] dir\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-f fanout] [-d depth] [-n files] [-s size] dir\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    char path[PATH_MAX];
+    size_t len = strlen(argv[optind]);
+    if (len >= sizeof(path)) {
+        fprintf(stderr, "mktree: path too long: %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(path, argv[optind], len + 1);
+
+    make_directory(path);
+    make_tree(path, len, &shape, 0);
+    return EXIT_SUCCESS;
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Parses a non-negative number given on the command line.
+ *
+ * @param arg The argument.
+ * @param what What the number is, for the error message.
+ * @return The number.
+ */
+static long parse_number(const char *arg, const char *what) {
+    char *end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < 0 || errno != 0) {
+        fprintf(stderr, "Invalid %s: %s\n", what, arg);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+/**
+ * @brief Creates a directory, unless it already exists.
+ *
+ * @param path Path of the directory.
+ */
+static void make_directory(const char *path) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "mktree: cannot create directory '%s': %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Fills a directory with files and, above the maximum depth, subdirectories.
+ *
+ * @param path Path of the directory, with room to append names up to PATH_MAX.
+ * @param len Length of the path.
+ * @param shape Shape of the tree.
+ * @param depth Depth of the directory below the top of the tree.
+ */
+static void make_tree(char *path, size_t len, const struct TreeShape *shape, long depth) {
+    for (long i = 0; i < shape->files; i++) {
+        int n = snprintf(path + len, PATH_MAX - len, "/f%ld", i);
+        if (n < 0 || (size_t)n >= PATH_MAX - len) {
+            fprintf(stderr, "mktree: path too long\n");
+            exit(EXIT_FAILURE);
+        }
+        int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1 || ftruncate(fd, shape->size) != 0) {
+            fprintf(stderr, "mktree: cannot create file '%s': %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+
+    if (depth < shape->depth) {
+        for (long i = 0; i < shape->fanout; i++) {
+            int n = snprintf(path + len, PATH_MAX - len, "/d%ld", i);
+            if (n < 0 || (size_t)n >= PATH_MAX - len) {
+                fprintf(stderr, "mktree: path too long\n");
+                exit(EXIT_FAILURE);
+            }
+            make_directory(path);
+            make_tree(path, len + n, shape, depth + 1);
+        }
+    }
+    path[len] = '\0';
+}
@@ -0,0 +1,154 @@
+/**
+ * @file stats.c
+ * @brief Per-worker metrics of a traversal, printed with `--stats`.
+ *
+ * This file implements the clock, the queue depth samples and the CSV and JSON
+ * output. Rates are computed against the wall time of the whole traversal, so
+ * that workers that were idle for part of it show a lower rate.
+ *
+ * Error handling: Allocation failures end the program.
+ *
+ * Memory management: Queue samples are freed by `queue_samples_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "stats.h"
+#include "thread.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void add_stats(struct WorkerStats *total, const struct WorkerStats *stats);
+static void print_csv_row(FILE *out, const char *name, const struct WorkerStats *stats, double seconds);
+static void print_json_object(FILE *out, const struct WorkerStats *stats, double seconds);
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+enum StatsFormat stats_format(const char *name) {
+    if (strcmp(name, "csv") == 0) {
+        return STATS_CSV;
+    }
+    if (strcmp(name, "json") == 0) {
+        return STATS_JSON;
+    }
+    return STATS_NONE;
+}
+
+void queue_samples_add(struct QueueSamples *samples, uint64_t time_ns, size_t depth, int active) {
+    if (samples->count == samples->capacity) {
+        size_t capacity = samples->capacity ? samples->capacity * 2 : 256;
+        struct QueueSample *tmp = realloc(samples->samples, capacity * sizeof(struct QueueSample));
+        if (!tmp) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        samples->samples = tmp;
+        samples->capacity = capacity;
+    }
+    samples->samples[samples->count].time_ns = time_ns;
+    samples->samples[samples->count].depth = depth;
+    samples->samples[samples->count].active = active;
+    samples->count++;
+}
+
+void queue_samples_destroy(struct QueueSamples *samples) {
+    free(samples->samples);
+    samples->samples = NULL;
+    samples->count = 0;
+    samples->capacity = 0;
+}
+
+void stats_print(FILE *out, enum StatsFormat format, const struct ThreadData *data,
+                 const struct QueueSamples *samples, uint64_t elapsed_ns) {
+    double seconds = elapsed_ns / 1e9;
+    struct WorkerStats total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < data->num_workers; i++) {
+        add_stats(&total, &data->workers[i].stats);
+    }
+
+    if (format == STATS_CSV) {
+        fprintf(out, "worker,entries,directories,entries_per_sec,idle_ms,lock_wait_ms,deque_wait_ms,"
+                     "steals,published,openat,statx,readdir,io_uring_enter\n");
+        for (int i = 0; i < data->num_workers; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "%d", i);
+            print_csv_row(out, name, &data->workers[i].stats, seconds);
+        }
+        print_csv_row(out, "total", &total, seconds);
+        return;
+    }
+
+    size_t max_depth = 0;
+    for (size_t i = 0; i < samples->count; i++) {
+        if (samples->samples[i].depth > max_depth) {
+            max_depth = samples->samples[i].depth;
+        }
+    }
+
+    fprintf(out, "{\"threads\": %d, \"engine\": \"%s\", \"elapsed_ms\": %.3f, \"max_queue_depth\": %zu,\n",
+            data->num_workers, data->use_uring ? "uring" : "threads", elapsed_ns / 1e6, max_depth);
+    fprintf(out, " \"total\": ");
+    print_json_object(out, &total, seconds);
+    fprintf(out, ",\n \"workers\": [");
+    for (int i = 0; i < data->num_workers; i++) {
+        fprintf(out, "%s\n  ", i == 0 ? "" : ",");
+        print_json_object(out, &data->workers[i].stats, seconds);
+    }
+    fprintf(out, "\n ],\n \"queue_depth\": [");
+    for (size_t i = 0; i < samples->count; i++) {
+        fprintf(out, "%s[%.3f, %zu, %d]", i == 0 ? "" : ", ", samples->samples[i].time_ns / 1e6,
+                samples->samples[i].depth, samples->samples[i].active);
+    }
+    fprintf(out, "]}\n");
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Adds the counters of one worker to a total.
+ */
+static void add_stats(struct WorkerStats *total, const struct WorkerStats *stats) {
+    total->entries += stats->entries;
+    total->directories += stats->directories;
+    total->openat += stats->openat;
+    total->statx += stats->statx;
+    total->readdir += stats->readdir;
+    total->uring_enter += stats->uring_enter;
+    total->steals += stats->steals;
+    total->published += stats->published;
+    total->idle_ns += stats->idle_ns;
+    total->lock_wait_ns += stats->lock_wait_ns;
+    total->deque_wait_ns += stats->deque_wait_ns;
+}
+
+/**
+ * @brief Prints the counters of one worker, or of the total, as a CSV row.
+ */
+static void print_csv_row(FILE *out, const char *name, const struct WorkerStats *stats, double seconds) {
+    fprintf(out, "%s,%" PRIu64 ",%" PRIu64 ",%.0f,%.3f,%.3f,%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                 ",%" PRIu64 ",%" PRIu64 "\n",
+            name, stats->entries, stats->directories, seconds > 0 ? stats->entries / seconds : 0.0,
+            stats->idle_ns / 1e6, stats->lock_wait_ns / 1e6, stats->deque_wait_ns / 1e6, stats->steals,
+            stats->published, stats->openat, stats->statx, stats->readdir, stats->uring_enter);
+}
+
+/**
+ * @brief Prints the counters of one worker, or of the total, as a JSON object.
+ */
+static void print_json_object(FILE *out, const struct WorkerStats *stats, double seconds) {
+    fprintf(out, "{\"entries\": %" PRIu64 ", \"directories\": %" PRIu64 ", \"entries_per_sec\": %.0f, "
+                 "\"idle_ms\": %.3f, \"lock_wait_ms\": %.3f, \"deque_wait_ms\": %.3f, \"steals\": %" PRIu64 ", "
+                 "\"published\": %" PRIu64 ", \"syscalls\": {\"openat\": %" PRIu64 ", \"statx\": %" PRIu64 ", "
+                 "\"readdir\": %" PRIu64 ", \"io_uring_enter\": %" PRIu64 "}}",
+            stats->entries, stats->directories, seconds > 0 ? stats->entries / seconds : 0.0,
+            stats->idle_ns / 1e6, stats->lock_wait_ns / 1e6, stats->deque_wait_ns / 1e6, stats->steals,
+            stats->published, stats->openat, stats->statx, stats->readdir, stats->uring_enter);
+}
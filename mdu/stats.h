@@ -0,0 +1,116 @@
+/**
+ * @file stats.h
+ * @brief Per-worker metrics of a traversal, printed with `--stats`.
+ *
+ * Every worker counts its own entries, system calls and scheduling events in a
+ * structure that no other thread writes, so counting costs no synchronization.
+ * Times spent waiting for locks and for work are only measured when statistics
+ * are requested, since they need a clock read around every wait. The main
+ * thread samples the total queue depth while the workers run.
+ *
+ * Error handling: Allocation failures end the program.
+ *
+ * Memory management: Queue samples must be released with `queue_samples_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Interval between two samples of the queue depth. */
+#define STATS_SAMPLE_NS (10 * 1000 * 1000)
+
+enum StatsFormat {
+    STATS_NONE,
+    STATS_CSV,
+    STATS_JSON
+};
+
+/*
+ * readdir counts library calls, each of which reads at most one getdents buffer.
+ * io_uring_enter only counts the waits of the io_uring engine. lock_wait_ns is
+ * the time spent acquiring ThreadData.mutex, deque_wait_ns the time spent
+ * acquiring deque locks, and idle_ns the time spent without work.
+ */
+struct WorkerStats {
+    uint64_t entries;
+    uint64_t directories;
+    uint64_t openat;
+    uint64_t statx;
+    uint64_t readdir;
+    uint64_t uring_enter;
+    uint64_t steals;
+    uint64_t published;
+    uint64_t idle_ns;
+    uint64_t lock_wait_ns;
+    uint64_t deque_wait_ns;
+};
+
+struct QueueSample {
+    uint64_t time_ns;
+    size_t depth;
+    int active;
+};
+
+struct QueueSamples {
+    struct QueueSample *samples;
+    size_t count;
+    size_t capacity;
+};
+
+struct ThreadData;
+
+/**
+ * @brief Returns the time of a monotonic clock in nanoseconds.
+ *
+ * @return The current time.
+ */
+uint64_t stats_now(void);
+
+/**
+ * @brief Parses the argument of `--stats`.
+ *
+ * @param name "csv" or "json".
+ * @return The format, or STATS_NONE if the name is not known.
+ */
+enum StatsFormat stats_format(const char *name);
+
+/**
+ * @brief Records the total number of queued directories at a point in time.
+ *
+ * @param samples The samples.
+ * @param time_ns Time since the start of the traversal.
+ * @param depth Number of directories in all deques.
+ * @param active Number of active workers.
+ */
+void queue_samples_add(struct QueueSamples *samples, uint64_t time_ns, size_t depth, int active);
+
+/**
+ * @brief Frees the samples.
+ *
+ * @param samples The samples.
+ */
+void queue_samples_destroy(struct QueueSamples *samples);
+
+/**
+ * @brief Prints the metrics of every worker and their totals.
+ *
+ * CSV output has one row per worker and a final row named "total". JSON output
+ * also includes the queue depth samples, as [ms, depth, active workers].
+ *
+ * @param out The stream to print to.
+ * @param format The output format.
+ * @param data The thread data, after the workers have been joined.
+ * @param samples The queue depth samples.
+ * @param elapsed_ns Wall time of the traversal.
+ */
+void stats_print(FILE *out, enum StatsFormat format, const struct ThreadData *data,
+                 const struct QueueSamples *samples, uint64_t elapsed_ns);
+
+#endif // STATS_H
@@ -4,7 +4,19 @@
 #include <stdio.h>
 #include <errno.h>
 
-int thread_data_init(struct ThreadData *data) {
+static int deque_init(struct WorkDeque *deque);
+static void deque_destroy(struct WorkDeque *deque);
+static int work_available(struct ThreadData *data);
+static void notify_workers(struct Worker *worker, size_t count);
+static void wait_for_work(struct Worker *worker);
+static void wait_for_thieves(struct Worker *worker);
+static void wake_parked(struct Worker *thief);
+static void park(struct Worker *worker);
+static void lock_mutex(pthread_mutex_t *mutex);
+static void lock_timed(pthread_mutex_t *mutex, struct Worker *worker, uint64_t *wait_ns);
+static void unlock_mutex(pthread_mutex_t *mutex);
+
+int thread_data_init(struct ThreadData *data, int num_workers) {
     memset(data, 0, sizeof(struct ThreadData));
     int ret = pthread_mutex_init(&data->mutex, NULL);
     if (ret != 0) {
@@ -17,11 +29,44 @@ int thread_data_init(struct ThreadData *data) {
         pthread_mutex_destroy(&data->mutex);
         return -1;
     }
-    data->total_size = 0;
-    data->done = 0;
-    data->pending = 0;
-    data->queue_head = NULL;
-    data->queue_tail = NULL;
+    ret = pthread_cond_init(&data->park_cond, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_cond_init failed: %s\n", strerror(ret));
+        pthread_cond_destroy(&data->cond);
+        pthread_mutex_destroy(&data->mutex);
+        return -1;
+    }
+
+    data->workers = aligned_alloc(CACHE_LINE_SIZE, num_workers * sizeof(struct Worker));
+    if (!data->workers) {
+        perror("aligned_alloc");
+        pthread_cond_destroy(&data->park_cond);
+        pthread_cond_destroy(&data->cond);
+        pthread_mutex_destroy(&data->mutex);
+        return -1;
+    }
+    memset(data->workers, 0, num_workers * sizeof(struct Worker));
+    for (int i = 0; i < num_workers; i++) {
+        if (deque_init(&data->workers[i].deque) != 0) {
+            for (int j = 0; j < i; j++) {
+                deque_destroy(&data->workers[j].deque);
+            }
+            free(data->workers);
+            pthread_cond_destroy(&data->park_cond);
+            pthread_cond_destroy(&data->cond);
+            pthread_mutex_destroy(&data->mutex);
+            return -1;
+        }
+        data->workers[i].data = data;
+        data->workers[i].id = i;
+        node_pool_init(&data->workers[i].nodes);
+    }
+
+    data->num_workers = num_workers;
+    atomic_init(&data->active, num_workers);
+    atomic_init(&data->idle, 0);
+    atomic_init(&data->sleeping, 0);
+    atomic_init(&data->uring_warned, 0);
     data->error_occurred = 0;
     return 0;
 }
@@ -35,42 +80,346 @@ void thread_data_destroy(struct ThreadData *data) {
     if (ret != 0) {
         fprintf(stderr, "pthread_cond_destroy failed: %s\n", strerror(ret));
     }
+    ret = pthread_cond_destroy(&data->park_cond);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_cond_destroy failed: %s\n", strerror(ret));
+    }
 
-    while (data->queue_head) {
-        struct DirNode *tmp = data->queue_head;
-        data->queue_head = data->queue_head->next;
-        free(tmp->path);
-        free(tmp);
+    for (int i = 0; i < data->num_workers; i++) {
+        deque_destroy(&data->workers[i].deque);
+        node_pool_destroy(&data->workers[i].nodes);
+        cache_writer_destroy(&data->workers[i].cache_writer);
     }
+    free(data->workers);
 }
 
-int enqueue(struct ThreadData *data, char *path) {
-    struct DirNode *new_node = malloc(sizeof(struct DirNode));
-    if (!new_node) {
-        return -1;
+void thread_data_merge(struct ThreadData *data) {
+    data->error_occurred = 0;
+    for (int i = 0; i < data->num_workers; i++) {
+        if (data->workers[i].error_occurred) {
+            data->error_occurred = 1;
+        }
     }
-    new_node->path = path;
-    new_node->next = NULL;
-    if (data->queue_tail) {
-        data->queue_tail->next = new_node;
-        data->queue_tail = new_node;
+}
+
+void enqueue(struct Worker *worker, struct DirNode *node) {
+    node->prev = NULL;
+    node->next = NULL;
+    enqueue_list(worker, node, node, 1);
+}
+
+void enqueue_list(struct Worker *worker, struct DirNode *first, struct DirNode *last, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    struct WorkDeque *deque = &worker->deque;
+    lock_timed(&deque->mutex, worker, &worker->stats.deque_wait_ns);
+    last->next = deque->head;
+    if (deque->head) {
+        deque->head->prev = last;
     } else {
-        data->queue_head = new_node;
-        data->queue_tail = new_node;
+        deque->tail = last;
     }
-    return 0;
+    deque->head = first;
+    atomic_fetch_add(&deque->size, count);
+    unlock_mutex(&deque->mutex);
+
+    worker->stats.published += count;
+    notify_workers(worker, count);
 }
 
-char *dequeue(struct ThreadData *data) {
-    if (data->queue_head == NULL) {
+struct DirNode *dequeue(struct Worker *worker) {
+    struct WorkDeque *deque = &worker->deque;
+    if (atomic_load(&deque->size) == 0) {
         return NULL;
     }
-    struct DirNode *node = data->queue_head;
-    char *path = node->path;
-    data->queue_head = node->next;
-    if (data->queue_head == NULL) {
-        data->queue_tail = NULL;
+
+    lock_timed(&deque->mutex, worker, &worker->stats.deque_wait_ns);
+    struct DirNode *node = deque->head;
+    if (node) {
+        deque->head = node->next;
+        if (deque->head) {
+            deque->head->prev = NULL;
+        } else {
+            deque->tail = NULL;
+        }
+        atomic_fetch_sub(&deque->size, 1);
     }
-    free(node);
-    return path;
-}
\ No newline at end of file
+    unlock_mutex(&deque->mutex);
+    return node;
+}
+
+struct DirNode *steal(struct Worker *thief) {
+    struct ThreadData *data = thief->data;
+
+    for (int i = 1; i < data->num_workers; i++) {
+        struct Worker *victim = &data->workers[(thief->id + i) % data->num_workers];
+        struct WorkDeque *deque = &victim->deque;
+        if (atomic_load(&deque->size) == 0) {
+            continue;
+        }
+
+        lock_timed(&deque->mutex, thief, &thief->stats.deque_wait_ns);
+        struct DirNode *node = deque->tail;
+        if (node) {
+            deque->tail = node->prev;
+            if (deque->tail) {
+                deque->tail->next = NULL;
+            } else {
+                deque->head = NULL;
+            }
+            atomic_fetch_sub(&deque->size, 1);
+        }
+        int emptied = node && !deque->tail;
+        unlock_mutex(&deque->mutex);
+
+        if (node) {
+            thief->stats.steals++;
+            if (emptied && worker_parked(victim)) {
+                wake_parked(thief);
+            }
+            return node;
+        }
+    }
+    return NULL;
+}
+
+struct DirNode *next_node(struct Worker *worker) {
+    struct ThreadData *data = worker->data;
+
+    if (worker_parked(worker)) {
+        wait_for_thieves(worker);
+    }
+    struct DirNode *node = dequeue(worker);
+    if (node) {
+        return node;
+    }
+    if (!worker_parked(worker)) {
+        node = steal(worker);
+        if (node) {
+            return node;
+        }
+    }
+
+    uint64_t idle_start = data->collect_stats ? stats_now() : 0;
+    atomic_fetch_add(&data->idle, 1);
+    while (1) {
+        if (atomic_load(&data->idle) == data->num_workers) {
+            lock_timed(&data->mutex, worker, &worker->stats.lock_wait_ns);
+            int ret = pthread_cond_broadcast(&data->cond);
+            if (ret == 0) {
+                ret = pthread_cond_broadcast(&data->park_cond);
+            }
+            if (ret != 0) {
+                fprintf(stderr, "pthread_cond_broadcast failed: %s\n", strerror(ret));
+                exit(EXIT_FAILURE);
+            }
+            unlock_mutex(&data->mutex);
+            if (data->collect_stats) {
+                worker->stats.idle_ns += stats_now() - idle_start;
+            }
+            return NULL;
+        }
+
+        if (worker_parked(worker)) {
+            park(worker);
+            continue;
+        }
+
+        if (work_available(data)) {
+            atomic_fetch_sub(&data->idle, 1);
+            node = steal(worker);
+            if (node) {
+                if (data->collect_stats) {
+                    worker->stats.idle_ns += stats_now() - idle_start;
+                }
+                return node;
+            }
+            atomic_fetch_add(&data->idle, 1);
+            continue;
+        }
+
+        wait_for_work(worker);
+    }
+}
+
+int workers_starving(struct Worker *worker) {
+    struct ThreadData *data = worker->data;
+    int active = atomic_load_explicit(&data->active, memory_order_relaxed);
+    if (worker->id >= active) {
+        return 1;
+    }
+    /* Parked workers count as idle, but will not take any work. */
+    return atomic_load_explicit(&data->idle, memory_order_relaxed) > data->num_workers - active &&
+           atomic_load_explicit(&worker->deque.size, memory_order_relaxed) == 0;
+}
+
+int worker_parked(struct Worker *worker) {
+    return worker->id >= atomic_load_explicit(&worker->data->active, memory_order_relaxed);
+}
+
+void set_active_workers(struct ThreadData *data, int active) {
+    lock_mutex(&data->mutex);
+    atomic_store(&data->active, active);
+    int ret = pthread_cond_broadcast(&data->park_cond);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_cond_broadcast failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    unlock_mutex(&data->mutex);
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+static int deque_init(struct WorkDeque *deque) {
+    int ret = pthread_mutex_init(&deque->mutex, NULL);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_init failed: %s\n", strerror(ret));
+        return -1;
+    }
+    deque->head = NULL;
+    deque->tail = NULL;
+    atomic_init(&deque->size, 0);
+    return 0;
+}
+
+static void deque_destroy(struct WorkDeque *deque) {
+    int ret = pthread_mutex_destroy(&deque->mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_destroy failed: %s\n", strerror(ret));
+    }
+
+    deque->head = NULL;
+    deque->tail = NULL;
+}
+
+/*
+ * A deque is non-empty only while its owner is busy, so this is also what
+ * decides whether an idle worker should wake up and try to steal.
+ */
+static int work_available(struct ThreadData *data) {
+    for (int i = 0; i < data->num_workers; i++) {
+        if (atomic_load(&data->workers[i].deque.size) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * The pusher publishes its nodes before reading `sleeping`, and a sleeper
+ * announces itself before re-checking the deques, so at least one of them
+ * sees the other. The mutex is only touched when someone is asleep. A single
+ * node only wakes a single sleeper, since the others could not get any work.
+ */
+static void notify_workers(struct Worker *worker, size_t count) {
+    struct ThreadData *data = worker->data;
+    if (atomic_load(&data->sleeping) == 0) {
+        return;
+    }
+
+    lock_timed(&data->mutex, worker, &worker->stats.lock_wait_ns);
+    int ret = count == 1 ? pthread_cond_signal(&data->cond) : pthread_cond_broadcast(&data->cond);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_cond_signal failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    unlock_mutex(&data->mutex);
+}
+
+static void wait_for_work(struct Worker *worker) {
+    struct ThreadData *data = worker->data;
+    lock_timed(&data->mutex, worker, &worker->stats.lock_wait_ns);
+    atomic_fetch_add(&data->sleeping, 1);
+    while (!work_available(data) && atomic_load(&data->idle) != data->num_workers) {
+        int ret = pthread_cond_wait(&data->cond, &data->mutex);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_cond_wait failed: %s\n", strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+    atomic_fetch_sub(&data->sleeping, 1);
+    unlock_mutex(&data->mutex);
+}
+
+/*
+ * A parked worker keeps the nodes it has published until other workers have
+ * stolen them, and only then counts as idle. No worker ever pushes to another
+ * worker's deque, so an idle worker still holds no nodes.
+ */
+static void wait_for_thieves(struct Worker *worker) {
+    struct ThreadData *data = worker->data;
+    lock_timed(&data->mutex, worker, &worker->stats.lock_wait_ns);
+    while (worker_parked(worker) && atomic_load(&worker->deque.size) > 0) {
+        int ret = pthread_cond_wait(&data->park_cond, &data->mutex);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_cond_wait failed: %s\n", strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+    unlock_mutex(&data->mutex);
+}
+
+/*
+ * Wakes a parked worker waiting for its deque to be emptied. Called by the
+ * thief that took the last node, after the size has dropped to zero.
+ */
+static void wake_parked(struct Worker *thief) {
+    struct ThreadData *data = thief->data;
+    lock_timed(&data->mutex, thief, &thief->stats.lock_wait_ns);
+    int ret = pthread_cond_broadcast(&data->park_cond);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_cond_broadcast failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+    unlock_mutex(&data->mutex);
+}
+
+/*
+ * Parked workers wait on their own condition variable, so that the single
+ * wake-up sent for a newly published node always reaches a worker that can
+ * take it.
+ */
+static void park(struct Worker *worker) {
+    struct ThreadData *data = worker->data;
+    lock_timed(&data->mutex, worker, &worker->stats.lock_wait_ns);
+    while (worker_parked(worker) && atomic_load(&data->idle) != data->num_workers) {
+        int ret = pthread_cond_wait(&data->park_cond, &data->mutex);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_cond_wait failed: %s\n", strerror(ret));
+            exit(EXIT_FAILURE);
+        }
+    }
+    unlock_mutex(&data->mutex);
+}
+
+static void lock_mutex(pthread_mutex_t *mutex) {
+    int ret = pthread_mutex_lock(mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Like lock_mutex, but adds the time spent waiting for the lock to the
+ * worker's statistics when they are collected.
+ */
+static void lock_timed(pthread_mutex_t *mutex, struct Worker *worker, uint64_t *wait_ns) {
+    if (!worker->data->collect_stats) {
+        lock_mutex(mutex);
+        return;
+    }
+    uint64_t start = stats_now();
+    lock_mutex(mutex);
+    *wait_ns += stats_now() - start;
+}
+
+static void unlock_mutex(pthread_mutex_t *mutex) {
+    int ret = pthread_mutex_unlock(mutex);
+    if (ret != 0) {
+        fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+}
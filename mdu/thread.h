@@ -2,27 +2,131 @@
 #define THREAD_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <sys/types.h>
+#include "cache.h"
+#include "dirtree.h"
+#include "inode_set.h"
+#include "stats.h"
 
-struct DirNode {
-    char *path;
-    struct DirNode *next;
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Per-worker double-ended queue. The owning worker pushes and pops at the
+ * head (LIFO), other workers steal from the tail. The size is kept atomic so
+ * that idle workers can look for work without taking any lock.
+ */
+struct WorkDeque {
+    pthread_mutex_t mutex;
+    struct DirNode *head;
+    struct DirNode *tail;
+    atomic_size_t size;
+};
+
+struct ThreadData;
+
+/*
+ * Workers are cache-line aligned so that the state each thread updates while
+ * it works never shares a line with another worker. The error flag is only
+ * read by the main thread, after the workers have been joined. Nodes created
+ * by a worker come from its own node pool. When a cache is written, each
+ * worker collects the records of the directories it read in its own writer,
+ * using one builder per directory on its stack. stats is only written by the
+ * worker itself; progress mirrors stats.entries for the `-j auto` tuner,
+ * which reads it while the worker runs.
+ */
+struct Worker {
+    _Alignas(CACHE_LINE_SIZE) struct WorkDeque deque;
+    struct ThreadData *data;
+    int id;
+    _Alignas(CACHE_LINE_SIZE) struct NodePool nodes;
+    struct CacheWriter cache_writer;
+    struct CacheBuilder *builders;
+    struct WorkerStats stats;
+    atomic_ullong progress;
+    int error_occurred;
 };
 
+/*
+ * Only the first `active` workers take part in the traversal. The others are
+ * parked on park_cond: they stop taking work, wait until the nodes left in
+ * their deque have been stolen, and then count as idle. `active` starts at
+ * num_workers and is only changed by `set_active_workers`. uring_warned is
+ * set by the first worker that falls back to blocking calls, so that the
+ * fallback is only reported once.
+ */
 struct ThreadData {
     pthread_mutex_t mutex;
     pthread_cond_t cond;
-    struct DirNode *queue_head;
-    struct DirNode *queue_tail;
-    off_t total_size;
-    int pending;
-    int done;
+    pthread_cond_t park_cond;
+    struct Worker *workers;
+    int num_workers;
+    atomic_int active;
+    atomic_int idle;
+    atomic_int sleeping;
+    int use_uring;
+    atomic_int uring_warned;
+    struct InodeSet *inodes;
+    int print_depth;
+    int all_files;
+    const struct Cache *cache;
+    int write_cache;
+    int collect_stats;
     int error_occurred;
 };
 
-int thread_data_init(struct ThreadData *data);
+int thread_data_init(struct ThreadData *data, int num_workers);
 void thread_data_destroy(struct ThreadData *data);
-int enqueue(struct ThreadData *data, char *path);
-char *dequeue(struct ThreadData *data);
+void thread_data_merge(struct ThreadData *data);
+void enqueue(struct Worker *worker, struct DirNode *node);
+void enqueue_list(struct Worker *worker, struct DirNode *first, struct DirNode *last, size_t count);
+struct DirNode *dequeue(struct Worker *worker);
+struct DirNode *steal(struct Worker *thief);
+
+/**
+ * @brief Returns the next directory for a worker to process.
+ *
+ * Pops from the worker's own deque first, then tries to steal from the other
+ * workers, and finally sleeps until new work is published. The traversal is
+ * finished when every worker is idle at the same time, since idle workers
+ * hold no nodes and only busy workers can produce new ones. A parked worker
+ * does not steal, and waits until it is needed again.
+ *
+ * @param worker The calling worker.
+ * @return A node to process, or NULL when the traversal is complete.
+ */
+struct DirNode *next_node(struct Worker *worker);
+
+/**
+ * @brief Tells a worker walking a subtree on its own whether it should share work.
+ *
+ * True when some other active worker is idle and nothing is left in the
+ * calling worker's deque for it to steal, or when the calling worker has been
+ * parked and should give away what it has not started yet.
+ *
+ * @param worker The calling worker.
+ * @return Non-zero if the worker should publish its next subdirectory.
+ */
+int workers_starving(struct Worker *worker);
+
+/**
+ * @brief Tells whether a worker has been parked by `set_active_workers`.
+ *
+ * @param worker The calling worker.
+ * @return Non-zero if the worker should stop taking new work.
+ */
+int worker_parked(struct Worker *worker);
+
+/**
+ * @brief Changes the number of workers taking part in the traversal.
+ *
+ * Workers that are no longer needed park the next time they look for work;
+ * parked workers that are needed again are woken up.
+ *
+ * @param data The thread data.
+ * @param active The number of active workers, between 1 and num_workers.
+ */
+void set_active_workers(struct ThreadData *data, int active);
 
 #endif // THREAD_H
@@ -0,0 +1,123 @@
+/**
+ * @file tuner.c
+ * @brief Adjusts the number of active workers while the traversal runs (`-j auto`).
+ *
+ * Each interval's throughput is compared with the previous one, which was
+ * measured with the previous number of active workers. A step that improved
+ * throughput is repeated with twice the size; a step that hurt is undone. A
+ * step up that made no difference is undone as well, since the extra threads
+ * only add contention; after that the tuner holds, and probes upwards again
+ * when throughput changes or after TUNER_PROBE_INTERVALS quiet intervals.
+ *
+ * Error handling: None; the tuner only changes how many workers take work.
+ *
+ * Memory management: The tuner holds no allocated memory.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "tuner.h"
+#include <unistd.h>
+
+static unsigned long long total_progress(const struct ThreadData *data);
+static void choose_direction(struct Tuner *tuner, double rate);
+
+int tuner_max_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long max = cpus > 0 ? cpus * 4 : 8;
+    if (max < 8) {
+        max = 8;
+    }
+    if (max > TUNER_MAX_WORKERS) {
+        max = TUNER_MAX_WORKERS;
+    }
+    return (int)max;
+}
+
+void tuner_init(struct Tuner *tuner, struct ThreadData *data, uint64_t now) {
+    tuner->data = data;
+    tuner->max_workers = data->num_workers;
+    tuner->active = data->num_workers < TUNER_START_WORKERS ? data->num_workers : TUNER_START_WORKERS;
+    tuner->direction = 1;
+    tuner->step = 1;
+    tuner->held = 0;
+    tuner->last_time = now;
+    tuner->last_entries = 0;
+    tuner->last_rate = -1;
+    set_active_workers(data, tuner->active);
+}
+
+void tuner_update(struct Tuner *tuner, uint64_t now) {
+    if (now - tuner->last_time < TUNER_INTERVAL_NS) {
+        return;
+    }
+
+    unsigned long long entries = total_progress(tuner->data);
+    double rate = (double)(entries - tuner->last_entries) * 1e9 / (double)(now - tuner->last_time);
+    tuner->last_time = now;
+    tuner->last_entries = entries;
+    if (tuner->last_rate >= 0) {
+        choose_direction(tuner, rate);
+    }
+    tuner->last_rate = rate;
+
+    if (tuner->direction == 0) {
+        return;
+    }
+    int active = tuner->active + tuner->direction * tuner->step;
+    if (active < 1) {
+        active = 1;
+    }
+    if (active > tuner->max_workers) {
+        active = tuner->max_workers;
+    }
+    if (active == tuner->active) {
+        tuner->direction = 0;
+        tuner->step = 1;
+        return;
+    }
+    tuner->active = active;
+    set_active_workers(tuner->data, active);
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Sums the number of entries processed by every worker so far.
+ */
+static unsigned long long total_progress(const struct ThreadData *data) {
+    unsigned long long total = 0;
+    for (int i = 0; i < data->num_workers; i++) {
+        total += atomic_load_explicit(&data->workers[i].progress, memory_order_relaxed);
+    }
+    return total;
+}
+
+/**
+ * @brief Decides the next step from the rate of the interval just measured.
+ *
+ * @param tuner The tuner, with the rate and direction of the previous interval.
+ * @param rate Entries per second since the previous interval.
+ */
+static void choose_direction(struct Tuner *tuner, double rate) {
+    int better = rate > tuner->last_rate * (1 + TUNER_THRESHOLD);
+    int worse = rate < tuner->last_rate * (1 - TUNER_THRESHOLD);
+
+    if (tuner->direction == 0) {
+        tuner->held++;
+        if (better || worse || tuner->held >= TUNER_PROBE_INTERVALS) {
+            tuner->direction = 1;
+            tuner->step = 1;
+            tuner->held = 0;
+        }
+    } else if (better) {
+        tuner->step *= 2;
+    } else if (worse || tuner->direction > 0) {
+        /* Undo the last step, keeping its size. */
+        tuner->direction = -tuner->direction;
+    } else {
+        tuner->direction = 0;
+        tuner->step = 1;
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file tuner.h
+ * @brief Adjusts the number of active workers while the traversal runs (`-j auto`).
+ *
+ * The best number of threads depends on where the metadata comes from: a tree
+ * in the page cache is CPU-bound and stops scaling at the number of cores,
+ * while a cold disk or a network filesystem keeps gaining from more requests
+ * in flight. The tuner starts a pool of TUNER_MAX_WORKERS threads (or fewer, see
+ * `tuner_max_workers`) with only a few of them active, measures the number of
+ * entries processed per second over TUNER_INTERVAL_NS, and hill-climbs: it
+ * keeps growing or shrinking the active set while throughput improves, turns
+ * around when it drops, and holds when a step made no difference.
+ *
+ * Error handling: None; the tuner only changes how many workers take work.
+ *
+ * Memory management: The tuner holds no allocated memory.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdint.h>
+#include "thread.h"
+
+#define TUNER_MAX_WORKERS 64
+#define TUNER_START_WORKERS 2
+#define TUNER_INTERVAL_NS (100 * 1000 * 1000)
+/* Relative change in throughput that counts as better or worse. */
+#define TUNER_THRESHOLD 0.05
+/* Intervals to hold an unchanged rate before probing upwards again. */
+#define TUNER_PROBE_INTERVALS 10
+
+struct Tuner {
+    struct ThreadData *data;
+    int max_workers;
+    int active;
+    int direction;
+    int step;
+    int held;
+    uint64_t last_time;
+    unsigned long long last_entries;
+    double last_rate;
+};
+
+/**
+ * @brief Returns the number of worker threads to start for `-j auto`.
+ *
+ * Four per online CPU, so that I/O-bound trees can keep requests in flight,
+ * but at least 8 and at most TUNER_MAX_WORKERS.
+ *
+ * @return The size of the pool.
+ */
+int tuner_max_workers(void);
+
+/**
+ * @brief Activates the first few workers of the pool.
+ *
+ * Must be called before the worker threads are started.
+ *
+ * @param tuner The tuner.
+ * @param data The thread data, with num_workers threads.
+ * @param now The current time, from `stats_now`.
+ */
+void tuner_init(struct Tuner *tuner, struct ThreadData *data, uint64_t now);
+
+/**
+ * @brief Measures the throughput and adjusts the active set.
+ *
+ * Does nothing until TUNER_INTERVAL_NS have passed since the last adjustment,
+ * so it can be called at any rate.
+ *
+ * @param tuner The tuner.
+ * @param now The current time, from `stats_now`.
+ */
+void tuner_update(struct Tuner *tuner, uint64_t now);
+
+#endif // TUNER_H
@@ -0,0 +1,208 @@
+/**
+ * @file uring.c
+ * @brief Minimal io_uring wrapper used by the asynchronous traversal engine.
+ *
+ * This file implements ring setup and the submission/completion queue handling
+ * on top of the raw io_uring system calls. The queue indices shared with the
+ * kernel are accessed with acquire/release ordering.
+ *
+ * Error handling: Functions return -1 and set errno on failure.
+ *
+ * Memory management: The mapped queues are released by `uring_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int map_rings(struct Uring *ring, const struct io_uring_params *params);
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params);
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags);
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args);
+
+int uring_supported(void) {
+    struct Uring ring;
+    if (uring_init(&ring, 1) != 0) {
+        return 0;
+    }
+
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    int supported = 0;
+    if (probe && sys_io_uring_register(ring.fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        supported = probe->last_op >= IORING_OP_STATX
+                    && (probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+                    && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    free(probe);
+    uring_destroy(&ring);
+    return supported;
+}
+
+int uring_init(struct Uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(struct Uring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = sys_io_uring_setup(entries, &params);
+    if (ring->fd < 0) {
+        return -1;
+    }
+
+    if (map_rings(ring, &params) != 0) {
+        int saved_errno = errno;
+        uring_destroy(ring);
+        errno = saved_errno;
+        return -1;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+void uring_destroy(struct Uring *ring) {
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(struct Uring));
+    ring->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(struct Uring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->sq_entries) {
+        if (uring_submit_and_wait(ring, 0) != 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sqe_tail - head >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+int uring_submit_and_wait(struct Uring *ring, unsigned wait_nr) {
+    unsigned tail = *ring->sq_tail;
+    unsigned to_submit = ring->sqe_tail - tail;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    while (1) {
+        int ret = sys_io_uring_enter(ring->fd, to_submit, wait_nr,
+                                     wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+        to_submit = 0;
+    }
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct Uring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(struct Uring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * @brief Maps the submission queue, completion queue and submission entries of a ring.
+ *
+ * Mappings that fail are left as NULL so that `uring_destroy` can release the rest.
+ *
+ * @param ring The ring, with its file descriptor set up.
+ * @param params The parameters returned by io_uring_setup.
+ * @return 0 on success, -1 on failure.
+ */
+static int map_rings(struct Uring *ring, const struct io_uring_params *params) {
+    ring->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    void *sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        return -1;
+    }
+    ring->sq_ring = sq_ring;
+
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        void *cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            return -1;
+        }
+        ring->cq_ring = cq_ring;
+    }
+
+    ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return -1;
+    }
+    ring->sqes = sqes;
+    return 0;
+}
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
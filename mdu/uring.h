@@ -0,0 +1,101 @@
+/**
+ * @file uring.h
+ * @brief Minimal io_uring wrapper used by the asynchronous traversal engine.
+ *
+ * This header declares a small submission/completion ring built directly on the
+ * io_uring system calls, so that mdu does not depend on liburing. Only what the
+ * traversal needs is provided: getting a submission entry, submitting and waiting,
+ * and consuming completions.
+ *
+ * Error handling: Functions return -1 and set errno on failure.
+ *
+ * Memory management: A ring must be released with `uring_destroy`.
+ *
+ * @author Emil Engvall
+ * @date 14-10-2026
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+struct Uring {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_entries;
+    unsigned sqe_tail;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+/**
+ * @brief Checks whether the running kernel supports the operations mdu needs.
+ *
+ * @return 1 if io_uring with IORING_OP_OPENAT and IORING_OP_STATX is available, 0 otherwise.
+ */
+int uring_supported(void);
+
+/**
+ * @brief Sets up a ring and maps its queues.
+ *
+ * @param ring The ring to initialize.
+ * @param entries Requested number of submission entries.
+ * @return 0 on success, -1 on failure.
+ */
+int uring_init(struct Uring *ring, unsigned entries);
+
+/**
+ * @brief Unmaps and closes a ring.
+ *
+ * @param ring The ring to destroy.
+ */
+void uring_destroy(struct Uring *ring);
+
+/**
+ * @brief Returns a cleared submission entry.
+ *
+ * If the submission queue is full, the prepared entries are submitted first.
+ *
+ * @param ring The ring.
+ * @return A submission entry to fill in, or NULL if none could be made available.
+ */
+struct io_uring_sqe *uring_get_sqe(struct Uring *ring);
+
+/**
+ * @brief Submits all prepared entries and waits for completions.
+ *
+ * @param ring The ring.
+ * @param wait_nr Number of completions to wait for.
+ * @return 0 on success, -1 on failure.
+ */
+int uring_submit_and_wait(struct Uring *ring, unsigned wait_nr);
+
+/**
+ * @brief Returns the oldest unconsumed completion, or NULL if there is none.
+ *
+ * @param ring The ring.
+ * @return The completion entry.
+ */
+struct io_uring_cqe *uring_peek_cqe(struct Uring *ring);
+
+/**
+ * @brief Marks the completion returned by `uring_peek_cqe` as consumed.
+ *
+ * @param ring The ring.
+ */
+void uring_cqe_seen(struct Uring *ring);
+
+#endif // URING_H
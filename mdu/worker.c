@@ -3,291 +3,1255 @@
  * @brief Worker thread implementation for processing file paths.
  *
  * This file contains the worker thread logic that processes file and directory paths to calculate
- * disk usage. It includes functions to handle files, directories, and thread-safe operations using
- * mutexes and condition variables.
+ * disk usage. It includes functions to handle files and directories. The sizes of the files in a
+ * directory are summed locally and added to the directory's node once; subtotals then roll up the
+ * tree as subtrees complete, so the traversal itself takes no locks outside of the work deques.
  *
- * Error handling: If any errors occur during processing, they are updated in the shared thread data structure.
+ * Two engines are provided. The default one opens and stats entries with blocking system calls and
+ * walks each subtree depth-first on its own, only publishing subdirectories when another worker is
+ * starving, so memory stays bounded by the depth of the tree rather than its width. The io_uring
+ * engine keeps several directories and up to URING_DEPTH openat/statx requests in flight per
+ * worker, which hides the latency of metadata operations on network filesystems.
+ *
+ * Error handling: If any errors occur during processing, they are recorded in the worker's error flag.
  * 
- * Memory management: Memory for paths and file statistics is dynamically allocated and freed appropriately.
+ * Memory management: One node is allocated per directory from the worker's node pool, and is recycled
+ * once its subtree is complete. Full paths are only built for output and error messages.
  * 
  * @author Emil Engvall
  * @date 21-10-2024
  */
 
+#define _GNU_SOURCE
 #include "worker.h"
+#include "uring.h"
+#include "cache.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <unistd.h>
 
+/* ------------------------------- Constants ------------------------------- */
+
+/* Only what is needed to size an entry; the type is taken from d_type when known. */
+#define STAT_MASK (STATX_BLOCKS | STATX_INO | STATX_NLINK)
+/* Directories also need their timestamps, to be looked up in the cache. */
+#define DIR_STAT_MASK (STATX_MTIME | STATX_CTIME)
+#define STAT_FLAGS (AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT)
+#define OPEN_FLAGS (O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+
+/* Requests in flight and directories being read at once by one io_uring worker. */
+#define URING_DEPTH 256
+#define URING_MAX_DIRS 32
+
+/* Directories a blocking worker keeps open while it walks a subtree on its own. */
+#define LOCAL_DEPTH 64
+
+/* ------------------------------ Structures ------------------------------- */
+
+/*
+ * A directory on the depth-first stack of a blocking worker, and the size of its files so
+ * far. dir is NULL when the directory is unchanged and its subdirectories are taken from
+ * the cache, from cached up to cached_end. failed is set if the directory could not be
+ * read in full, in which case it is not cached.
+ */
+struct Frame {
+    struct DirNode *node;
+    DIR *dir;
+    int fd;
+    off_t size;
+    struct CacheBuilder *builder;
+    const char *cached;
+    const char *cached_end;
+    int failed;
+};
+
+/*
+ * Entries of a directory being read by the io_uring engine. The whole directory is read
+ * before any entry is stat'ed, and the buffers are reused from one directory to the next.
+ */
+struct EntryBatch {
+    char *names;
+    size_t names_len;
+    size_t names_capacity;
+    size_t *offsets;
+    unsigned char *types;
+    size_t count;
+    size_t capacity;
+};
+
+/* Subdirectories found while reading a directory, pushed in one go when it is done. */
+struct ChildList {
+    struct DirNode *first;
+    struct DirNode *last;
+    size_t count;
+};
+
+/* A directory being read by the io_uring engine. */
+struct UringDir {
+    struct DirNode *node;
+    DIR *dir;
+    int fd;
+    int opening;
+    struct EntryBatch batch;
+    size_t next_entry;
+    size_t in_flight;
+    off_t size;
+    struct ChildList children;
+    struct CacheBuilder builder;
+    int failed;
+};
+
+/* A request in flight. Its index in UringEngine.ops is the request's user_data. */
+struct UringOp {
+    int dir_index;
+    size_t entry;
+    struct statx stx;
+};
+
+struct UringEngine {
+    struct Uring ring;
+    struct UringDir dirs[URING_MAX_DIRS];
+    int active;
+    struct UringOp ops[URING_DEPTH];
+    int free_ops[URING_DEPTH];
+    int free_count;
+};
+
 /* ------------------ Declarations of internal functions ------------------ */
 
-static void process_path(char *path, struct ThreadData *data);
-static void handle_file(const struct stat *st, struct ThreadData *data);
-static void handle_directory(const char *path, struct ThreadData *data);
-static char *construct_path(const char *dir_path, const char *entry_name);
-static void update_error_status(struct ThreadData *data, int error_in_this_call);
+static void process_node(struct DirNode *node, struct Worker *worker);
+static int stat_root(struct DirNode *node, struct Worker *worker);
+static unsigned int entry_mask(unsigned char d_type);
+static int entry_is_dir(unsigned char d_type, const struct statx *stx);
+static void stamp_from_statx(struct DirStamp *stamp, const struct statx *stx);
+static off_t handle_file(const struct statx *stx, int is_dir, const struct DirNode *node, struct Worker *worker);
+static int count_link(uint64_t dev, uint64_t ino, off_t size, const struct DirNode *node, struct Worker *worker);
+static void handle_directory(struct DirNode *node, struct Worker *worker);
+static void walk_subtree(struct Frame *stack, struct Worker *worker);
+static int start_frame(struct Frame *frame, struct DirNode *node, int fd, struct CacheBuilder *builder,
+                       struct Worker *worker);
+static int next_entry(struct Frame *frame, const char **name, unsigned char *d_type, struct Worker *worker);
+static struct DirNode *visit_entry(struct Frame *frame, const char *name, unsigned char d_type,
+                                   struct Worker *worker);
+static int open_child(struct Frame *frame, struct DirNode *child, struct Worker *worker);
+static void publish_child(struct Frame *frame, struct DirNode *child, struct Worker *worker);
+static void end_frame(struct Frame *frame, struct Worker *worker);
+static off_t replay_cached(const struct CacheDir *cached, const struct DirNode *node, struct CacheBuilder *builder,
+                           struct Worker *worker);
+static void record_directory(const struct DirNode *node, const struct CacheBuilder *builder, int failed,
+                             struct Worker *worker);
+static DIR *open_stream(struct DirNode *node, int fd, struct Worker *worker);
+static DIR *open_entries(struct DirNode *node, int fd, struct EntryBatch *batch, int *failed,
+                         struct Worker *worker);
+static struct DirNode *handle_entry(struct DirNode *node, const char *name, unsigned char d_type,
+                                    const struct statx *stx, off_t *size, struct CacheBuilder *builder,
+                                    struct Worker *worker);
+static void record_file(const struct statx *stx, struct CacheBuilder *builder);
+static void child_list_add(struct ChildList *children, struct DirNode *child);
+static void finish_directory(struct DirNode *node, DIR *dir, int fd, off_t size, struct ChildList *children,
+                             struct Worker *worker);
+static int read_entries(DIR *dir, struct EntryBatch *batch, struct Worker *worker);
+static int batch_add(struct EntryBatch *batch, const char *name, unsigned char type);
+static struct UringEngine *uring_engine_create(void);
+static void uring_engine_destroy(struct UringEngine *engine);
+static void uring_worker_loop(struct Worker *worker, struct UringEngine *engine);
+static void uring_start_directory(struct UringEngine *engine, struct DirNode *node, struct Worker *worker);
+static void uring_submit_stats(struct UringEngine *engine, struct Worker *worker);
+static void uring_reap(struct UringEngine *engine, struct Worker *worker);
+static void uring_open_directory(struct UringDir *dir, int fd, struct Worker *worker);
+static void uring_end_directory(struct UringEngine *engine, int index, struct Worker *worker);
+static void report_error(const char *what, const struct DirNode *node, const char *entry_name, int err);
+static void update_error_status(struct Worker *worker, int error_in_this_call);
 
 
 /* -------------------------- External functions -------------------------- */
 
 void *worker_thread(void *arg) {
-    struct ThreadData *data = (struct ThreadData *)arg;
+    struct Worker *worker = (struct Worker *)arg;
+    struct DirNode *node;
 
-    while (1) {
-        char *path = NULL;
-        int ret = pthread_mutex_lock(&data->mutex);
-        if (ret != 0) {
-            fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
-            exit(EXIT_FAILURE);
+    if (worker->data->use_uring) {
+        struct UringEngine *engine = uring_engine_create();
+        if (engine) {
+            uring_worker_loop(worker, engine);
+            uring_engine_destroy(engine);
+            return NULL;
         }
-
-        while (data->queue_head == NULL && !data->done) {
-            ret = pthread_cond_wait(&data->cond, &data->mutex);
-            if (ret != 0) {
-                fprintf(stderr, "pthread_cond_wait failed: %s\n", strerror(ret));
-                exit(EXIT_FAILURE);
-            }
-        }
-
-        if (data->queue_head == NULL && data->done) {
-            ret = pthread_mutex_unlock(&data->mutex);
-            if (ret != 0) {
-                fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
-                exit(EXIT_FAILURE);
-            }
-            pthread_exit(NULL);
+        if (!atomic_exchange(&worker->data->uring_warned, 1)) {
+            fprintf(stderr, "du: io_uring setup failed, using blocking calls: %s\n", strerror(errno));
         }
+    }
 
-        path = dequeue(data);
-        ret = pthread_mutex_unlock(&data->mutex);
-        if (ret != 0) {
-            fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+    if (worker->data->write_cache) {
+        worker->builders = calloc(LOCAL_DEPTH, sizeof(struct CacheBuilder));
+        if (!worker->builders) {
+            perror("calloc");
             exit(EXIT_FAILURE);
         }
+    }
+
+    while ((node = next_node(worker)) != NULL) {
+        process_node(node, worker);
+        release_node(&worker->nodes, node, worker->data->print_depth);
+    }
 
-        if (path) {
-            process_path(path, data);
-            free(path);
+    if (worker->builders) {
+        for (int i = 0; i < LOCAL_DEPTH; i++) {
+            cache_builder_destroy(&worker->builders[i]);
         }
+        free(worker->builders);
+        worker->builders = NULL;
     }
+    return NULL;
 }
 
 /* -------------------------- Internal functions -------------------------- */
 
 /**
- * @brief Processes a given file or directory path.
+ * @brief Processes a node taken from the work deques.
  *
- * This function processes the provided path, determining whether it is a file or directory.
- * Based on its type, it delegates to the appropriate handling function (file or directory).
+ * Directories found during the traversal have already been stat'ed by the worker that read
+ * their parent, so only root nodes (the paths given on the command line) are stat'ed here.
+ * A root may be a file, in which case only its own size is counted.
  * 
- * @param path The file or directory path to process.
- * @param data Pointer to the shared ThreadData structure.
+ * @param node The node to process.
+ * @param worker The worker processing the node.
  */
-static void process_path(char *path, struct ThreadData *data) {
-    struct stat st;
-    int ret;
-    int error_in_this_call = 0;
+static void process_node(struct DirNode *node, struct Worker *worker) {
+    if (!node->parent && !stat_root(node, worker)) {
+        return;
+    }
 
-    ret = lstat(path, &st);
-    if (ret != 0) {
-        fprintf(stderr, "du: cannot access '%s': %s\n", path, strerror(errno));
-        error_in_this_call = 1;
-    } else {
-        handle_file(&st, data);
-        if (S_ISDIR(st.st_mode)) {
-            handle_directory(path, data);
-        }
+    handle_directory(node, worker);
+}
+
+/**
+ * @brief Stats a path given on the command line and counts its size.
+ * 
+ * @param node The root node.
+ * @param worker The worker processing the node.
+ * @return 1 if the root is a directory that should be read, 0 otherwise.
+ */
+static int stat_root(struct DirNode *node, struct Worker *worker) {
+    struct statx stx;
+    worker->stats.statx++;
+    if (statx(AT_FDCWD, node->name, STAT_FLAGS, entry_mask(DT_UNKNOWN), &stx) != 0) {
+        fprintf(stderr, "du: cannot access '%s': %s\n", node->name, strerror(errno));
+        update_error_status(worker, 1);
+        return 0;
+    }
+    int is_dir = entry_is_dir(DT_UNKNOWN, &stx);
+    stamp_from_statx(&node->stamp, &stx);
+    off_t size = handle_file(&stx, is_dir, node, worker);
+    if (size > 0) {
+        atomic_fetch_add(&node->subtotal, size);
+    }
+    return is_dir;
+}
+
+/**
+ * @brief Returns the statx mask needed for an entry.
+ *
+ * When readdir already reported the entry's type, the type is not requested from the
+ * filesystem and the decision to descend is taken from d_type alone. Only for DT_UNKNOWN
+ * is STATX_TYPE added to the mask. Timestamps are only requested for possible directories.
+ * 
+ * @param d_type Type reported by readdir, or DT_UNKNOWN.
+ * @return The mask to pass to statx.
+ */
+static unsigned int entry_mask(unsigned char d_type) {
+    if (d_type == DT_UNKNOWN) {
+        return STAT_MASK | STATX_TYPE | DIR_STAT_MASK;
     }
+    if (d_type == DT_DIR) {
+        return STAT_MASK | DIR_STAT_MASK;
+    }
+    return STAT_MASK;
+}
 
-    update_error_status(data, error_in_this_call);
+/**
+ * @brief Decides whether an entry is a directory to descend into.
+ * 
+ * @param d_type Type reported by readdir, or DT_UNKNOWN.
+ * @param stx The statx result for the entry, fetched with `entry_mask(d_type)`.
+ * @return Non-zero if the entry is a directory.
+ */
+static int entry_is_dir(unsigned char d_type, const struct statx *stx) {
+    if (d_type == DT_UNKNOWN) {
+        return S_ISDIR(stx->stx_mode);
+    }
+    return d_type == DT_DIR;
 }
 
 /**
- * @brief Handles the processing of a regular file.
+ * @brief Fills in the identity and timestamps of a directory from its statx result.
  *
- * This function processes a regular file, adding its size to the total size in the ThreadData structure.
+ * The inode number is left at zero, so that the directory is never cached, if the
+ * filesystem did not return all of them.
  * 
- * @param st The stat structure containing file information.
- * @param data Pointer to the shared ThreadData structure.
+ * @param stamp The stamp to fill in.
+ * @param stx The statx result for the directory.
  */
-static void handle_file(const struct stat *st, struct ThreadData *data) {
-    off_t size = st->st_blocks * 512;
+static void stamp_from_statx(struct DirStamp *stamp, const struct statx *stx) {
+    memset(stamp, 0, sizeof(struct DirStamp));
+    if ((stx->stx_mask & (STATX_INO | DIR_STAT_MASK)) != (STATX_INO | DIR_STAT_MASK)) {
+        return;
+    }
+    stamp->dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    stamp->ino = stx->stx_ino;
+    stamp->mtime_sec = stx->stx_mtime.tv_sec;
+    stamp->mtime_nsec = stx->stx_mtime.tv_nsec;
+    stamp->ctime_sec = stx->stx_ctime.tv_sec;
+    stamp->ctime_nsec = stx->stx_ctime.tv_nsec;
+}
 
-    int ret = pthread_mutex_lock(&data->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
-        exit(EXIT_FAILURE);
+/**
+ * @brief Returns the size an entry adds to its directory.
+ *
+ * A file with several hard links is only counted the first time one of its links
+ * is seen, unless links are counted separately.
+ * 
+ * @param stx The statx structure containing file information.
+ * @param is_dir Non-zero if the entry is a directory.
+ * @param node The node the entry belongs to: its directory, or itself for a root.
+ * @param worker The worker processing the file.
+ * @return The size in bytes, or -1 if the entry is a hard link that was already counted.
+ */
+static off_t handle_file(const struct statx *stx, int is_dir, const struct DirNode *node, struct Worker *worker) {
+    if (!(stx->stx_mask & STATX_BLOCKS)) {
+        return 0;
     }
-    data->total_size += size;
-    ret = pthread_mutex_unlock(&data->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+
+    off_t size = (off_t)stx->stx_blocks * 512;
+    if (!is_dir && (stx->stx_mask & STATX_NLINK) && stx->stx_nlink > 1 &&
+        !count_link(makedev(stx->stx_dev_major, stx->stx_dev_minor), stx->stx_ino, size, node, worker)) {
+        return -1;
+    }
+
+    return size;
+}
+
+/**
+ * @brief Decides whether a file with several hard links should be counted.
+ *
+ * The root the link was found under is recorded, so that the size can be moved to the
+ * lowest root containing the file once the traversal is done.
+ * 
+ * @param dev Device the file lives on.
+ * @param ino The file's inode number.
+ * @param size The file's size.
+ * @param node The node the link belongs to.
+ * @param worker The worker processing the file.
+ * @return 1 if this is the first link seen, or links are counted separately, 0 otherwise.
+ */
+static int count_link(uint64_t dev, uint64_t ino, off_t size, const struct DirNode *node, struct Worker *worker) {
+    struct InodeSet *inodes = worker->data->inodes;
+    if (!inodes) {
+        return 1;
+    }
+
+    int ret = inode_set_insert(inodes, dev, ino, size, node->root->index);
+    if (ret == -1) {
+        perror("malloc");
         exit(EXIT_FAILURE);
     }
+    return ret;
 }
 
 /**
  * @brief Handles the processing of a directory.
  *
- * This function processes a directory by traversing its contents and processing each file or
- * subdirectory within it. It updates the shared data with the directory's size.
+ * This function opens the directory relative to its parent's descriptor, so the kernel never
+ * has to walk a full path and no path strings are built, and then walks its subtree.
  * 
- * @param path The directory path.
- * @param data Pointer to the shared ThreadData structure.
+ * @param node The directory node.
+ * @param worker The worker processing the directory.
  */
-static void handle_directory(const char *path, struct ThreadData *data) {
-    DIR *dir = opendir(path);
-    if (!dir) {
-        fprintf(stderr, "du: cannot read directory '%s': %s\n", path, strerror(errno));
-        int ret = pthread_mutex_lock(&data->mutex);
-        if (ret != 0) {
-            fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
-            exit(EXIT_FAILURE);
+static void handle_directory(struct DirNode *node, struct Worker *worker) {
+    int parent_fd = node->parent ? node->parent->fd : AT_FDCWD;
+    worker->stats.openat++;
+    int fd = openat(parent_fd, node->name, OPEN_FLAGS);
+    int open_errno = errno;
+    if (node->parent) {
+        release_node_fd(node->parent);
+    }
+    if (fd == -1) {
+        report_error("cannot read directory", node, NULL, open_errno);
+        update_error_status(worker, 1);
+        return;
+    }
+
+    struct Frame stack[LOCAL_DEPTH];
+    if (start_frame(&stack[0], node, fd, worker->builders, worker) != 0) {
+        return;
+    }
+    walk_subtree(stack, worker);
+}
+
+/**
+ * @brief Walks the subtree of an opened directory depth-first on the calling worker.
+ *
+ * Entries are stat'ed as they are read, and each subdirectory is descended into right away,
+ * relative to the descriptor of the directory it was found in. The worker thus only holds
+ * the directories on its current path, whatever the width of the tree. A subdirectory is
+ * published to the worker's deque instead when another worker is starving, or when
+ * LOCAL_DEPTH directories are already open. The node of the subtree itself is released by
+ * the caller.
+ * 
+ * @param stack Room for LOCAL_DEPTH frames, the first of which is the started directory.
+ * @param worker The worker processing the directory.
+ */
+static void walk_subtree(struct Frame *stack, struct Worker *worker) {
+    int top = 0;
+
+    while (top >= 0) {
+        struct Frame *frame = &stack[top];
+        const char *name;
+        unsigned char d_type;
+
+        if (!next_entry(frame, &name, &d_type, worker)) {
+            end_frame(frame, worker);
+            if (top > 0) {
+                release_node(&worker->nodes, frame->node, worker->data->print_depth);
+            }
+            top--;
+            continue;
         }
-        data->error_occurred = 1;
-        ret = pthread_mutex_unlock(&data->mutex);
-        if (ret != 0) {
-            fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
-            exit(EXIT_FAILURE);
+
+        struct DirNode *child = visit_entry(frame, name, d_type, worker);
+        if (!child) {
+            continue;
         }
-        return;
+        if (top + 1 == LOCAL_DEPTH || workers_starving(worker)) {
+            publish_child(frame, child, worker);
+            continue;
+        }
+
+        struct CacheBuilder *builder = worker->builders ? &worker->builders[top + 1] : NULL;
+        int fd = open_child(frame, child, worker);
+        if (fd == -1 || start_frame(&stack[top + 1], child, fd, builder, worker) != 0) {
+            release_node(&worker->nodes, child, worker->data->print_depth);
+            continue;
+        }
+        top++;
+    }
+}
+
+/**
+ * @brief Starts reading an opened directory on the worker's stack.
+ *
+ * If the directory is in the cache and has not changed, the cached subdirectory names are
+ * used instead of reading the directory, and the cached size of its files is counted.
+ * Otherwise the descriptor is wrapped in a directory stream, and closed if that fails.
+ * 
+ * @param frame The frame to fill in.
+ * @param node The directory node.
+ * @param fd The directory's descriptor.
+ * @param builder Builder to record the directory's contents in, or NULL.
+ * @param worker The worker processing the directory.
+ * @return 0 on success, -1 on failure.
+ */
+static int start_frame(struct Frame *frame, struct DirNode *node, int fd, struct CacheBuilder *builder,
+                       struct Worker *worker) {
+    frame->node = node;
+    frame->fd = fd;
+    frame->size = 0;
+    frame->builder = builder;
+    frame->cached = NULL;
+    frame->cached_end = NULL;
+    frame->failed = 0;
+    if (builder) {
+        cache_builder_reset(builder);
+    }
+
+    struct CacheDir cached;
+    if (worker->data->cache && cache_lookup(worker->data->cache, &node->stamp, &cached)) {
+        frame->dir = NULL;
+        frame->cached = cached.names;
+        frame->cached_end = cached.names + cached.names_len;
+        frame->size = replay_cached(&cached, node, builder, worker);
+        worker->stats.directories++;
+        return 0;
+    }
+
+    frame->dir = open_stream(node, fd, worker);
+    if (!frame->dir) {
+        return -1;
+    }
+    worker->stats.directories++;
+    return 0;
+}
+
+/**
+ * @brief Returns the next entry of the directory on top of the stack.
+ *
+ * "." and ".." are skipped. A read error is reported, and ends the directory.
+ * 
+ * @param frame The directory.
+ * @param name Set to the entry's name.
+ * @param d_type Set to the type reported by readdir, or DT_DIR for a cached subdirectory.
+ * @param worker The worker processing the directory.
+ * @return 1 if an entry was returned, 0 at the end of the directory.
+ */
+static int next_entry(struct Frame *frame, const char **name, unsigned char *d_type, struct Worker *worker) {
+    if (!frame->dir) {
+        if (frame->cached == frame->cached_end) {
+            return 0;
+        }
+        *name = frame->cached;
+        *d_type = DT_DIR;
+        frame->cached += strlen(frame->cached) + 1;
+        return 1;
     }
 
     struct dirent *entry;
-    int pending_increment = 0;
-    size_t paths_capacity = 0;
-    size_t paths_count = 0;
-    char **paths_to_enqueue = NULL;
+    errno = 0;
+    while (worker->stats.readdir++, (entry = readdir(frame->dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            *name = entry->d_name;
+            *d_type = entry->d_type;
+            return 1;
+        }
+    }
+    if (errno != 0) {
+        report_error("cannot read directory", frame->node, NULL, errno);
+        update_error_status(worker, 1);
+        frame->failed = 1;
+    }
+    return 0;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-        continue;
+/**
+ * @brief Stats and counts an entry of the directory on top of the stack.
+ * 
+ * @param frame The directory the entry belongs to.
+ * @param name Name of the entry.
+ * @param d_type Type reported by readdir, or DT_UNKNOWN.
+ * @param worker The worker processing the directory.
+ * @return A new node if the entry is a subdirectory, NULL otherwise.
+ */
+static struct DirNode *visit_entry(struct Frame *frame, const char *name, unsigned char d_type,
+                                   struct Worker *worker) {
+    struct statx stx;
+    worker->stats.statx++;
+    if (statx(frame->fd, name, STAT_FLAGS, entry_mask(d_type), &stx) != 0) {
+        report_error("cannot access", frame->node, name, errno);
+        update_error_status(worker, 1);
+        frame->failed = 1;
+        return NULL;
     }
+    return handle_entry(frame->node, name, d_type, &stx, &frame->size, frame->builder, worker);
+}
 
-    char *new_path = construct_path(path, entry->d_name);
-    if (new_path == NULL) {
-        perror("malloc");
-        closedir(dir);
-        exit(EXIT_FAILURE);
+/**
+ * @brief Opens a subdirectory relative to the directory it was found in.
+ * 
+ * @param frame The parent directory.
+ * @param child The subdirectory's node.
+ * @param worker The worker processing the directory.
+ * @return The subdirectory's descriptor, or -1 on failure.
+ */
+static int open_child(struct Frame *frame, struct DirNode *child, struct Worker *worker) {
+    worker->stats.openat++;
+    int fd = openat(frame->fd, child->name, OPEN_FLAGS);
+    if (fd == -1) {
+        report_error("cannot read directory", child, NULL, errno);
+        update_error_status(worker, 1);
     }
+    return fd;
+}
 
-    if (paths_count == paths_capacity) {
-        if (paths_capacity == 0) {
-            paths_capacity = 16;
-        } else {
-            paths_capacity *= 2;
+/**
+ * @brief Pushes a subdirectory onto the worker's deque for any worker to take.
+ *
+ * The parent keeps a duplicate of its descriptor for published children to be opened
+ * relative to. The frame holds one reference to it, so it stays open until the frame
+ * has ended and every published child has been opened.
+ * 
+ * @param frame The parent directory.
+ * @param child The subdirectory's node.
+ * @param worker The worker processing the directory.
+ */
+static void publish_child(struct Frame *frame, struct DirNode *child, struct Worker *worker) {
+    struct DirNode *node = frame->node;
+    if (node->fd == -1) {
+        node->fd = fcntl(frame->fd, F_DUPFD_CLOEXEC, 0);
+        if (node->fd == -1) {
+            perror("fcntl");
+            exit(EXIT_FAILURE);
+        }
+        atomic_store(&node->fd_users, 1);
+    }
+    atomic_fetch_add(&node->fd_users, 1);
+    enqueue(worker, child);
+}
+
+/**
+ * @brief Adds the size of a fully read directory to its node and closes it.
+ * 
+ * @param frame The directory.
+ * @param worker The worker processing the directory.
+ */
+static void end_frame(struct Frame *frame, struct Worker *worker) {
+    atomic_fetch_add(&frame->node->subtotal, frame->size);
+    record_directory(frame->node, frame->builder, frame->failed, worker);
+    if (frame->node->fd != -1) {
+        release_node_fd(frame->node);
+    }
+    if (frame->dir) {
+        if (closedir(frame->dir) != 0) {
+            fprintf(stderr, "closedir failed: %s\n", strerror(errno));
         }
-        char **tmp = realloc(paths_to_enqueue, paths_capacity * sizeof(char *));
-        if (tmp == NULL) {
+    } else {
+        close(frame->fd);
+    }
+}
+
+/**
+ * @brief Counts the files of an unchanged directory from its cached contents.
+ *
+ * Files with several hard links still go through the inode set, so that they are only
+ * counted once even when another link is found in a directory that was read.
+ * 
+ * @param cached The directory's cached contents.
+ * @param node The directory node.
+ * @param builder Builder to copy the contents into, or NULL.
+ * @param worker The worker processing the directory.
+ * @return The size to add to the directory.
+ */
+static off_t replay_cached(const struct CacheDir *cached, const struct DirNode *node, struct CacheBuilder *builder,
+                           struct Worker *worker) {
+    off_t size = cached->size;
+    if (builder) {
+        builder->size = cached->size;
+    }
+
+    for (size_t i = 0; i < cached->num_links; i++) {
+        const struct CacheLink *link = &cached->links[i];
+        if (builder && cache_builder_add_link(builder, link) != 0) {
             perror("realloc");
-            free(new_path);
-            for (size_t i = 0; i < paths_count; i++) {
-                free(paths_to_enqueue[i]);
-            }
-            free(paths_to_enqueue);
-            closedir(dir);
             exit(EXIT_FAILURE);
         }
-        paths_to_enqueue = tmp;
-    }
-    paths_to_enqueue[paths_count++] = new_path;
-    pending_increment++;
+        if (count_link(link->dev, link->ino, link->size, node, worker)) {
+            size += link->size;
+        }
     }
+    return size;
+}
 
-    int ret = pthread_mutex_lock(&data->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
+/**
+ * @brief Adds a completely read directory to the worker's cache writer.
+ *
+ * Directories that could not be read in full, or whose identity is unknown, are left
+ * out, so that they are read again on the next run.
+ * 
+ * @param node The directory node.
+ * @param builder The directory's contents, or NULL if no cache is written.
+ * @param failed Non-zero if an error occurred while reading the directory.
+ * @param worker The worker processing the directory.
+ */
+static void record_directory(const struct DirNode *node, const struct CacheBuilder *builder, int failed,
+                             struct Worker *worker) {
+    if (!builder || failed || node->stamp.ino == 0) {
+        return;
+    }
+    if (cache_writer_add(&worker->cache_writer, &node->stamp, builder) != 0) {
+        perror("realloc");
         exit(EXIT_FAILURE);
     }
-    for (size_t i = 0; i < paths_count; i++) {
-        if (enqueue(data, paths_to_enqueue[i]) != 0) {
-            perror("enqueue");
-            pthread_mutex_unlock(&data->mutex);
-            closedir(dir);
-            exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Wraps an opened directory's descriptor in a directory stream.
+ *
+ * If the stream cannot be created the descriptor is closed.
+ * 
+ * @param node The directory node.
+ * @param fd The directory's descriptor.
+ * @param worker The worker processing the directory.
+ * @return The directory stream, or NULL on failure.
+ */
+static DIR *open_stream(struct DirNode *node, int fd, struct Worker *worker) {
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        report_error("cannot read directory", node, NULL, errno);
+        update_error_status(worker, 1);
+        close(fd);
+    }
+    return dir;
+}
+
+/**
+ * @brief Starts reading an opened directory.
+ *
+ * Wraps the descriptor in a directory stream and reads all entries into the batch. A read
+ * error is reported, but the entries read before it are still counted.
+ * 
+ * @param node The directory node.
+ * @param fd The directory's descriptor.
+ * @param batch The batch to fill.
+ * @param failed Set to 1 if the entries could not all be read.
+ * @param worker The worker processing the directory.
+ * @return The directory stream, or NULL on failure.
+ */
+static DIR *open_entries(struct DirNode *node, int fd, struct EntryBatch *batch, int *failed,
+                         struct Worker *worker) {
+    DIR *dir = open_stream(node, fd, worker);
+    if (!dir) {
+        return NULL;
+    }
+
+    if (read_entries(dir, batch, worker) != 0) {
+        report_error("cannot read directory", node, NULL, errno);
+        update_error_status(worker, 1);
+        *failed = 1;
+    }
+    return dir;
+}
+
+/**
+ * @brief Counts a stat'ed entry and creates a node for it if it is a subdirectory.
+ *
+ * A file is added to the directory's local size, and printed if all files are listed.
+ * A subdirectory gets a node that starts out with its own size.
+ * 
+ * @param node The directory the entry belongs to.
+ * @param name Name of the entry.
+ * @param d_type Type reported by readdir, or DT_UNKNOWN.
+ * @param stx The statx result for the entry.
+ * @param size The directory's local size to add files to.
+ * @param builder Builder to record the entry in, or NULL.
+ * @param worker The worker processing the directory.
+ * @return The subdirectory's node, or NULL if the entry is not a directory.
+ */
+static struct DirNode *handle_entry(struct DirNode *node, const char *name, unsigned char d_type,
+                                    const struct statx *stx, off_t *size, struct CacheBuilder *builder,
+                                    struct Worker *worker) {
+    int is_dir = entry_is_dir(d_type, stx);
+    off_t entry_size = handle_file(stx, is_dir, node, worker);
+    worker->stats.entries++;
+    atomic_store_explicit(&worker->progress, worker->stats.entries, memory_order_relaxed);
+    if (!is_dir) {
+        if (builder) {
+            record_file(stx, builder);
         }
+        if (entry_size < 0) {
+            return NULL;
+        }
+        *size += entry_size;
+        if (worker->data->all_files && node->depth < worker->data->print_depth) {
+            print_entry(&worker->nodes, entry_size, node, name);
+        }
+        return NULL;
     }
-    data->pending += pending_increment;
-    ret = pthread_cond_broadcast(&data->cond);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_cond_broadcast failed: %s\n", strerror(ret));
+
+    if (builder && cache_builder_add_dir(builder, name) != 0) {
+        perror("realloc");
         exit(EXIT_FAILURE);
     }
-    ret = pthread_mutex_unlock(&data->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+    struct DirNode *child = create_node(&worker->nodes, NULL, node, name, entry_size > 0 ? entry_size : 0);
+    if (!child) {
+        perror("malloc");
         exit(EXIT_FAILURE);
     }
+    stamp_from_statx(&child->stamp, stx);
+    return child;
+}
 
-    free(paths_to_enqueue);
+/**
+ * @brief Records the size of a file in a directory's cache builder.
+ *
+ * Files with several hard links are kept apart, since whether they are counted depends on
+ * the other links seen during a run.
+ * 
+ * @param stx The statx result for the file.
+ * @param builder The directory's builder.
+ */
+static void record_file(const struct statx *stx, struct CacheBuilder *builder) {
+    if (!(stx->stx_mask & STATX_BLOCKS)) {
+        return;
+    }
 
-    if (closedir(dir) != 0) {
-        fprintf(stderr, "closedir failed: %s\n", strerror(errno));
+    off_t size = (off_t)stx->stx_blocks * 512;
+    if (!(stx->stx_mask & STATX_NLINK) || stx->stx_nlink <= 1) {
+        builder->size += size;
+        return;
+    }
+
+    struct CacheLink link = {makedev(stx->stx_dev_major, stx->stx_dev_minor), stx->stx_ino, size};
+    if (cache_builder_add_link(builder, &link) != 0) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
     }
 }
 
+/**
+ * @brief Links a subdirectory into a list of children.
+ * 
+ * @param children The list.
+ * @param child The subdirectory's node.
+ */
+static void child_list_add(struct ChildList *children, struct DirNode *child) {
+    child->next = children->first;
+    if (children->first) {
+        children->first->prev = child;
+    } else {
+        children->last = child;
+    }
+    children->first = child;
+    children->count++;
+}
+
+/**
+ * @brief Publishes the size and subdirectories of a directory and closes it.
+ *
+ * If there are subdirectories, the node keeps a duplicate of the descriptor so that they
+ * can be opened relative to it.
+ * 
+ * @param node The directory node.
+ * @param dir The directory stream, or NULL if the directory was taken from the cache.
+ * @param fd The directory's descriptor.
+ * @param size Total size of the files directly in the directory.
+ * @param children The subdirectories found.
+ * @param worker The worker processing the directory.
+ */
+static void finish_directory(struct DirNode *node, DIR *dir, int fd, off_t size, struct ChildList *children,
+                             struct Worker *worker) {
+    atomic_fetch_add(&node->subtotal, size);
+    if (children->count > 0) {
+        node->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (node->fd == -1) {
+            perror("fcntl");
+            exit(EXIT_FAILURE);
+        }
+        atomic_store(&node->fd_users, (int)children->count);
+        enqueue_list(worker, children->first, children->last, children->count);
+    }
+
+    if (!dir) {
+        close(fd);
+    } else if (closedir(dir) != 0) {
+        fprintf(stderr, "closedir failed: %s\n", strerror(errno));
+    }
+}
 
 /**
- * @brief Constructs a full file path from a directory and an entry name.
+ * @brief Reads every entry of a directory into a batch.
  *
- * This function creates a full path string by combining the directory path with the entry name.
+ * The batch is cleared first. "." and ".." are skipped.
+ * 
+ * @param dir The directory stream to read.
+ * @param batch The batch to fill.
+ * @param worker The worker reading the directory.
+ * @return 0 on success, -1 if readdir failed with errno set. Entries read before the
+ *         failure are kept in the batch.
+ */
+static int read_entries(DIR *dir, struct EntryBatch *batch, struct Worker *worker) {
+    struct dirent *entry;
+
+    batch->count = 0;
+    batch->names_len = 0;
+
+    errno = 0;
+    while (worker->stats.readdir++, (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (batch_add(batch, entry->d_name, entry->d_type) != 0) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return errno == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Appends a name to a batch, growing its buffers when needed.
  * 
- * @param dir_path The directory path.
- * @param entry_name The name of the directory entry (file or subdirectory).
- * @return A dynamically allocated string containing the full path.
+ * @param batch The batch to append to.
+ * @param name The entry name.
+ * @param type The entry's d_type.
+ * @return 0 on success, -1 if memory could not be allocated.
  */
-static char *construct_path(const char *dir_path, const char *entry_name) {
-    size_t path_len = strlen(dir_path);
-    size_t name_len = strlen(entry_name);
-    size_t new_path_len = path_len + 1 + name_len + 1; // '/' and '\0'
+static int batch_add(struct EntryBatch *batch, const char *name, unsigned char type) {
+    size_t name_len = strlen(name) + 1;
 
-    char *new_path = malloc(new_path_len);
-    if (!new_path) {
+    if (batch->names_len + name_len > batch->names_capacity) {
+        size_t capacity = batch->names_capacity ? batch->names_capacity : 4096;
+        while (batch->names_len + name_len > capacity) {
+            capacity *= 2;
+        }
+        char *tmp = realloc(batch->names, capacity);
+        if (!tmp) {
+            return -1;
+        }
+        batch->names = tmp;
+        batch->names_capacity = capacity;
+    }
+
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 256;
+        size_t *offsets = realloc(batch->offsets, capacity * sizeof(size_t));
+        if (!offsets) {
+            return -1;
+        }
+        batch->offsets = offsets;
+        unsigned char *types = realloc(batch->types, capacity);
+        if (!types) {
+            return -1;
+        }
+        batch->types = types;
+        batch->capacity = capacity;
+    }
+
+    memcpy(batch->names + batch->names_len, name, name_len);
+    batch->offsets[batch->count] = batch->names_len;
+    batch->types[batch->count] = type;
+    batch->names_len += name_len;
+    batch->count++;
+    return 0;
+}
+
+
+/**
+ * @brief Creates the per-worker state of the io_uring engine.
+ * 
+ * @return The engine, or NULL if the ring could not be set up.
+ */
+static struct UringEngine *uring_engine_create(void) {
+    struct UringEngine *engine = calloc(1, sizeof(struct UringEngine));
+    if (!engine) {
+        return NULL;
+    }
+    if (uring_init(&engine->ring, URING_DEPTH) != 0) {
+        int saved_errno = errno;
+        free(engine);
+        errno = saved_errno;
         return NULL;
     }
 
-    snprintf(new_path, new_path_len, "%s/%s", dir_path, entry_name);
-    return new_path;
+    for (int i = 0; i < URING_DEPTH; i++) {
+        engine->free_ops[i] = URING_DEPTH - 1 - i;
+    }
+    engine->free_count = URING_DEPTH;
+    return engine;
+}
+
+/**
+ * @brief Releases the io_uring engine of a worker.
+ * 
+ * @param engine The engine to destroy.
+ */
+static void uring_engine_destroy(struct UringEngine *engine) {
+    for (int i = 0; i < URING_MAX_DIRS; i++) {
+        free(engine->dirs[i].batch.names);
+        free(engine->dirs[i].batch.offsets);
+        free(engine->dirs[i].batch.types);
+        cache_builder_destroy(&engine->dirs[i].builder);
+    }
+    uring_destroy(&engine->ring);
+    free(engine);
 }
 
 /**
- * @brief Updates the error status in the shared ThreadData structure.
+ * @brief Main loop of a worker using the io_uring engine.
  *
- * This function sets the error status flag in the shared data if an error occurs during file or directory processing.
+ * The worker takes up to URING_MAX_DIRS directories at a time and keeps their openat and
+ * statx requests in flight together. It only blocks in `next_node` when it has no directory
+ * of its own left, so it never counts as idle while holding work. A parked worker finishes
+ * the directories it has but takes no new ones. Reading the entries of an
+ * opened directory is still done with readdir, since io_uring has no getdents operation.
  * 
- * @param data Pointer to the shared ThreadData structure.
- * @param error_in_this_call Error code for the current call.
+ * @param worker The worker.
+ * @param engine The worker's engine.
+ */
+static void uring_worker_loop(struct Worker *worker, struct UringEngine *engine) {
+    int done = 0;
+
+    while (!done || engine->active > 0) {
+        while (!done && engine->active < URING_MAX_DIRS && engine->free_count > 0) {
+            struct DirNode *node;
+            if (engine->active == 0) {
+                node = next_node(worker);
+                if (!node) {
+                    done = 1;
+                    break;
+                }
+            } else if (worker_parked(worker)) {
+                break;
+            } else {
+                node = dequeue(worker);
+                if (!node) {
+                    node = steal(worker);
+                }
+                if (!node) {
+                    break;
+                }
+            }
+            uring_start_directory(engine, node, worker);
+        }
+
+        if (engine->active == 0) {
+            continue;
+        }
+
+        uring_submit_stats(engine, worker);
+        worker->stats.uring_enter++;
+        if (uring_submit_and_wait(&engine->ring, 1) != 0) {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+        uring_reap(engine, worker);
+    }
+}
+
+/**
+ * @brief Takes a directory into the engine and queues its openat request.
+ *
+ * Roots are stat'ed synchronously first, and released right away if they are not directories.
+ * 
+ * @param engine The worker's engine.
+ * @param node The directory node.
+ * @param worker The worker.
  */
-static void update_error_status(struct ThreadData *data, int error_in_this_call) {
-    int ret = pthread_mutex_lock(&data->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_mutex_lock failed: %s\n", strerror(ret));
+static void uring_start_directory(struct UringEngine *engine, struct DirNode *node, struct Worker *worker) {
+    if (!node->parent && !stat_root(node, worker)) {
+        release_node(&worker->nodes, node, worker->data->print_depth);
+        return;
+    }
+
+    int index = 0;
+    while (engine->dirs[index].node) {
+        index++;
+    }
+    struct UringDir *dir = &engine->dirs[index];
+    worker->stats.openat++;
+    dir->node = node;
+    dir->dir = NULL;
+    dir->fd = -1;
+    dir->opening = 1;
+    dir->next_entry = 0;
+    dir->in_flight = 1;
+    dir->size = 0;
+    dir->children = (struct ChildList){NULL, NULL, 0};
+    dir->failed = 0;
+    cache_builder_reset(&dir->builder);
+    engine->active++;
+
+    int op = engine->free_ops[--engine->free_count];
+    engine->ops[op].dir_index = index;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(&engine->ring);
+    if (!sqe) {
+        perror("io_uring_enter");
         exit(EXIT_FAILURE);
     }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = node->parent ? node->parent->fd : AT_FDCWD;
+    sqe->addr = (uintptr_t)node->name;
+    sqe->open_flags = OPEN_FLAGS;
+    sqe->user_data = op;
+}
 
-    data->pending--;
+/**
+ * @brief Queues statx requests for the entries of the opened directories.
+ *
+ * Requests are queued until every directory has been fully submitted or URING_DEPTH
+ * requests are in flight.
+ * 
+ * @param engine The worker's engine.
+ * @param worker The worker.
+ */
+static void uring_submit_stats(struct UringEngine *engine, struct Worker *worker) {
+    for (int i = 0; i < URING_MAX_DIRS && engine->free_count > 0; i++) {
+        struct UringDir *dir = &engine->dirs[i];
+        if (!dir->node || dir->opening) {
+            continue;
+        }
 
-    if (error_in_this_call) {
-        data->error_occurred = 1;
+        while (dir->next_entry < dir->batch.count && engine->free_count > 0) {
+            size_t entry = dir->next_entry++;
+            int op = engine->free_ops[--engine->free_count];
+            engine->ops[op].dir_index = i;
+            engine->ops[op].entry = entry;
+            worker->stats.statx++;
+
+            struct io_uring_sqe *sqe = uring_get_sqe(&engine->ring);
+            if (!sqe) {
+                perror("io_uring_enter");
+                exit(EXIT_FAILURE);
+            }
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dir->fd;
+            sqe->addr = (uintptr_t)(dir->batch.names + dir->batch.offsets[entry]);
+            sqe->len = entry_mask(dir->batch.types[entry]);
+            sqe->statx_flags = STAT_FLAGS;
+            sqe->off = (uintptr_t)&engine->ops[op].stx;
+            sqe->user_data = op;
+            dir->in_flight++;
+        }
     }
+}
 
-    if (data->pending == 0 && data->queue_head == NULL) {
-        data->done = 1;
-        ret = pthread_cond_broadcast(&data->cond);
-        if (ret != 0) {
-            fprintf(stderr, "pthread_cond_broadcast failed: %s\n", strerror(ret));
-            exit(EXIT_FAILURE);
+/**
+ * @brief Handles all available completions.
+ *
+ * A completed openat starts reading the directory; a completed statx counts the entry.
+ * A directory is finished once all its entries have been submitted and completed.
+ * 
+ * @param engine The worker's engine.
+ * @param worker The worker.
+ */
+static void uring_reap(struct UringEngine *engine, struct Worker *worker) {
+    struct io_uring_cqe *cqe;
+
+    while ((cqe = uring_peek_cqe(&engine->ring)) != NULL) {
+        int op = (int)cqe->user_data;
+        int res = cqe->res;
+        uring_cqe_seen(&engine->ring);
+
+        struct UringOp *uop = &engine->ops[op];
+        struct UringDir *dir = &engine->dirs[uop->dir_index];
+        engine->free_ops[engine->free_count++] = op;
+        dir->in_flight--;
+
+        if (dir->opening) {
+            dir->opening = 0;
+            if (dir->node->parent) {
+                release_node_fd(dir->node->parent);
+            }
+            if (res < 0) {
+                report_error("cannot read directory", dir->node, NULL, -res);
+                update_error_status(worker, 1);
+                release_node(&worker->nodes, dir->node, worker->data->print_depth);
+                dir->node = NULL;
+                engine->active--;
+                continue;
+            }
+            uring_open_directory(dir, res, worker);
+            if (dir->fd == -1) {
+                release_node(&worker->nodes, dir->node, worker->data->print_depth);
+                dir->node = NULL;
+                engine->active--;
+                continue;
+            }
+        } else {
+            const char *name = dir->batch.names + dir->batch.offsets[uop->entry];
+            struct CacheBuilder *builder = worker->data->write_cache ? &dir->builder : NULL;
+            if (res < 0) {
+                report_error("cannot access", dir->node, name, -res);
+                update_error_status(worker, 1);
+                dir->failed = 1;
+            } else {
+                struct DirNode *child = handle_entry(dir->node, name, dir->batch.types[uop->entry],
+                                                     &uop->stx, &dir->size, builder, worker);
+                if (child) {
+                    child_list_add(&dir->children, child);
+                }
+            }
+        }
+
+        if (dir->next_entry == dir->batch.count && dir->in_flight == 0) {
+            uring_end_directory(engine, uop->dir_index, worker);
         }
     }
+}
+
+/**
+ * @brief Starts reading a directory of the io_uring engine once it has been opened.
+ *
+ * An unchanged directory in the cache gets its cached subdirectories as its batch, so that
+ * only they are stat'ed. On failure the descriptor is closed and dir->fd is set to -1.
+ * 
+ * @param dir The directory.
+ * @param fd The descriptor returned by openat.
+ * @param worker The worker.
+ */
+static void uring_open_directory(struct UringDir *dir, int fd, struct Worker *worker) {
+    struct CacheBuilder *builder = worker->data->write_cache ? &dir->builder : NULL;
+    struct CacheDir cached;
+
+    dir->fd = fd;
+    if (worker->data->cache && cache_lookup(worker->data->cache, &dir->node->stamp, &cached)) {
+        dir->dir = NULL;
+        dir->batch.count = 0;
+        dir->batch.names_len = 0;
+        for (const char *name = cached.names; name < cached.names + cached.names_len; name += strlen(name) + 1) {
+            if (batch_add(&dir->batch, name, DT_DIR) != 0) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        dir->size = replay_cached(&cached, dir->node, builder, worker);
+        worker->stats.directories++;
+        return;
+    }
+
+    dir->dir = open_entries(dir->node, fd, &dir->batch, &dir->failed, worker);
+    if (!dir->dir) {
+        dir->fd = -1;
+        return;
+    }
+    worker->stats.directories++;
+}
+
+/**
+ * @brief Finishes a directory of the io_uring engine and frees its slot.
+ * 
+ * @param engine The worker's engine.
+ * @param index The directory's slot.
+ * @param worker The worker.
+ */
+static void uring_end_directory(struct UringEngine *engine, int index, struct Worker *worker) {
+    struct UringDir *dir = &engine->dirs[index];
+    record_directory(dir->node, worker->data->write_cache ? &dir->builder : NULL, dir->failed, worker);
+    finish_directory(dir->node, dir->dir, dir->fd, dir->size, &dir->children, worker);
+    release_node(&worker->nodes, dir->node, worker->data->print_depth);
+    dir->node = NULL;
+    dir->dir = NULL;
+    engine->active--;
+}
 
-    ret = pthread_mutex_unlock(&data->mutex);
-    if (ret != 0) {
-        fprintf(stderr, "pthread_mutex_unlock failed: %s\n", strerror(ret));
+/**
+ * @brief Prints an error message for a directory entry.
+ *
+ * The full path is only rebuilt here, from the node's chain of parents, since the traversal
+ * itself never needs it.
+ * 
+ * @param what Description of the operation that failed.
+ * @param node The directory the failing entry belongs to, or the failing directory itself.
+ * @param entry_name Name of the failing entry within node, or NULL for node itself.
+ * @param err The errno value of the failure.
+ */
+static void report_error(const char *what, const struct DirNode *node, const char *entry_name, int err) {
+    char *path = node_path(node, entry_name);
+    if (!path) {
+        perror("malloc");
         exit(EXIT_FAILURE);
     }
-}
\ No newline at end of file
+    fprintf(stderr, "du: %s '%s': %s\n", what, path, strerror(err));
+    free(path);
+}
+
+/**
+ * @brief Updates the error status of the calling worker.
+ *
+ * This function sets the worker's error flag if an error occurs during file or directory
+ * processing. The flags of all workers are merged once all workers have finished.
+ * 
+ * @param worker The worker processing the path.
+ * @param error_in_this_call Error code for the current call.
+ */
+static void update_error_status(struct Worker *worker, int error_in_this_call) {
+    if (error_in_this_call) {
+        worker->error_occurred = 1;
+    }
+}
@@ -18,10 +18,11 @@
  * @brief Worker thread function.
  *
  * This function is executed by each worker thread. It processes file paths, handles
- * files and directories, and updates the shared thread data structure. The function
+ * files and directories, and updates the shared thread data structure. Paths are
+ * taken from the worker's own deque or stolen from other workers, and the function
  * continues until all paths have been processed.
  * 
- * @param arg Pointer to the shared `ThreadData` structure.
+ * @param arg Pointer to the worker's `Worker` structure.
  * @return NULL when the thread finishes execution.
  */
 void *worker_thread(void *arg);
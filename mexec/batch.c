@@ -0,0 +1,181 @@
+/**
+ * file: batch.c
+ *
+ * This module runs the pipelines of a batch concurrently. Each running pipeline
+ * occupies a job slot holding the PIDs of its stages; waitpid(-1) returns stages
+ * in the order they exit, and the PID is looked up among the slots.
+ *
+ * Error handling: Errors are managed by printing messages with perror and exiting
+ * on critical failures, such as errors in fork, pipe or waitpid.
+ *
+ * Memory management: All memory for running pipelines is freed before run_batch returns.
+ *
+ * date: 14-10-2026
+ * author: Emil Engvall
+ */
+
+#include "batch.h"
+#include "command.h"
+#include "pipes.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int run_batch(struct Pipeline *pipelines, int count, int max_jobs, int pipe_size, FILE *report, int fail_fast) {
+    struct Job *jobs = calloc(max_jobs, sizeof(struct Job));
+    if (!jobs) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < max_jobs; i++) {
+        jobs[i].index = -1;
+    }
+
+    int exit_status = EXIT_SUCCESS;
+    int next = 0;
+    int running = 0;
+
+    while (next < count || running > 0) {
+        for (int slot = 0; slot < max_jobs && next < count; slot++) {
+            if (jobs[slot].index != -1) {
+                continue;
+            }
+            start_job(&jobs[slot], &pipelines[next], next, pipe_size, report != NULL);
+            next++;
+            if (fail_fast && jobs[slot].failed_stage != -1) {
+                terminate_job(&jobs[slot]);
+            }
+            if (jobs[slot].remaining > 0) {
+                running++;
+            } else if (finish_job(&jobs[slot], pipelines, report) != 0) {
+                exit_status = EXIT_FAILURE;
+            }
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        int status;
+        struct StageStats done;
+        pid_t pid = report ? reap_child(-1, &status, &done) : waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitpid");
+            exit(EXIT_FAILURE);
+        }
+        int slot = reap_stage(jobs, max_jobs, pid, status, report ? &done : NULL, fail_fast);
+        if (slot != -1) {
+            running--;
+            if (finish_job(&jobs[slot], pipelines, report) != 0) {
+                exit_status = EXIT_FAILURE;
+            }
+        }
+    }
+
+    free(jobs);
+    return exit_status;
+}
+
+void start_job(struct Job *job, struct Pipeline *pipeline, int index, int pipe_size, int measure) {
+    int num_pipes = pipeline->cmd_count - 1;
+    int **pipes = setup_pipes(num_pipes);
+    if (pipe_size > 0) {
+        set_pipe_size(pipes, num_pipes, pipe_size);
+    }
+    job->index = index;
+    job->cmd_count = pipeline->cmd_count;
+    job->pids = malloc(pipeline->cmd_count * sizeof(int));
+    job->stats = measure ? malloc(pipeline->cmd_count * sizeof(struct StageStats)) : NULL;
+    if (!job->pids || (measure && !job->stats)) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < pipeline->cmd_count; i++) {
+        if (job->stats) {
+            clock_gettime(CLOCK_MONOTONIC, &job->stats[i].start);
+        }
+        launch_command(i, pipeline->commands, pipeline->cmd_count, pipes, job->pids);
+    }
+    close_all_pipes(pipes, pipeline->cmd_count);
+    free_pipes(pipes, num_pipes);
+
+    job->remaining = 0;
+    job->failed_stage = -1;
+    job->status = 0;
+    for (int i = 0; i < pipeline->cmd_count; i++) {
+        if (job->pids[i] == -1) {
+            job->failed_stage = i;
+            job->status = 127;
+            if (job->stats) {
+                job->stats[i].pid = -1;
+                job->stats[i].status = 127;
+            }
+        } else {
+            job->remaining++;
+        }
+    }
+}
+
+int reap_stage(struct Job *jobs, int max_jobs, pid_t pid, int status, const struct StageStats *stats, int fail_fast) {
+    for (int slot = 0; slot < max_jobs; slot++) {
+        struct Job *job = &jobs[slot];
+        if (job->index == -1) {
+            continue;
+        }
+        for (int i = 0; i < job->cmd_count; i++) {
+            if (job->pids[i] != pid) {
+                continue;
+            }
+            int stage = stage_status(status);
+            /* Keep the rightmost failure, like a shell with pipefail. */
+            if (stage != 0 && i > job->failed_stage) {
+                job->failed_stage = i;
+                job->status = stage;
+            }
+            if (stats) {
+                struct timespec start = job->stats[i].start;
+                job->stats[i] = *stats;
+                job->stats[i].start = start;
+            }
+            job->pids[i] = 0;
+            job->remaining--;
+            if (stage != 0 && fail_fast) {
+                terminate_job(job);
+            }
+            return job->remaining == 0 ? slot : -1;
+        }
+    }
+    return -1;
+}
+
+void terminate_job(struct Job *job) {
+    /* The stages are not reaped yet, so their PIDs cannot have been reused. */
+    for (int i = 0; i < job->cmd_count; i++) {
+        if (job->pids[i] > 0) {
+            kill(job->pids[i], SIGTERM);
+        }
+    }
+}
+
+int finish_job(struct Job *job, struct Pipeline *pipelines, FILE *report) {
+    int status = job->status;
+    fprintf(stderr, "pipeline %d (line %d): %d\n", job->index + 1, pipelines[job->index].line, status);
+    if (report) {
+        for (int i = 0; i < job->cmd_count; i++) {
+            print_stage_report(report, job->index + 1, i, pipelines[job->index].commands[i][0], &job->stats[i]);
+        }
+        fflush(report);
+    }
+    free(job->stats);
+    free(job->pids);
+    job->stats = NULL;
+    job->pids = NULL;
+    job->index = -1;
+    return status;
+}
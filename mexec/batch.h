@@ -0,0 +1,103 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "parser.h"
+#include "report.h"
+
+/**
+ * @file batch.h
+ * @brief Declarations for running the independent pipelines of a batch concurrently.
+ *
+ * In batch mode (`-b`) the input holds many pipelines, separated by blank lines or
+ * "---". Up to max_jobs of them run at the same time. Children are reaped with
+ * waitpid(-1) in the order they exit, and a new pipeline is started as soon as one
+ * has finished, so a slow pipeline never holds up the others.
+ *
+ * When a pipeline finishes, a line "pipeline N (line L): S" is written to standard
+ * error, where N counts the pipelines from 1, L is the line of its first command, and
+ * S is the status of the rightmost failed stage, or 0. A stage that exits normally has
+ * its exit code as status, a stage killed by a signal 128 plus the signal number, and a
+ * command that cannot be executed 127. With fail-fast, a failed stage makes the other
+ * stages of its pipeline be terminated with SIGTERM. With a report, the rows of the pipeline's stages
+ * are written to it at the same time.
+ *
+ * Error handling: Errors are managed by printing messages with perror and exiting
+ * on critical failures, such as errors in fork, pipe or waitpid.
+ *
+ * Memory management: All memory for running pipelines is freed before run_batch returns.
+ *
+ * @date 14-10-2026
+ * @author Emil Engvall
+ */
+
+/* A pipeline that has been started and has stages left to reap. A free slot has index -1. */
+struct Job {
+    int index;
+    int *pids;
+    struct StageStats *stats;
+    int cmd_count;
+    int remaining;
+    int failed_stage;
+    int status;
+};
+
+/**
+ * @brief Runs every pipeline of a batch, at most max_jobs at a time.
+ *
+ * @param pipelines The pipelines.
+ * @param count The number of pipelines.
+ * @param max_jobs The largest number of pipelines running at the same time.
+ * @param pipe_size Capacity of the pipes, or 0 for the default.
+ * @param report The report to write a row per stage to, or NULL (see report.h).
+ * @param fail_fast Non-zero to terminate the other stages of a pipeline as soon as one fails.
+ * @return EXIT_SUCCESS if every pipeline succeeded, EXIT_FAILURE otherwise.
+ */
+int run_batch(struct Pipeline *pipelines, int count, int max_jobs, int pipe_size, FILE *report, int fail_fast);
+
+/**
+ * @brief Creates the pipes of a pipeline and starts all its stages.
+ *
+ * The parent's ends of the pipes are closed once every stage has been started.
+ *
+ * @param job The free job slot to fill.
+ * @param pipeline The pipeline to start.
+ * @param index The pipeline's index in the batch.
+ * @param pipe_size Capacity of the pipes, or 0 for the default.
+ * @param measure Non-zero to record the start time of every stage for the report.
+ */
+void start_job(struct Job *job, struct Pipeline *pipeline, int index, int pipe_size, int measure);
+
+/**
+ * @brief Records the exit of a stage.
+ *
+ * @param jobs The job slots.
+ * @param max_jobs The number of job slots.
+ * @param pid The reaped child.
+ * @param status The child's wait status.
+ * @param stats The child's measurements from reap_child, or NULL without a report.
+ * @param fail_fast Non-zero to terminate the job's other stages if this one failed.
+ * @return The slot of the job if this was its last stage, -1 otherwise.
+ */
+int reap_stage(struct Job *jobs, int max_jobs, pid_t pid, int status, const struct StageStats *stats,
+               int fail_fast);
+
+/**
+ * @brief Sends SIGTERM to the stages of a job that are still running.
+ *
+ * @param job The job.
+ */
+void terminate_job(struct Job *job);
+
+/**
+ * @brief Reports a finished pipeline and frees its slot.
+ *
+ * @param job The job, with no stages left.
+ * @param pipelines The pipelines, for the report.
+ * @param report The report, or NULL.
+ * @return The pipeline's status.
+ */
+int finish_job(struct Job *job, struct Pipeline *pipelines, FILE *report);
+
+#endif // BATCH_H
@@ -0,0 +1,236 @@
+/**
+ * file: builtin.c
+ *
+ * This module implements the stages that mexec runs itself: @splice forwards data
+ * and @tee duplicates it, both with splice and tee so that the data is moved between
+ * pipe buffers by reference instead of being copied through user space.
+ *
+ * Error handling: Errors are reported with perror, and the stage exits with a failure status.
+ *
+ * Memory management: The fallback buffer is allocated and freed within each stage.
+ *
+ * date: 14-10-2026
+ * author: Emil Engvall
+ */
+
+#define _GNU_SOURCE
+#include "builtin.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int is_builtin(const char *name) {
+    return strcmp(name, "@splice") == 0 || strcmp(name, "@tee") == 0;
+}
+
+int run_builtin(char **argv) {
+    if (strcmp(argv[0], "@splice") == 0) {
+        int in = STDIN_FILENO;
+        if (argv[1] && argv[2]) {
+            fprintf(stderr, "usage: @splice [FILE]\n");
+            return EXIT_FAILURE;
+        }
+        if (argv[1]) {
+            in = open(argv[1], O_RDONLY | O_CLOEXEC);
+            if (in == -1) {
+                fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+        int out = STDOUT_FILENO;
+        int ret = is_pipe(in) || is_pipe(out) ? splice_all(in, out) : copy_all(in, &out, 1);
+        return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int num_outputs = 1;
+    while (argv[num_outputs]) {
+        num_outputs++;
+    }
+    int *outputs = malloc(num_outputs * sizeof(int));
+    if (!outputs) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    outputs[0] = STDOUT_FILENO;
+    for (int i = 1; i < num_outputs; i++) {
+        outputs[i] = open(argv[i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (outputs[i] == -1) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            free(outputs);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int ret;
+    if (num_outputs == 1) {
+        ret = is_pipe(STDIN_FILENO) || is_pipe(STDOUT_FILENO) ? splice_all(STDIN_FILENO, STDOUT_FILENO)
+                                                              : copy_all(STDIN_FILENO, outputs, 1);
+    } else if (is_pipe(STDIN_FILENO)) {
+        ret = tee_all(STDIN_FILENO, outputs, num_outputs);
+    } else {
+        ret = copy_all(STDIN_FILENO, outputs, num_outputs);
+    }
+    free(outputs);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int splice_all(int in, int out) {
+    int moved = 0;
+    while (1) {
+        ssize_t n = splice(in, NULL, out, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0) {
+            return 0;
+        }
+        if (n > 0) {
+            moved = 1;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EINVAL && !moved) {
+            return copy_all(in, &out, 1);
+        }
+        perror("splice");
+        return -1;
+    }
+}
+
+int tee_all(int in, const int *outputs, int num_outputs) {
+    int copy[2];
+    if (pipe2(copy, O_CLOEXEC) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    int size = fcntl(in, F_GETPIPE_SZ);
+    if (size > 0) {
+        fcntl(copy[1], F_SETPIPE_SZ, size);
+    }
+
+    int ret = 0;
+    while (ret == 0) {
+        /*
+         * tee always starts at the head of the input, so each output but the last
+         * gets its own tee into the empty private pipe, which then takes the same
+         * buffers every time. Splicing the input to the last output consumes them.
+         */
+        ssize_t n = 0;
+        for (int i = 0; i < num_outputs - 1 && ret == 0; i++) {
+            ssize_t copied;
+            do {
+                copied = tee(in, copy[1], i == 0 ? SPLICE_CHUNK : (size_t)n, 0);
+            } while (copied == -1 && errno == EINTR);
+            if (copied == -1) {
+                perror("tee");
+                ret = -1;
+            } else if (i > 0 && copied != n) {
+                fprintf(stderr, "tee: short copy\n");
+                ret = -1;
+            } else {
+                n = copied;
+                ret = move_bytes(copy[0], outputs[i], n);
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        if (ret != 0 || n == 0) {
+            break;
+        }
+        ret = move_bytes(in, outputs[num_outputs - 1], n);
+    }
+
+    close(copy[0]);
+    close(copy[1]);
+    return ret;
+}
+
+int move_bytes(int in, int out, size_t count) {
+    char *buffer = NULL;
+    while (count > 0) {
+        ssize_t n;
+        if (!buffer) {
+            n = splice(in, NULL, out, NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n == -1 && errno == EINVAL) {
+                buffer = malloc(COPY_BUFFER_SIZE);
+                if (!buffer) {
+                    perror("malloc");
+                    return -1;
+                }
+                continue;
+            }
+        } else {
+            n = read(in, buffer, count < COPY_BUFFER_SIZE ? count : COPY_BUFFER_SIZE);
+            if (n > 0 && write_all(out, buffer, n) != 0) {
+                free(buffer);
+                return -1;
+            }
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror(buffer ? "read" : "splice");
+            free(buffer);
+            return -1;
+        }
+        count -= n;
+    }
+    free(buffer);
+    return 0;
+}
+
+int copy_all(int in, const int *outputs, int num_outputs) {
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (!buffer) {
+        perror("malloc");
+        return -1;
+    }
+
+    int ret = 0;
+    while (ret == 0) {
+        ssize_t n = read(in, buffer, COPY_BUFFER_SIZE);
+        if (n == 0) {
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < num_outputs && ret == 0; i++) {
+            ret = write_all(outputs[i], buffer, n);
+        }
+    }
+
+    free(buffer);
+    return ret;
+}
+
+int write_all(int fd, const char *buffer, size_t count) {
+    while (count > 0) {
+        ssize_t n = write(fd, buffer, count);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return -1;
+        }
+        buffer += n;
+        count -= n;
+    }
+    return 0;
+}
+
+int is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
@@ -0,0 +1,112 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <stddef.h>
+
+/**
+ * @file builtin.h
+ * @brief Declarations for stages that mexec runs itself instead of executing a program.
+ *
+ * Built-in stages move data between file descriptors with splice and tee, so the
+ * bytes stay in kernel pipe buffers instead of being copied through user space:
+ *
+ *   @splice [FILE]   forwards standard input, or FILE, to standard output.
+ *   @tee FILE...     copies standard input to standard output and to every FILE.
+ *
+ * splice needs a pipe on one side and tee on both, so a stage whose descriptors
+ * do not allow it falls back to read and write.
+ *
+ * Error handling: Errors are reported with perror, and the stage exits with a failure status.
+ *
+ * Memory management: The fallback buffer is allocated and freed within each stage.
+ *
+ * @date 14-10-2026
+ * @author Emil Engvall
+ */
+
+/* Largest number of bytes moved by one splice or tee call. */
+#define SPLICE_CHUNK (1024 * 1024)
+#define COPY_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Checks whether a command is a built-in stage.
+ *
+ * @param name The command name.
+ * @return 1 if the command is a built-in stage, 0 otherwise.
+ */
+int is_builtin(const char *name);
+
+/**
+ * @brief Runs a built-in stage in the current process.
+ *
+ * Standard input and output must already be connected to the stage's pipes.
+ *
+ * @param argv The NULL-terminated arguments, starting with the stage's name.
+ * @return The stage's exit status.
+ */
+int run_builtin(char **argv);
+
+/**
+ * @brief Forwards everything from one descriptor to another with splice.
+ *
+ * @param in The descriptor to read from.
+ * @param out The descriptor to write to.
+ * @return 0 on success, -1 on failure.
+ */
+int splice_all(int in, int out);
+
+/**
+ * @brief Copies a pipe to several outputs with tee and splice.
+ *
+ * The first output receives a tee of the input, every output but the last a tee
+ * through a private pipe, and the last output is spliced from the input, which
+ * consumes the data.
+ *
+ * @param in The pipe to read from.
+ * @param outputs The descriptors to write to.
+ * @param num_outputs The number of outputs, at least 2.
+ * @return 0 on success, -1 on failure.
+ */
+int tee_all(int in, const int *outputs, int num_outputs);
+
+/**
+ * @brief Moves exactly count bytes from a pipe to a descriptor.
+ *
+ * Uses splice, or read and write if the output does not support splice.
+ *
+ * @param in The pipe to read from.
+ * @param out The descriptor to write to.
+ * @param count The number of bytes to move.
+ * @return 0 on success, -1 on failure or if the pipe ended early.
+ */
+int move_bytes(int in, int out, size_t count);
+
+/**
+ * @brief Copies everything from one descriptor to several others with read and write.
+ *
+ * @param in The descriptor to read from.
+ * @param outputs The descriptors to write to.
+ * @param num_outputs The number of outputs.
+ * @return 0 on success, -1 on failure.
+ */
+int copy_all(int in, const int *outputs, int num_outputs);
+
+/**
+ * @brief Writes a whole buffer, retrying after partial writes.
+ *
+ * @param fd The descriptor to write to.
+ * @param buffer The data.
+ * @param count The number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int write_all(int fd, const char *buffer, size_t count);
+
+/**
+ * @brief Checks whether a descriptor refers to a pipe.
+ *
+ * @param fd The descriptor.
+ * @return 1 if it is a pipe or FIFO, 0 otherwise.
+ */
+int is_pipe(int fd);
+
+#endif // BUILTIN_H
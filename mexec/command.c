@@ -2,44 +2,122 @@
  * file: command.c
  * 
  * This module provides functions to execute commands, handle 
- * input/output redirection, and manage processes.
+ * input/output redirection, and manage processes. Commands are started with
+ * posix_spawnp, falling back to fork when it is not usable.
  * 
  * Error handling: Errors are managed by printing messages with perror and exiting 
  * on critical failures, such as errors in fork, dup2, or exec.
  * 
- * Memory management: The memory for commands needs to be manually freed by calling free_commands.
+ * Memory management: The memory for commands needs to be manually freed by calling free_input.
  * 
  * date: 14-10-2024
  * author: Emil Engvall
  */
 
+#define _GNU_SOURCE
 #include "command.h"
+#include "builtin.h"
+#include "report.h"
+#include "supervise.h"
+#include "pipes.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/wait.h>
 #include <string.h> 
 #include <errno.h> 
+#include <spawn.h>
 
-int execute_commands(char ***commands, int cmd_count, int **pipes) {
+extern char **environ;
+
+int execute_commands(char ***commands, int cmd_count, int **pipes, FILE *report, int fail_fast) {
     int *pids = malloc(cmd_count * sizeof(int));
-    if (!pids) {
+    struct StageStats *stats = report ? malloc(cmd_count * sizeof(struct StageStats)) : NULL;
+    if (!pids || (report && !stats)) {
         perror("malloc");
         exit(EXIT_FAILURE);
     }
     int exit_status = 0;
 
     for (int i = 0; i < cmd_count; i++) {
-        fork_and_execute_command(i, commands, cmd_count, pipes, pids);
+        if (stats) {
+            clock_gettime(CLOCK_MONOTONIC, &stats[i].start);
+        }
+        launch_command(i, commands, cmd_count, pipes, pids);
     }
 
     close_all_pipes(pipes, cmd_count);
-    wait_for_children(pids, cmd_count, &exit_status);
+    if (supervise_children(pids, stats, cmd_count, fail_fast, &exit_status) != 0) {
+        reap_in_exit_order(pids, stats, cmd_count, fail_fast, &exit_status);
+    }
+    if (stats) {
+        for (int i = 0; i < cmd_count; i++) {
+            print_stage_report(report, 1, i, commands[i][0], &stats[i]);
+        }
+        fflush(report);
+    }
 
+    free(stats);
     free(pids);
     return exit_status;
 }
 
+int start_pipeline(char ***commands, int cmd_count, int *pids) {
+    int **pipes = setup_pipes(cmd_count - 1);
+    int ret = 0;
+    for (int i = 0; i < cmd_count; i++) {
+        launch_command(i, commands, cmd_count, pipes, pids);
+        if (pids[i] == -1) {
+            ret = -1;
+        }
+    }
+    close_all_pipes(pipes, cmd_count);
+    free_pipes(pipes, cmd_count - 1);
+    return ret;
+}
+
+void launch_command(int i, char ***commands, int cmd_count, int **pipes, int *pids) {
+    if (is_builtin(commands[i][0]) || spawn_command(i, commands, cmd_count, pipes, pids) != 0) {
+        fork_and_execute_command(i, commands, cmd_count, pipes, pids);
+    }
+}
+
+int spawn_command(int i, char ***commands, int cmd_count, int **pipes, int *pids) {
+    posix_spawn_file_actions_t actions;
+    int ret = posix_spawn_file_actions_init(&actions);
+    if (ret != 0) {
+        return -1;
+    }
+
+    if (i > 0) {
+        ret = posix_spawn_file_actions_adddup2(&actions, pipes[i - 1][0], STDIN_FILENO);
+    }
+    if (ret == 0 && i < cmd_count - 1) {
+        ret = posix_spawn_file_actions_adddup2(&actions, pipes[i][1], STDOUT_FILENO);
+    }
+
+    pid_t pid = -1;
+    if (ret == 0) {
+        ret = posix_spawnp(&pid, commands[i][0], &actions, NULL, commands[i], environ);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (ret == 0) {
+        pids[i] = pid;
+        return 0;
+    }
+    if (ret == ENOSYS || ret == EINVAL) {
+        return -1;
+    }
+    if (ret == EAGAIN || ret == ENOMEM) {
+        fprintf(stderr, "posix_spawn: %s\n", strerror(ret));
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stderr, "%s: %s\n", commands[i][0], strerror(ret));
+    pids[i] = -1;
+    return 0;
+}
+
 void fork_and_execute_command(int i, char ***commands, int cmd_count, int **pipes, int *pids) {
     int pid = fork();
     if (pid == -1) {
@@ -50,6 +128,11 @@ void fork_and_execute_command(int i, char ***commands, int cmd_count, int **pipe
     if (pid == 0) {
         setup_redirection(i, cmd_count, pipes);
         close_all_pipes(pipes, cmd_count);
+        if (is_builtin(commands[i][0])) {
+            /* No exec closes the other pipelines' pipes of a batch for a built-in stage. */
+            close_range(3, ~0U, 0);
+            exit(run_builtin(commands[i]));
+        }
         execvp(commands[i][0], commands[i]);
         fprintf(stderr, "%s: %s\n", commands[i][0], strerror(errno));
         exit(EXIT_FAILURE);
@@ -58,20 +141,6 @@ void fork_and_execute_command(int i, char ***commands, int cmd_count, int **pipe
     pids[i] = pid;
 }
 
-void wait_for_children(int *pids, int cmd_count, int *exit_status) {
-    for (int i = 0; i < cmd_count; i++) {
-        int status;
-        if (waitpid(pids[i], &status, 0) == -1) {
-            perror("waitpid");
-            *exit_status = EXIT_FAILURE;
-        } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-            *exit_status = EXIT_FAILURE;
-        } else if (WIFSIGNALED(status)) {
-            *exit_status = EXIT_FAILURE;
-        }
-    }
-}
-
 void setup_redirection(int i, int cmd_count, int **pipes) {
     if (i > 0) {
         if (dup2(pipes[i - 1][0], STDIN_FILENO) == -1) {
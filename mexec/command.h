@@ -8,35 +8,58 @@
  * This module provides functions to execute commands, handle 
  * input/output redirection, and manage processes.
  * 
+ * Commands are started with posix_spawnp, which on Linux creates the child without
+ * copying the parent's page tables and reports exec errors back to the parent. The
+ * pipe descriptors are close-on-exec, so the only file actions needed are the two
+ * dup2 calls of the stage. fork is only used for built-in stages, and if
+ * posix_spawnp fails for a reason other than the command itself.
+ * 
  * Error handling: Errors are managed by printing messages with perror and exiting 
- * on critical failures, such as errors in fork, dup2, or exec.
+ * on critical failures, such as errors in fork, dup2, or exec. A command that
+ * cannot be executed is reported and counts as a failed stage.
  * 
- * Memory management: The memory for commands needs to be manually freed by calling free_commands.
+ * Memory management: The memory for commands needs to be manually freed by calling free_input.
  * 
  * @date 14-10-2024
  * @author Emil Engvall
  */
 
 #include <stdio.h>
+#include "report.h"
 
 /**
  * @brief Executes all commands by creating processes and setting up pipes.
  * 
  * This function manages the execution flow by forking processes, setting up redirection,
- * and waiting for all child processes to finish.
+ * and waiting for all child processes to finish, in the order they exit (see supervise.h).
  * 
  * @param commands Array of commands to execute.
  * @param cmd_count The number of commands.
  * @param pipes Array of pipes for connecting commands.
- * @return Exit status for the entire process.
+ * @param report The report to write a row per stage to, or NULL (see report.h).
+ * @param fail_fast Non-zero to terminate the other stages as soon as one fails.
+ * @return The status of the rightmost failed stage, or 0 (see supervise.h).
  */
-int execute_commands(char ***commands, int cmd_count, int **pipes);
+int execute_commands(char ***commands, int cmd_count, int **pipes, FILE *report, int fail_fast);
 
 /**
- * @brief Forks and executes a single command.
+ * @brief Starts a pipeline without waiting for it.
  * 
- * This function forks a new process for the command at index i, sets up redirection,
- * and executes the command. Stores the child's PID in the pids array.
+ * Creates the pipes between the commands, starts every command and closes the parent's
+ * ends of the pipes. The caller reaps the children, whose PIDs are stored in the pids
+ * array. This is the entry point that mmake uses to run a recipe as a pipeline.
+ * 
+ * @param commands Array of commands to execute.
+ * @param cmd_count The number of commands.
+ * @param pids The array to store child process IDs, -1 for a command that could not be executed.
+ * @return 0 if every command was started, -1 if a command could not be executed.
+ */
+int start_pipeline(char ***commands, int cmd_count, int *pids);
+
+/**
+ * @brief Starts a single command, with posix_spawnp or, if needed, fork.
+ * 
+ * Stores the child's PID in the pids array, or -1 if the command could not be executed.
  * 
  * @param i The index of the current command.
  * @param commands The array of commands.
@@ -44,19 +67,36 @@ int execute_commands(char ***commands, int cmd_count, int **pipes);
  * @param pipes The array of pipes.
  * @param pids The array to store child process IDs.
  */
-void fork_and_execute_command(int i, char ***commands, int cmd_count, int **pipes, int *pids);
+void launch_command(int i, char ***commands, int cmd_count, int **pipes, int *pids);
+
+/**
+ * @brief Starts a single command with posix_spawnp.
+ * 
+ * The file actions connect the command's standard input and output to its pipes. If the
+ * command cannot be executed, the error is reported and the PID is set to -1.
+ * 
+ * @param i The index of the current command.
+ * @param commands The array of commands.
+ * @param cmd_count The total number of commands.
+ * @param pipes The array of pipes.
+ * @param pids The array to store child process IDs.
+ * @return 0 if the command was handled, -1 if posix_spawnp is not usable and fork should be used.
+ */
+int spawn_command(int i, char ***commands, int cmd_count, int **pipes, int *pids);
 
 /**
- * @brief Waits for all child processes to finish.
+ * @brief Forks and executes a single command.
  * 
- * This function waits for all child processes whose PIDs are stored in the pids array,
- * and updates the exit_status accordingly.
+ * This function forks a new process for the command at index i, sets up redirection,
+ * and executes the command, or runs it in the child if it is a built-in stage. Stores the child's PID in the pids array.
  * 
- * @param pids The array of child process IDs.
+ * @param i The index of the current command.
+ * @param commands The array of commands.
  * @param cmd_count The total number of commands.
- * @param exit_status Pointer to the exit status variable to update.
+ * @param pipes The array of pipes.
+ * @param pids The array to store child process IDs.
  */
-void wait_for_children(int *pids, int cmd_count, int *exit_status);
+void fork_and_execute_command(int i, char ***commands, int cmd_count, int **pipes, int *pids);
 
 /**
  * @brief Sets up input/output redirection for a command.
@@ -5,14 +5,24 @@
  * provided as an argument, then executes the commands sequentially or as a pipeline 
  * if multiple commands are provided. The program creates pipes for inter-process communication, 
  * sets up child processes for each command, and connects their input and output streams.
+ * With `-p size` the capacity of every pipe is raised with F_SETPIPE_SZ; the size may end
+ * in K or M. Stages named @splice and @tee are run by mexec itself and move data with
+ * splice and tee (see builtin.h). With `-b` the input is a batch of independent pipelines,
+ * separated by blank lines or "---", which run concurrently, at most `-j jobs` at a time
+ * (see batch.h). With `-r FILE` a CSV row of wall time, CPU time, memory, context switches and
+ * I/O bytes is written to FILE, or to standard error for "-", for every stage (see report.h).
+ * Stages are reaped in the order they exit, and with `-f` (fail fast) the first stage that
+ * fails makes the rest of its pipeline be terminated (see supervise.h). With `-s SOCKET`
+ * mexec runs as a server that executes the pipelines clients send over a Unix socket
+ * (see server.h).
  * 
  * Error handling: Errors are handled by printing messages with perror and exiting 
  * the program in the case of failures such as file opening, memory allocation, 
  * fork, pipe, or exec errors.
  * 
  * Memory management: The memory allocated for pipes needs to be manually freed using 
- * the close_pipes function, and the memory allocated for commands should be freed 
- * using free_commands.
+ * the close_pipes function, and the loaded input, which the commands point into,
+ * should be freed using free_input.
  * 
  * date: 14-10-2024
  * author: Emil Engvall
@@ -20,53 +30,134 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 #include "parser.h"
 #include "pipes.h"
 #include "command.h"
-#include "parser.h"
+#include "batch.h"
+#include "server.h"
 
-FILE *open_input_file(int argc, char *argv[]);
+int open_input_file(int argc, char *argv[]);
+int parse_pipe_size(const char *arg);
 
 int main(int argc, char *argv[]) {
-    FILE *input = open_input_file(argc, argv);
+    int pipe_size = 0;
+    int batch = 0;
+    FILE *report = NULL;
+    int fail_fast = 0;
+    const char *socket_path = NULL;
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "bfj:p:r:s:")) != -1) {
+        if (opt == 'p') {
+            pipe_size = parse_pipe_size(optarg);
+        } else if (opt == 'r') {
+            report = open_report(optarg);
+        } else if (opt == 's') {
+            socket_path = optarg;
+        } else if (opt == 'f') {
+            fail_fast = 1;
+        } else if (opt == 'b') {
+            batch = 1;
+        } else if (opt == 'j') {
+            char *end;
+            max_jobs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || max_jobs < 1 || max_jobs > INT_MAX) {
+                fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            fprintf(stderr, "usage: %s [-b] [-f] [-j jobs] [-p pipe_size] [-r report] [-s socket] [FILE]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (max_jobs < 1) {
+        max_jobs = 1;
+    }
 
-    int cmd_count;
-    char ***commands = read_commands(input, &cmd_count);
+    if (socket_path) {
+        if (optind != argc) {
+            fprintf(stderr, "usage: %s -s socket [-f] [-p pipe_size] [-r report]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        run_server(socket_path, pipe_size, report, fail_fast);
+    }
 
-    if (input != stdin) {
-        fclose(input);
+    int fd = open_input_file(argc, argv);
+    struct Input input;
+    load_input(&input, fd);
+    if (fd != STDIN_FILENO) {
+        close(fd);
     }
+    parse_input(&input, batch);
 
-    if (cmd_count == 0) {
-        free_commands(commands, cmd_count);
+    if (batch) {
+        int exit_status = run_batch(input.pipelines, input.count, (int)max_jobs, pipe_size, report, fail_fast);
+        free_input(&input);
+        close_report(report);
+        return exit_status;
+    }
+
+    if (input.count == 0) {
+        free_input(&input);
+        close_report(report);
         exit(EXIT_SUCCESS);
     }
 
+    char ***commands = input.pipelines[0].commands;
+    int cmd_count = input.pipelines[0].cmd_count;
     int num_pipes = cmd_count - 1;
     int **pipes_ptr = setup_pipes(num_pipes);
+    if (pipe_size > 0) {
+        set_pipe_size(pipes_ptr, num_pipes, pipe_size);
+    }
 
-    int overall_exit_status = execute_commands(commands, cmd_count, pipes_ptr);
+    int overall_exit_status = execute_commands(commands, cmd_count, pipes_ptr, report, fail_fast);
 
-    free_commands(commands, cmd_count);
+    free_input(&input);
     close_pipes(pipes_ptr, num_pipes);
+    close_report(report);
 
-    return overall_exit_status;
+    return overall_exit_status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-FILE *open_input_file(int argc, char *argv[]) {
-    if (argc > 2) {
-        fprintf(stderr, "usage: %s [FILE]\n", argv[0]);
+int open_input_file(int argc, char *argv[]) {
+    if (argc - optind > 1) {
+        fprintf(stderr, "usage: %s [-b] [-f] [-j jobs] [-p pipe_size] [-r report] [-s socket] [FILE]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    if (argc == 2) {
-        FILE *file = fopen(argv[1], "r");
-        if (!file) {
-            fprintf(stderr, "%s: No such file or directory\n", argv[1]);
+    if (argc - optind == 1) {
+        int fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            fprintf(stderr, "%s: No such file or directory\n", argv[optind]);
             exit(EXIT_FAILURE);
         }
-        return file;
+        return fd;
     }
 
-    return stdin;
-}
\ No newline at end of file
+    return STDIN_FILENO;
+}
+
+int parse_pipe_size(const char *arg) {
+    char *end;
+    errno = 0;
+    long size = strtol(arg, &end, 10);
+    long multiplier = 1;
+    if (*end == 'K' || *end == 'k') {
+        multiplier = 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        multiplier = 1024 * 1024;
+        end++;
+    }
+    /* The range is checked before multiplying, so that a large size cannot overflow. */
+    if (end == arg || *end != '\0' || errno == ERANGE || size <= 0 || size > INT_MAX / multiplier) {
+        fprintf(stderr, "Invalid pipe size: %s\n", arg);
+        exit(EXIT_FAILURE);
+    }
+    return (int)(size * multiplier);
+}
@@ -1,136 +1,221 @@
 /**
  * file: parser.c
- * 
- * This module provides functions for parsing command lines and tokenizing 
- * them into individual arguments, trimming whitespace, and handling multiple commands.
- * 
- * Error handling: Errors are handled by printing appropriate messages using perror 
+ *
+ * This module loads the input of mexec into one buffer and tokenizes it in a single
+ * pass. Arguments are terminated in place and point into the buffer; the argument
+ * vectors of all commands share one array, and the commands and pipelines are set up
+ * to point into it once the whole input has been read.
+ *
+ * Error handling: Errors are handled by printing appropriate messages using perror
  * and exiting the program on memory allocation failures or invalid input.
- * 
+ *
  * date: 14-10-2024
  * author: Emil Engvall
  */
 
 #include "parser.h"
+#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-void trim(char *str) {
-    char *start = str;
-    while (*start && isspace((unsigned char)*start)) {
-        start++;
-    }
+void load_input(struct Input *input, int fd) {
+    memset(input, 0, sizeof(*input));
 
-    char *end = start + strlen(start);
-    while (end > start && isspace((unsigned char)*(end - 1))) {
-        end--;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
     }
 
-    *end = '\0';
-
-    if (start != str) {
-        memmove(str, start, end - start + 1);
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        /*
+         * Reserve one byte more than the file so that a token ending the file can be
+         * terminated: the file is mapped over the start of an anonymous mapping, and
+         * the byte after it lies either in the zero-filled tail of the file's last
+         * page or in the anonymous page that follows.
+         */
+        input->size = st.st_size;
+        input->map_size = input->size + 1;
+        void *area = mmap(NULL, input->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (area == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        if (mmap(area, input->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        input->data = area;
+        input->data[input->size] = '\0';
+        return;
     }
-}
-
-char **parse_command(const char *line, int *argc_out) {
-    int argc = 0;
-    int capacity = INITIAL_ARG_CAPACITY;
 
-    char **argv = malloc(capacity * sizeof(char *));
-    if (!argv) {
+    size_t capacity = READ_CHUNK;
+    input->data = malloc(capacity);
+    if (!input->data) {
         perror("malloc");
         exit(EXIT_FAILURE);
     }
-
-    char *copy = strdup(line);
-    if (!copy) {
-        perror("strdup");
-        exit(EXIT_FAILURE);
-    }
-
-    char *ptr = copy;
-    char *token;
-
-    while ((token = strtok_r(ptr, " \t\n", &ptr))) {
-        if (argc >= capacity) {
+    while (1) {
+        if (capacity - input->size < READ_CHUNK / 2) {
             capacity *= 2;
-            argv = realloc(argv, capacity * sizeof(char *));
-            if (!argv) {
+            char *data = realloc(input->data, capacity);
+            if (!data) {
                 perror("realloc");
                 exit(EXIT_FAILURE);
             }
+            input->data = data;
+        }
+        /* Leave room for the terminator of the last token. */
+        ssize_t n = read(fd, input->data + input->size, capacity - input->size - 1);
+        if (n == 0) {
+            break;
         }
-        argv[argc++] = strdup(token);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        input->size += n;
     }
+    input->data[input->size] = '\0';
+}
 
-    argv[argc] = NULL;
-    if (argc_out) {
-        *argc_out = argc;
+void parse_input(struct Input *input, int batch) {
+    input->args_capacity = INITIAL_ARG_CAPACITY;
+    input->args = malloc(input->args_capacity * sizeof(char *));
+    input->capacity = INITIAL_PIPELINE_CAPACITY;
+    input->pipelines = malloc(input->capacity * sizeof(struct Pipeline));
+    if (!input->args || !input->pipelines) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
 
-    free(copy);
-    return argv;
-}
+    /* A new pipeline starts at the first command after a separator line. */
+    int in_pipeline = 0;
+    char *data_end = input->data + input->size;
+    char *line_start = input->data;
+    for (int line = 1; line_start < data_end; line++) {
+        char *line_end = memchr(line_start, '\n', data_end - line_start);
+        if (!line_end) {
+            line_end = data_end;
+        }
+        char *start = line_start;
+        char *end = line_end;
+        line_start = line_end + 1;
+        trim_span(&start, &end);
+
+        if (start == end || (batch && end - start == 3 && memcmp(start, "---", 3) == 0)) {
+            if (batch) {
+                in_pipeline = 0;
+            }
+            continue;
+        }
+        if (!in_pipeline) {
+            add_pipeline(input, line);
+            in_pipeline = 1;
+        }
+        add_command(input, start, end);
+        input->pipelines[input->count - 1].cmd_count++;
+    }
 
-char ***allocate_commands(void) {
-    char ***commands = malloc(INITIAL_CMD_CAPACITY * sizeof(char **));
-    if (!commands) {
+    /* The argument array no longer moves, so the commands can point into it. */
+    input->commands = malloc((input->num_commands ? input->num_commands : 1) * sizeof(char **));
+    if (!input->commands) {
         perror("malloc");
         exit(EXIT_FAILURE);
     }
-    return commands;
+    size_t command = 0;
+    char **argv = input->args;
+    for (size_t i = 0; i < input->num_args; i++) {
+        if (!input->args[i]) {
+            input->commands[command++] = argv;
+            argv = &input->args[i + 1];
+        }
+    }
+    command = 0;
+    for (int i = 0; i < input->count; i++) {
+        input->pipelines[i].commands = &input->commands[command];
+        command += input->pipelines[i].cmd_count;
+    }
+}
+
+void trim_span(char **start, char **end) {
+    while (*start < *end && isspace((unsigned char)**start)) {
+        (*start)++;
+    }
+    while (*end > *start && isspace((unsigned char)*(*end - 1))) {
+        (*end)--;
+    }
 }
 
-int read_and_trim_line(FILE *input, char *line) {
-    while (fgets(line, MAX_LINE_LENGTH, input)) {
-        trim(line);
-        if (line[0] != '\0') {
-            return 1;
+void add_command(struct Input *input, char *start, char *end) {
+    char *p = start;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        add_arg(input, p);
+        while (p < end && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        /* The byte after each token is a delimiter, a newline or the spare byte. */
+        *p = '\0';
+        if (p < end) {
+            p++;
         }
     }
-    return 0;
+    add_arg(input, NULL);
+    input->num_commands++;
 }
 
-char ***add_command(char ***commands, int *cmd_count, int *cmd_capacity, char **args) {
-    if (*cmd_count >= *cmd_capacity) {
-        *cmd_capacity *= 2;
-        char ***temp = realloc(commands, (*cmd_capacity) * sizeof(char **));
-        if (!temp) {
+void add_arg(struct Input *input, char *arg) {
+    if (input->num_args == input->args_capacity) {
+        input->args_capacity *= 2;
+        char **args = realloc(input->args, input->args_capacity * sizeof(char *));
+        if (!args) {
             perror("realloc");
             exit(EXIT_FAILURE);
         }
-        commands = temp;
+        input->args = args;
     }
-    commands[(*cmd_count)++] = args;
-    return commands;
+    input->args[input->num_args++] = arg;
 }
 
-char ***read_commands(FILE *input, int *cmd_count_out) {
-    char ***commands = allocate_commands();
-    int cmd_capacity = INITIAL_CMD_CAPACITY;
-    int cmd_count = 0;
-    char line[MAX_LINE_LENGTH];
-
-    while (read_and_trim_line(input, line)) {
-        int argc;
-        char **args = parse_command(line, &argc);
-        commands = add_command(commands, &cmd_count, &cmd_capacity, args);
+void add_pipeline(struct Input *input, int line) {
+    if (input->count == input->capacity) {
+        input->capacity *= 2;
+        struct Pipeline *pipelines = realloc(input->pipelines, input->capacity * sizeof(struct Pipeline));
+        if (!pipelines) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        input->pipelines = pipelines;
     }
-
-    *cmd_count_out = cmd_count;
-    return commands;
+    input->pipelines[input->count].commands = NULL;
+    input->pipelines[input->count].cmd_count = 0;
+    input->pipelines[input->count].line = line;
+    input->count++;
 }
 
-void free_commands(char ***commands, int cmd_count) {
-    for (int i = 0; i < cmd_count; i++) {
-        char **cmd = commands[i];
-        for (int j = 0; cmd[j] != NULL; j++) {
-            free(cmd[j]);
-        }
-        free(cmd);
+void free_input(struct Input *input) {
+    if (input->map_size > 0) {
+        munmap(input->data, input->map_size);
+    } else {
+        free(input->data);
     }
-    free(commands);
+    free(input->args);
+    free(input->commands);
+    free(input->pipelines);
+    memset(input, 0, sizeof(*input));
 }
@@ -1,101 +1,118 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <stdio.h>
+#include <stddef.h>
 
 /**
  * @file parser.h
- * @brief Declarations for command line parsing functions.
- * 
- * This module provides functions for parsing command lines and tokenizing 
- * them into individual arguments, trimming whitespace, and handling multiple commands.
- * 
- * Error handling: Errors are handled by printing appropriate messages using perror 
+ * @brief Declarations for loading and tokenizing the commands of mexec.
+ *
+ * The whole input is loaded into one buffer first: a regular file is memory-mapped,
+ * anything else is read until end of file. The tokenizer then makes a single pass
+ * over the buffer, trimming each line and splitting it at spaces and tabs. Tokens
+ * are terminated in place, so every argument points into the buffer and nothing is
+ * copied; there is no limit on the length of a line. The argument vectors of all
+ * commands are stored back to back in one array, so parsing takes a constant
+ * number of allocations, however many arguments a command has.
+ *
+ * In batch mode, pipelines are separated by blank lines or by lines containing only
+ * "---". Otherwise blank lines are skipped and every line belongs to one pipeline.
+ *
+ * Error handling: Errors are handled by printing appropriate messages using perror
  * and exiting the program on memory allocation failures or invalid input.
- * 
+ *
+ * Memory management: The buffer and the arrays pointing into it must be released
+ * with free_input.
+ *
  * @date 14-10-2024
-* @author Emil Engvall
+ * @author Emil Engvall
  */
 
-#define MAX_LINE_LENGTH 1024
-#define INITIAL_ARG_CAPACITY 10
-#define INITIAL_CMD_CAPACITY 10
+#define INITIAL_ARG_CAPACITY 64
+#define INITIAL_PIPELINE_CAPACITY 16
+#define READ_CHUNK (64 * 1024)
+
+/* A pipeline: its NULL-terminated commands, and the line its first command is on. */
+struct Pipeline {
+    char ***commands;
+    int cmd_count;
+    int line;
+};
+
+/* The loaded input and everything parsed from it. */
+struct Input {
+    char *data;
+    size_t size;
+    size_t map_size;
+    char **args;
+    size_t num_args;
+    size_t args_capacity;
+    char ***commands;
+    size_t num_commands;
+    struct Pipeline *pipelines;
+    int count;
+    int capacity;
+};
 
 /**
- * @brief Trims leading and trailing whitespace from a string.
- * 
- * This function removes any leading or trailing spaces from the input string.
- * 
- * @param str The string to trim.
+ * @brief Loads the whole input into memory.
+ *
+ * A non-empty regular file is mapped privately, with one writable byte after its end
+ * for the last terminator. Other inputs are read into a growing buffer.
+ *
+ * @param input The input to fill.
+ * @param fd The descriptor to load from.
  */
-void trim(char *str);
+void load_input(struct Input *input, int fd);
 
 /**
- * @brief Parses a command line into arguments.
- * 
- * This function takes a command line string and splits it into individual 
- * arguments, returning a dynamically allocated array of arguments.
- * 
- * @param line The command line to parse.
- * @param argc_out Pointer to an integer where the argument count will be stored.
- * @return A NULL-terminated array of strings representing the arguments.
+ * @brief Tokenizes the loaded input into pipelines.
+ *
+ * @param input The loaded input.
+ * @param batch Non-zero to split the input into pipelines at separator lines.
  */
-char **parse_command(const char *line, int *argc_out);
+void parse_input(struct Input *input, int batch);
 
 /**
- * @brief Reads all commands from input.
- * 
- * This function reads multiple commands from the input stream and returns them as 
- * a dynamically allocated array of commands.
- * 
- * @param input The input file to read commands from.
- * @param cmd_count_out Pointer to an integer where the number of commands will be stored.
- * @return A dynamically allocated array of commands.
+ * @brief Finds the trimmed extent of a line.
+ *
+ * @param start Set to the first character of the line that is not whitespace.
+ * @param end The end of the line; set to one past its last character that is not whitespace.
  */
-char ***read_commands(FILE *input, int *cmd_count_out);
+void trim_span(char **start, char **end);
 
 /**
- * @brief Reads a single line from input and trims it.
- * 
- * This function reads a line from the input file, trims any leading and trailing whitespace,
- * and returns 1 if a non-empty line was read, or 0 otherwise.
- * 
- * @param input The input file to read from.
- * @param line Buffer to store the read line.
- * @return 1 if a non-empty line was read, 0 otherwise.
+ * @brief Splits a trimmed line into the arguments of one command.
+ *
+ * Each argument is terminated in place, and the command is terminated by NULL.
+ *
+ * @param input The input to add the arguments to.
+ * @param start The first character of the line.
+ * @param end One past the last character of the line.
  */
-int read_and_trim_line(FILE *input, char *line);
+void add_command(struct Input *input, char *start, char *end);
 
 /**
- * @brief Allocates initial memory for the commands array.
- * 
- * This function allocates memory for the commands array with an initial capacity.
- * 
- * @return A pointer to the newly allocated commands array.
+ * @brief Appends an argument, or the NULL ending a command, to the argument array.
+ *
+ * @param input The input.
+ * @param arg The argument.
  */
-char ***allocate_commands(void);
+void add_arg(struct Input *input, char *arg);
 
 /**
- * @brief Adds a command to the commands array, resizing if necessary.
- * 
- * This function adds a new command to the commands array, and reallocates memory if the capacity is exceeded.
- * 
- * @param commands The current commands array.
- * @param cmd_count Pointer to the current command count.
- * @param cmd_capacity Pointer to the current capacity of the commands array.
- * @param args The command arguments to add.
- * @return The (possibly reallocated) commands array.
+ * @brief Starts a new pipeline.
+ *
+ * @param input The input.
+ * @param line The line of the pipeline's first command.
  */
-char ***add_command(char ***commands, int *cmd_count, int *cmd_capacity, char **args);
+void add_pipeline(struct Input *input, int line);
 
 /**
- * @brief Frees the memory allocated for the commands array.
- * 
- * This function frees all memory associated with the commands array.
- * 
- * @param commands The commands array to free.
- * @param cmd_count The number of commands in the array.
+ * @brief Frees the buffer and every array pointing into it.
+ *
+ * @param input The input to free.
  */
-void free_commands(char ***commands, int cmd_count);
+void free_input(struct Input *input);
 
 #endif // PARSER_H
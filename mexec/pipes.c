@@ -13,7 +13,9 @@
  * @author Emil Engvall
  */
 
+#define _GNU_SOURCE
 #include "pipes.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -40,7 +42,7 @@ int **setup_pipes(int num_pipes) {
             exit(EXIT_FAILURE);
         }
 
-        if (pipe(pipes[i]) == -1) {
+        if (pipe2(pipes[i], O_CLOEXEC) == -1) {
             perror("pipe");
             for (int j = 0; j <= i; j++) {
                 free(pipes[j]);
@@ -53,6 +55,27 @@ int **setup_pipes(int num_pipes) {
     return pipes;
 }
 
+void free_pipes(int **pipes, int num_pipes) {
+    if (!pipes) {
+        return;
+    }
+
+    for (int i = 0; i < num_pipes; i++) {
+        free(pipes[i]);
+    }
+    free(pipes);
+}
+
+void set_pipe_size(int **pipes, int num_pipes, int size) {
+    int reported = 0;
+    for (int i = 0; i < num_pipes; i++) {
+        if (fcntl(pipes[i][1], F_SETPIPE_SZ, size) == -1 && !reported) {
+            perror("fcntl F_SETPIPE_SZ");
+            reported = 1;
+        }
+    }
+}
+
 void close_pipes(int **pipes, int num_pipes) {
     if (!pipes) {
         return;
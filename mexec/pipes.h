@@ -7,6 +7,8 @@
  * 
  * This module provides functions for creating pipes for communication between 
  * commands, handling setup, and closing all file descriptors associated with the pipes.
+ * The pipes are created close-on-exec, so a command only keeps the ends it has
+ * duplicated onto its standard input and output.
  * 
  * Error handling: This module handles errors by printing error messages using `perror` 
  * and immediately exiting the program on critical failures such as memory allocation or pipe creation errors.
@@ -39,6 +41,29 @@ int **setup_pipes(int num_pipes);
  */
 void close_pipes(int **pipes, int num_pipes);
 
+/**
+ * @brief Frees the memory of pipes whose descriptors have already been closed.
+ * 
+ * @param pipes The array of pipes.
+ * @param num_pipes The number of pipes.
+ */
+void free_pipes(int **pipes, int num_pipes);
+
+/**
+ * @brief Sets the capacity of every pipe with F_SETPIPE_SZ.
+ * 
+ * A larger capacity lets a producer run further ahead of its consumer, so fewer
+ * context switches are needed per byte. The kernel rounds the size up to a power
+ * of two pages; sizes above /proc/sys/fs/pipe-max-size need CAP_SYS_RESOURCE.
+ * Every pipe is tried; one whose size cannot be changed keeps its capacity, and only
+ * the first such failure is reported.
+ * 
+ * @param pipes The array of pipes.
+ * @param num_pipes The number of pipes.
+ * @param size The capacity in bytes.
+ */
+void set_pipe_size(int **pipes, int num_pipes, int size);
+
 #endif // PIPES_H
 /**
  * @}
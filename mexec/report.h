@@ -0,0 +1,108 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * @file report.h
+ * @brief Declarations for the per-stage resource report of mexec.
+ *
+ * With `-r FILE` every stage is reaped with wait4, and one CSV row per stage is written
+ * to FILE ("-" for standard error) after the header
+ *
+ *   pipeline,stage,command,pid,status,wall_ms,user_ms,sys_ms,max_rss_kb,
+ *   voluntary_cs,involuntary_cs,bytes_read,bytes_written
+ *
+ * wall_ms is the time from just before the stage was started until it was reaped, and
+ * the CPU times, maximum resident set size and context switches come from its rusage.
+ * Before the stage is reaped, waitid with WNOWAIT leaves it a zombie so that the
+ * rchar and wchar counters of /proc/PID/io can still be read: the bytes passed to
+ * read and write, which for a filter are almost all its pipe traffic; data moved by
+ * splice, as in the built-in stages, is not counted. A counter that
+ * cannot be read is reported as -1, and so is every value of a stage that could not
+ * be executed.
+ *
+ * Error handling: Errors in waitid and wait4 are returned to the caller, with errno set.
+ *
+ * Memory management: No memory is allocated.
+ *
+ * @date 14-10-2026
+ * @author Emil Engvall
+ */
+
+/* What was measured for one stage. */
+struct StageStats {
+    pid_t pid;
+    int status;
+    struct timespec start;
+    struct timespec end;
+    struct rusage usage;
+    long long bytes_read;
+    long long bytes_written;
+};
+
+/**
+ * @brief Waits for a child to exit, and measures it before reaping it.
+ *
+ * @param pid The child to wait for, or -1 for any child.
+ * @param status Set to the child's wait status.
+ * @param stats Filled with the child's PID, exit time, rusage and I/O counters; start is not changed.
+ * @return The PID of the reaped child, or -1 on error.
+ */
+pid_t reap_child(pid_t pid, int *status, struct StageStats *stats);
+
+/**
+ * @brief Reads the rchar and wchar counters of a process from /proc.
+ *
+ * @param pid The process, which may be a zombie.
+ * @param stats Its bytes_read and bytes_written are set, or -1 if they cannot be read.
+ */
+void read_stage_io(pid_t pid, struct StageStats *stats);
+
+/**
+ * @brief Opens the report file.
+ *
+ * @param path The file, or "-" for standard error.
+ * @return The open report, with the header written.
+ */
+FILE *open_report(const char *path);
+
+/**
+ * @brief Closes the report file.
+ *
+ * @param report The report, or NULL if there is none.
+ */
+void close_report(FILE *report);
+
+/**
+ * @brief Writes the row of one stage.
+ *
+ * @param report The report.
+ * @param pipeline The pipeline's number, from 1.
+ * @param stage The stage's index in the pipeline.
+ * @param command The name of the stage's command.
+ * @param stats The stage's measurements, with pid -1 if it could not be executed.
+ */
+void print_stage_report(FILE *report, int pipeline, int stage, const char *command, const struct StageStats *stats);
+
+/**
+ * @brief Converts a wait status to the status of a stage.
+ *
+ * @param status The wait status.
+ * @return The exit code, or 128 plus the signal number.
+ */
+int stage_status(int status);
+
+/**
+ * @brief Returns the milliseconds between two points in time.
+ *
+ * @param start The earlier time.
+ * @param end The later time.
+ * @return The difference in milliseconds.
+ */
+double elapsed_ms(const struct timespec *start, const struct timespec *end);
+
+#endif // REPORT_H
@@ -0,0 +1,272 @@
+/**
+ * file: server.c
+ *
+ * This module runs mexec as a server: it accepts connections on a Unix socket, executes
+ * every pipeline a client sends through execute_commands, and writes back each
+ * pipeline's exit status. The pipes come from a pool that is filled between requests.
+ *
+ * Error handling: Errors on a connection are reported with perror and end that
+ * connection; errors in setting up the socket exit the program.
+ *
+ * Memory management: Each request is parsed into its own buffer, which is freed once
+ * its pipelines have been executed.
+ *
+ * date: 14-10-2026
+ * author: Emil Engvall
+ */
+
+#define _GNU_SOURCE
+#include "server.h"
+#include "command.h"
+#include "parser.h"
+#include "pipes.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* The socket to remove on shutdown, and the process that owns it; stages forked for
+ * built-ins inherit the exit handler and must not remove it. */
+static const char *server_path;
+static pid_t server_pid;
+
+static void remove_socket(void) {
+    if (server_path && getpid() == server_pid) {
+        unlink(server_path);
+    }
+}
+
+static void stop_server(int sig) {
+    remove_socket();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void run_server(const char *path, int pipe_size, FILE *report, int fail_fast) {
+    int listener = open_server_socket(path);
+
+    server_path = path;
+    server_pid = getpid();
+    atexit(remove_socket);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+
+    struct PipePool pool;
+    pool.pipes = malloc(SERVER_POOL_PIPES * sizeof(int *));
+    if (!pool.pipes) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pool.available = 0;
+    pool.pipe_size = pipe_size;
+    fill_pipe_pool(&pool);
+
+    while (1) {
+        int conn = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            exit(EXIT_FAILURE);
+        }
+        serve_connection(conn, &pool, report, fail_fast);
+        close(conn);
+    }
+}
+
+int open_server_socket(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: Socket path too long\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    /* Only a stale socket is replaced, never a file a mistyped path names. */
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s: %s\n", path, strerror(EEXIST));
+            exit(EXIT_FAILURE);
+        }
+        unlink(path);
+    }
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    if (listen(listener, SERVER_BACKLOG) == -1) {
+        perror("listen");
+        exit(EXIT_FAILURE);
+    }
+    return listener;
+}
+
+void serve_connection(int conn, struct PipePool *pool, FILE *report, int fail_fast) {
+    size_t capacity = SERVER_READ_CHUNK;
+    size_t size = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    int done = 0;
+    while (!done) {
+        if (capacity - size < SERVER_READ_CHUNK / 2) {
+            capacity *= 2;
+            char *grown = realloc(buffer, capacity);
+            if (!grown) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            buffer = grown;
+        }
+        ssize_t n = read(conn, buffer + size, capacity - size);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            break;
+        }
+        if (n == 0) {
+            /* The end of the connection ends its last pipeline. */
+            if (size > 0) {
+                run_request(conn, buffer, size, pool, report, fail_fast);
+            }
+            break;
+        }
+        size += n;
+
+        size_t end;
+        while (!done && (end = find_request_end(buffer, size)) > 0) {
+            if (run_request(conn, buffer, end, pool, report, fail_fast) != 0) {
+                done = 1;
+            }
+            memmove(buffer, buffer + end, size - end);
+            size -= end;
+            fill_pipe_pool(pool);
+        }
+    }
+
+    free(buffer);
+    fill_pipe_pool(pool);
+}
+
+int run_request(int conn, const char *text, size_t size, struct PipePool *pool, FILE *report, int fail_fast) {
+    struct Input input;
+    memset(&input, 0, sizeof(input));
+    input.data = malloc(size + 1);
+    if (!input.data) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(input.data, text, size);
+    input.data[size] = '\0';
+    input.size = size;
+    parse_input(&input, 1);
+
+    int ret = 0;
+    for (int i = 0; i < input.count && ret == 0; i++) {
+        struct Pipeline *pipeline = &input.pipelines[i];
+        int num_pipes = pipeline->cmd_count - 1;
+        int **pipes = take_pipes(pool, num_pipes);
+        int status = execute_commands(pipeline->commands, pipeline->cmd_count, pipes, report, fail_fast);
+        free_pipes(pipes, num_pipes);
+
+        char line[16];
+        int length = snprintf(line, sizeof(line), "%d\n", status);
+        ret = send_all(conn, line, length);
+    }
+
+    free_input(&input);
+    return ret;
+}
+
+int **take_pipes(struct PipePool *pool, int num_pipes) {
+    if (num_pipes <= 0) {
+        return NULL;
+    }
+    if (num_pipes > pool->available) {
+        int **pipes = setup_pipes(num_pipes);
+        if (pool->pipe_size > 0) {
+            set_pipe_size(pipes, num_pipes, pool->pipe_size);
+        }
+        return pipes;
+    }
+
+    int **pipes = malloc(num_pipes * sizeof(int *));
+    if (!pipes) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pool->available -= num_pipes;
+    memcpy(pipes, pool->pipes + pool->available, num_pipes * sizeof(int *));
+    return pipes;
+}
+
+void fill_pipe_pool(struct PipePool *pool) {
+    int missing = SERVER_POOL_PIPES - pool->available;
+    if (missing == 0) {
+        return;
+    }
+    int **pipes = setup_pipes(missing);
+    if (pool->pipe_size > 0) {
+        set_pipe_size(pipes, missing, pool->pipe_size);
+    }
+    memcpy(pool->pipes + pool->available, pipes, missing * sizeof(int *));
+    pool->available = SERVER_POOL_PIPES;
+    free(pipes);
+}
+
+int send_all(int conn, const char *buffer, size_t count) {
+    while (count > 0) {
+        ssize_t n = send(conn, buffer, count, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("send");
+            return -1;
+        }
+        buffer += n;
+        count -= n;
+    }
+    return 0;
+}
+
+size_t find_request_end(const char *buffer, size_t size) {
+    size_t line_start = 0;
+    while (line_start < size) {
+        const char *newline = memchr(buffer + line_start, '\n', size - line_start);
+        if (!newline) {
+            return 0;
+        }
+        char *start = (char *)buffer + line_start;
+        char *end = (char *)newline;
+        trim_span(&start, &end);
+        line_start = newline - buffer + 1;
+        if (start == end || (end - start == 3 && memcmp(start, "---", 3) == 0)) {
+            return line_start;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * @file server.h
+ * @brief Declarations for running mexec as a server that executes pipelines sent over a Unix socket.
+ *
+ * With `-s SOCKET` mexec listens on a Unix stream socket instead of reading one input.
+ * A client writes pipelines in the format of batch mode: commands one per line, each
+ * pipeline ended by a blank line or a line "---", or by the end of the connection.
+ * Each pipeline is executed through execute_commands as soon as its last line has
+ * arrived, and its exit status is written back as one line "S\n", so a client can keep
+ * one connection open and send pipeline after pipeline. S is the status of the rightmost
+ * failed stage, or 0, as in batch mode: an exit code, 128 plus a signal number, or 127
+ * for a command that could not be executed. Clients are served one at a
+ * time, and the stages use the server's standard input, output and error.
+ *
+ * The server keeps a pool of pipe pairs created with setup_pipes. Pipelines take their
+ * pipes from the pool, and the pool is filled again after the status has been sent,
+ * while the server waits for the next request, so that creating pipes is not part of
+ * the time a client waits for.
+ *
+ * Error handling: Errors on a connection are reported with perror and end that
+ * connection; errors in setting up the socket exit the program.
+ *
+ * Memory management: Each request is parsed into its own buffer, which is freed once
+ * its pipelines have been executed.
+ *
+ * @date 14-10-2026
+ * @author Emil Engvall
+ */
+
+#define SERVER_POOL_PIPES 16
+#define SERVER_BACKLOG 16
+#define SERVER_READ_CHUNK 4096
+
+/* Pipe pairs created ahead of the pipelines that will use them. */
+struct PipePool {
+    int **pipes;
+    int available;
+    int pipe_size;
+};
+
+/**
+ * @brief Accepts connections and executes the pipelines sent on them, until killed.
+ *
+ * The socket is removed when the server exits or is stopped by SIGINT, SIGTERM or SIGHUP.
+ *
+ * @param path The path of the socket; a stale socket there is replaced.
+ * @param pipe_size Capacity of the pipes, or 0 for the default.
+ * @param report The report to write a row per stage to, or NULL (see report.h).
+ * @param fail_fast Non-zero to terminate the other stages of a pipeline as soon as one fails.
+ */
+void run_server(const char *path, int pipe_size, FILE *report, int fail_fast);
+
+/**
+ * @brief Creates the listening socket.
+ *
+ * An existing socket at the path is removed first; any other existing file makes the
+ * program exit with "File exists".
+ *
+ * @param path The path of the socket.
+ * @return The listening socket.
+ */
+int open_server_socket(const char *path);
+
+/**
+ * @brief Reads requests from a connection and executes each complete pipeline.
+ *
+ * @param conn The connection.
+ * @param pool The pipe pool.
+ * @param report The report, or NULL.
+ * @param fail_fast Non-zero for fail-fast.
+ */
+void serve_connection(int conn, struct PipePool *pool, FILE *report, int fail_fast);
+
+/**
+ * @brief Executes the pipelines of one request and writes their statuses to the connection.
+ *
+ * @param conn The connection.
+ * @param text The request, which is copied.
+ * @param size The length of the request.
+ * @param pool The pipe pool.
+ * @param report The report, or NULL.
+ * @param fail_fast Non-zero for fail-fast.
+ * @return 0 on success, -1 if the statuses could not be sent.
+ */
+int run_request(int conn, const char *text, size_t size, struct PipePool *pool, FILE *report, int fail_fast);
+
+/**
+ * @brief Takes pipe pairs from the pool, or creates them if the pool has too few.
+ *
+ * @param pool The pipe pool.
+ * @param num_pipes The number of pipes.
+ * @return The pipes, to be freed with free_pipes once they have been closed.
+ */
+int **take_pipes(struct PipePool *pool, int num_pipes);
+
+/**
+ * @brief Creates pipe pairs until the pool is full.
+ *
+ * @param pool The pipe pool.
+ */
+void fill_pipe_pool(struct PipePool *pool);
+
+/**
+ * @brief Sends a whole buffer on a connection, without raising SIGPIPE.
+ *
+ * @param conn The connection.
+ * @param buffer The data.
+ * @param count The number of bytes.
+ * @return 0 on success, -1 on failure.
+ */
+int send_all(int conn, const char *buffer, size_t count);
+
+/**
+ * @brief Finds the end of the first complete pipeline in a request buffer.
+ *
+ * @param buffer The buffered text.
+ * @param size The number of buffered bytes.
+ * @return The length of the text up to and including the first separator line, or 0 if
+ *         no separator line is complete.
+ */
+size_t find_request_end(const char *buffer, size_t size);
+
+#endif // SERVER_H
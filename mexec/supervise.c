@@ -0,0 +1,198 @@
+/**
+ * file: supervise.c
+ *
+ * This module waits for the stages of a pipeline with one epoll instance watching a
+ * pidfd per stage, reaping each stage when it exits, and with fail-fast terminates
+ * the rest of the pipeline through the pidfds once a stage has failed.
+ *
+ * The pipeline's status is that of its rightmost failed stage, as in batch mode.
+ *
+ * Error handling: Errors in epoll_wait and waitpid are reported with perror, and mark
+ * the pipeline as failed.
+ *
+ * Memory management: The pidfds are allocated and freed within supervise_children.
+ *
+ * date: 14-10-2026
+ * author: Emil Engvall
+ */
+
+#define _GNU_SOURCE
+#include "supervise.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int supervise_children(int *pids, struct StageStats *stats, int cmd_count, int fail_fast, int *exit_status) {
+    int *pidfds = malloc(cmd_count * sizeof(int));
+    if (!pidfds) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int ret = epfd == -1 ? -1 : 0;
+    for (int i = 0; i < cmd_count; i++) {
+        pidfds[i] = -1;
+        if (ret == 0 && pids[i] > 0) {
+            pidfds[i] = pidfd_open(pids[i], 0);
+            struct epoll_event event = {.events = EPOLLIN, .data.u32 = i};
+            if (pidfds[i] == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, pidfds[i], &event) == -1) {
+                ret = -1;
+            }
+        }
+    }
+    if (ret == -1) {
+        for (int i = 0; i < cmd_count; i++) {
+            if (pidfds[i] != -1) {
+                close(pidfds[i]);
+            }
+        }
+        if (epfd != -1) {
+            close(epfd);
+        }
+        free(pidfds);
+        return -1;
+    }
+
+    int failed_stage = -1;
+    int running = count_running(pids, stats, cmd_count, &failed_stage, exit_status);
+    int failed = running < cmd_count;
+    int terminated = 0;
+
+    while (running > 0) {
+        if (failed && fail_fast && !terminated) {
+            for (int i = 0; i < cmd_count; i++) {
+                if (pids[i] > 0) {
+                    pidfd_send_signal(pidfds[i], SIGTERM, NULL, 0);
+                }
+            }
+            terminated = 1;
+        }
+
+        struct epoll_event events[SUPERVISE_EVENTS];
+        int n = epoll_wait(epfd, events, SUPERVISE_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            if (*exit_status == 0) {
+                *exit_status = EXIT_FAILURE;
+            }
+            break;
+        }
+        for (int e = 0; e < n; e++) {
+            int i = events[e].data.u32;
+            int status;
+            struct StageStats done;
+            pid_t pid = stats ? reap_child(pids[i], &status, &done) : waitpid(pids[i], &status, 0);
+            if (pid == -1) {
+                perror("waitpid");
+                status = EXIT_FAILURE << 8;
+                if (stats) {
+                    done = stats[i];
+                    done.pid = -1;
+                    done.status = EXIT_FAILURE;
+                }
+            }
+            close(pidfds[i]);
+            pidfds[i] = -1;
+            running--;
+            if (record_exit(pids, stats, i, status, &done, &failed_stage, exit_status)) {
+                failed = 1;
+            }
+        }
+    }
+
+    for (int i = 0; i < cmd_count; i++) {
+        if (pidfds[i] != -1) {
+            close(pidfds[i]);
+        }
+    }
+    close(epfd);
+    free(pidfds);
+    return 0;
+}
+
+void reap_in_exit_order(int *pids, struct StageStats *stats, int cmd_count, int fail_fast, int *exit_status) {
+    int failed_stage = -1;
+    int running = count_running(pids, stats, cmd_count, &failed_stage, exit_status);
+    int failed = running < cmd_count;
+    int terminated = 0;
+
+    while (running > 0) {
+        if (failed && fail_fast && !terminated) {
+            /* The stages are not reaped yet, so their PIDs cannot have been reused. */
+            for (int i = 0; i < cmd_count; i++) {
+                if (pids[i] > 0) {
+                    kill(pids[i], SIGTERM);
+                }
+            }
+            terminated = 1;
+        }
+
+        int status;
+        struct StageStats done;
+        pid_t pid = stats ? reap_child(-1, &status, &done) : waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitpid");
+            if (*exit_status == 0) {
+                *exit_status = EXIT_FAILURE;
+            }
+            return;
+        }
+        for (int i = 0; i < cmd_count; i++) {
+            if (pids[i] == pid) {
+                running--;
+                if (record_exit(pids, stats, i, status, &done, &failed_stage, exit_status)) {
+                    failed = 1;
+                }
+                break;
+            }
+        }
+    }
+}
+
+int record_exit(int *pids, struct StageStats *stats, int i, int status, const struct StageStats *done,
+                int *failed_stage, int *exit_status) {
+    int stage = stage_status(status);
+    note_failure(i, stage, failed_stage, exit_status);
+    if (stats) {
+        struct timespec start = stats[i].start;
+        stats[i] = *done;
+        stats[i].start = start;
+    }
+    pids[i] = 0;
+    return stage != 0;
+}
+
+int count_running(int *pids, struct StageStats *stats, int cmd_count, int *failed_stage, int *exit_status) {
+    int running = 0;
+    for (int i = 0; i < cmd_count; i++) {
+        if (pids[i] == -1) {
+            note_failure(i, 127, failed_stage, exit_status);
+            if (stats) {
+                stats[i].pid = -1;
+                stats[i].status = 127;
+            }
+        } else {
+            running++;
+        }
+    }
+    return running;
+}
+
+void note_failure(int i, int stage, int *failed_stage, int *exit_status) {
+    /* Keep the rightmost failure, like a shell with pipefail. */
+    if (stage != 0 && i > *failed_stage) {
+        *failed_stage = i;
+        *exit_status = stage;
+    }
+}
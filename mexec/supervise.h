@@ -0,0 +1,109 @@
+#ifndef SUPERVISE_H
+#define SUPERVISE_H
+
+#include "report.h"
+
+/**
+ * @file supervise.h
+ * @brief Declarations for waiting for the stages of a pipeline in the order they exit.
+ *
+ * Every stage gets a pidfd from pidfd_open, and all of them are watched by one epoll
+ * instance. A pidfd becomes readable when its process exits, so each stage is reaped
+ * as soon as it has exited, whatever its position in the pipeline. Because a pidfd
+ * refers to one process, signals sent through it with pidfd_send_signal can never
+ * reach a process that has reused the PID.
+ *
+ * With fail-fast, the first stage that fails, or cannot be executed, makes the
+ * supervisor send SIGTERM to every stage that is still running, instead of letting
+ * the stages before it keep producing into a pipeline that will fail anyway. The
+ * terminated stages are reported with status 143.
+ *
+ * The status of the pipeline is that of its rightmost failed stage, or 0, computed like
+ * the statuses of batch mode: a stage's exit code, 128 plus the number of the signal
+ * that killed it, or 127 for a command that could not be executed.
+ *
+ * If the kernel has no pidfds, the stages are reaped with waitpid(-1) instead, which
+ * also returns them in the order they exit.
+ *
+ * Error handling: Errors in epoll_wait and waitpid are reported with perror, and mark
+ * the pipeline as failed.
+ *
+ * Memory management: The pidfds are allocated and freed within supervise_children.
+ *
+ * @date 14-10-2026
+ * @author Emil Engvall
+ */
+
+/* Largest number of exits handled per epoll_wait call. */
+#define SUPERVISE_EVENTS 16
+
+/**
+ * @brief Waits for all stages with pidfds and epoll, in the order they exit.
+ *
+ * The PIDs of reaped stages are cleared, and a PID of -1 is a command that could not
+ * be executed, which counts as a failure.
+ *
+ * @param pids The array of child process IDs.
+ * @param stats The stages' measurements, with the start times set, or NULL to measure nothing.
+ * @param cmd_count The total number of commands.
+ * @param fail_fast Non-zero to terminate the running stages when one fails.
+ * @param exit_status Pointer to the pipeline's status, 0 when called, to update.
+ * @return 0, or -1 if pidfds are not available and nothing has been reaped.
+ */
+int supervise_children(int *pids, struct StageStats *stats, int cmd_count, int fail_fast, int *exit_status);
+
+/**
+ * @brief Waits for all stages with waitpid(-1), in the order they exit.
+ *
+ * Used when pidfds are not available; the parameters are those of supervise_children.
+ * Only the stages of the pipeline may be children of the calling process.
+ *
+ * @param pids The array of child process IDs.
+ * @param stats The stages' measurements, or NULL.
+ * @param cmd_count The total number of commands.
+ * @param fail_fast Non-zero to terminate the running stages when one fails.
+ * @param exit_status Pointer to the pipeline's status, 0 when called, to update.
+ */
+void reap_in_exit_order(int *pids, struct StageStats *stats, int cmd_count, int fail_fast, int *exit_status);
+
+/**
+ * @brief Records a reaped stage, and reports whether it failed.
+ *
+ * @param pids The array of child process IDs; the stage's PID is cleared.
+ * @param stats The stages' measurements, or NULL.
+ * @param i The index of the stage.
+ * @param status The stage's wait status.
+ * @param done The stage's measurements from reap_child, if stats is not NULL.
+ * @param failed_stage Index of the rightmost failed stage so far, or -1.
+ * @param exit_status Pointer to the pipeline's status.
+ * @return 1 if the stage failed, 0 otherwise.
+ */
+int record_exit(int *pids, struct StageStats *stats, int i, int status, const struct StageStats *done,
+                int *failed_stage, int *exit_status);
+
+/**
+ * @brief Counts the running stages.
+ *
+ * Stages that could not be executed get status 127 in their measurements, and count as
+ * failures of the pipeline.
+ *
+ * @param pids The array of child process IDs.
+ * @param stats The stages' measurements, or NULL.
+ * @param cmd_count The total number of commands.
+ * @param failed_stage Index of the rightmost failed stage so far, or -1.
+ * @param exit_status Pointer to the pipeline's status.
+ * @return The number of stages that are running.
+ */
+int count_running(int *pids, struct StageStats *stats, int cmd_count, int *failed_stage, int *exit_status);
+
+/**
+ * @brief Makes a failed stage the pipeline's status if it is the rightmost failure so far.
+ *
+ * @param i The index of the stage.
+ * @param stage The stage's status, as returned by stage_status; 0 is not a failure.
+ * @param failed_stage Index of the rightmost failed stage so far, or -1.
+ * @param exit_status Pointer to the pipeline's status.
+ */
+void note_failure(int i, int stage, int *failed_stage, int *exit_status);
+
+#endif // SUPERVISE_H
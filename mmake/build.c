@@ -4,7 +4,8 @@
  * @brief Implementation of target building functions.
  * 
  * This source file implements functions for building the specified targets in the makefile.
- * It handles dependency resolution, determining if a target needs to be built, and executing commands.
+ * The requested targets and their prerequisites are turned into a dependency graph,
+ * which the scheduler builds with up to `-j` commands running at the same time.
  * 
  * Error handling: Errors during the build process result in error messages and program exit.
  * 
@@ -16,16 +17,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "options.h"
 #include "makefile_loader.h"
 #include "build.h"
 #include "utils.h"
 #include "parser.h"
+#include "scheduler.h"
+#include "hashdb.h"
+#include "trace.h"
+#include "jobserver.h"
 
 void build_targets(makefile *make, options_t *options) {
+    const char *default_target;
     if (options->target_count == 0) {
-        const char *default_target = makefile_default_target(make);
+        default_target = makefile_default_target(make);
         if (!default_target) {
             handle_no_default_target(make);
         }
@@ -33,42 +40,22 @@ void build_targets(makefile *make, options_t *options) {
         options->target_count = 1;
     }
 
-    for (int i = 0; i < options->target_count; i++) {
-        if (process_target(make, options->targets[i], options) != 0) {
-            makefile_del(make);
-            exit(EXIT_FAILURE);
-        }
-    }
-}
-
-int process_target(makefile *make, const char *target_name, options_t *options) {
-    rule *r = makefile_rule(make, target_name);
-
-    if (!r && file_exists(target_name)) {
-        return 0;
-    }
-
-    if (r) {
-        if (build_prerequisites(make, r, options) != 0) {
-            return -1;
-        }
-    } else {
-        handle_missing_rule(target_name);
+    trace_t *trace = options->trace_file ? trace_create(options->trace_file) : NULL;
+    graph_t *graph = graph_create(make, options->targets, options->target_count);
+    graph->trace = trace;
+    /* Without -H, an existing database is still kept in step with the targets that are rebuilt. */
+    graph->content_hash = options->content_hash;
+    if (options->content_hash || access(HASH_DB_FILE, F_OK) == 0) {
+        graph->hashes = hashdb_load();
     }
 
-    int build = needs_build(make, target_name, options);
-    if (build == 1) {
-        char **cmd = rule_cmd(r);
-        if (!cmd || !cmd[0]) {
-            handle_no_command(target_name);
-        }
-        if (!options->silent) {
-            print_command(cmd);
-        }
-        if (execute_command(cmd) != 0) {
-            return -1;
-        }
+    /* With -j N, the jobs are shared with nested builds; without it, those of an outer make are. */
+    if (options->jobs > 1) {
+        graph->jobserver = jobserver_create(options->jobs);
+    } else if (options->jobs == 0) {
+        graph->jobserver = jobserver_join();
+        options->jobs = graph->jobserver ? MAX_JOBS : 1;
     }
-    return 0;
+    graph_build(graph, options);
+    graph_del(graph);
 }
-
@@ -3,8 +3,8 @@
  * 
  * @brief Functions for building targets specified in the makefile.
  * 
- * This header file declares functions for building targets, handling the build process,
- * and processing individual targets based on their dependencies and commands.
+ * This header file declares the function that builds the requested targets, based on
+ * their dependencies and commands (see scheduler.h).
  * 
  * Error handling: Functions report errors via `stderr` and may exit on critical failures.
  * 
@@ -31,17 +31,4 @@
  */
 void build_targets(makefile *make, options_t *options);
 
-/**
- * @brief Processes an individual target, building it if necessary.
- * 
- * This function checks if a target needs to be built, processes its prerequisites,
- * and executes the associated commands if a build is needed.
- * 
- * @param make The makefile structure containing rules.
- * @param target_name The name of the target to process.
- * @param options The options structure containing command-line options.
- * @return 0 on success, -1 on failure.
- */
-int process_target(makefile *make, const char *target_name, options_t *options);
-
 #endif
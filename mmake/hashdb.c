@@ -0,0 +1,194 @@
+/**
+ * @file hashdb.c
+ *
+ * @brief Implementation of the content hash database.
+ *
+ * This source file loads and saves the database of content hashes, and hashes files
+ * with 64-bit FNV-1a, reusing a stored hash while the file's size and modification
+ * time are unchanged.
+ *
+ * Error handling: A database that cannot be read is treated as empty; one that cannot
+ * be written is reported via `stderr`.
+ *
+ * Memory management: The database is freed using hashdb_del.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hashdb.h"
+
+hashdb_t *hashdb_load(void) {
+    hashdb_t *db = calloc(1, sizeof(hashdb_t));
+    if (!db) {
+        perror("mmake: calloc");
+        exit(EXIT_FAILURE);
+    }
+    db->size = INITIAL_HASHDB_SIZE;
+    db->entries = calloc(db->size, sizeof(hash_entry_t));
+    if (!db->entries) {
+        perror("mmake: calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *fp = fopen(HASH_DB_FILE, "r");
+    if (!fp) {
+        return db;
+    }
+    char *line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, fp) != -1) {
+        uint64_t deps_hash, content_hash;
+        long long size, sec, nsec;
+        int name_start;
+        if (sscanf(line, "%" SCNx64 " %" SCNx64 " %lld %lld %lld %n", &deps_hash, &content_hash, &size, &sec,
+                   &nsec, &name_start) != 5) {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        hash_entry_t *entry = hashdb_entry(db, line + name_start);
+        entry->deps_hash = deps_hash;
+        entry->content_hash = content_hash;
+        entry->size = size;
+        entry->mtime.tv_sec = sec;
+        entry->mtime.tv_nsec = nsec;
+        entry->hashed = sec != 0 || nsec != 0;
+    }
+    free(line);
+    fclose(fp);
+    db->changed = 0;
+    return db;
+}
+
+void hashdb_save(hashdb_t *db) {
+    if (!db->changed) {
+        return;
+    }
+    char tmp_path[] = HASH_DB_FILE ".tmp";
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        perror("mmake: " HASH_DB_FILE);
+        return;
+    }
+    for (size_t i = 0; i < db->size; i++) {
+        hash_entry_t *entry = &db->entries[i];
+        if (!entry->name || (!entry->hashed && !entry->deps_hash)) {
+            continue;
+        }
+        fprintf(fp, "%016" PRIx64 " %016" PRIx64 " %lld %lld %ld %s\n", entry->deps_hash, entry->content_hash,
+                (long long)entry->size, (long long)entry->mtime.tv_sec, entry->mtime.tv_nsec, entry->name);
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, HASH_DB_FILE) != 0) {
+        perror("mmake: " HASH_DB_FILE);
+        unlink(tmp_path);
+        return;
+    }
+    db->changed = 0;
+}
+
+hash_entry_t *hashdb_entry(hashdb_t *db, const char *name) {
+    if (2 * (db->count + 1) > db->size) {
+        hash_entry_t *old = db->entries;
+        size_t old_size = db->size;
+        db->size *= 2;
+        db->entries = calloc(db->size, sizeof(hash_entry_t));
+        if (!db->entries) {
+            perror("mmake: calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < old_size; i++) {
+            if (!old[i].name) {
+                continue;
+            }
+            size_t j = fnv1a(FNV_OFFSET, old[i].name, strlen(old[i].name)) & (db->size - 1);
+            while (db->entries[j].name) {
+                j = (j + 1) & (db->size - 1);
+            }
+            db->entries[j] = old[i];
+        }
+        free(old);
+    }
+
+    size_t i = fnv1a(FNV_OFFSET, name, strlen(name)) & (db->size - 1);
+    while (db->entries[i].name) {
+        if (strcmp(db->entries[i].name, name) == 0) {
+            return &db->entries[i];
+        }
+        i = (i + 1) & (db->size - 1);
+    }
+    db->entries[i].name = strdup(name);
+    if (!db->entries[i].name) {
+        perror("mmake: strdup");
+        exit(EXIT_FAILURE);
+    }
+    db->count++;
+    return &db->entries[i];
+}
+
+int hashdb_file_hash(hashdb_t *db, const char *name, uint64_t *hash) {
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    hash_entry_t *entry = hashdb_entry(db, name);
+    if (entry->hashed && entry->size == st.st_size && entry->mtime.tv_sec == st.st_mtim.tv_sec
+        && entry->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        close(fd);
+        *hash = entry->content_hash;
+        return 0;
+    }
+
+    char *buffer = malloc(HASH_BUFFER_SIZE);
+    if (!buffer) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t h = FNV_OFFSET;
+    ssize_t n;
+    while ((n = read(fd, buffer, HASH_BUFFER_SIZE)) > 0) {
+        h = fnv1a(h, buffer, n);
+    }
+    free(buffer);
+    close(fd);
+    if (n == -1) {
+        return -1;
+    }
+
+    entry->content_hash = h;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    entry->hashed = 1;
+    db->changed = 1;
+    *hash = h;
+    return 0;
+}
+
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+void hashdb_del(hashdb_t *db) {
+    for (size_t i = 0; i < db->size; i++) {
+        free(db->entries[i].name);
+    }
+    free(db->entries);
+    free(db);
+}
@@ -0,0 +1,116 @@
+/**
+ * @file hashdb.h
+ *
+ * @brief On-disk database of content hashes, for rebuild decisions by content.
+ *
+ * With `-H`, a target whose prerequisites are newer than it is only rebuilt if their
+ * contents have changed since the target was last built, so touching a file without
+ * changing it does not cause a rebuild. The database, HASH_DB_FILE in the current
+ * directory, has one line per file:
+ *
+ *   DEPS_HASH CONTENT_HASH SIZE SECONDS NANOSECONDS NAME
+ *
+ * CONTENT_HASH is the 64-bit FNV-1a hash of the file's contents, which is reused as
+ * long as the file has the same size and modification time. DEPS_HASH, for targets
+ * that have been built, combines the content hashes of the target's prerequisites,
+ * in order, at the time of its last successful command; it is 0 for files that have
+ * not been built, or whose last build was without `-H`. Builds without `-H` load an
+ * existing database only to clear DEPS_HASH for the targets they rebuild.
+ *
+ * Error handling: A database that cannot be read is treated as empty; one that cannot
+ * be written is reported via `stderr`, and only costs rebuilds in the next run.
+ *
+ * Memory management: The database must be freed using hashdb_del.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#ifndef HASHDB_H
+#define HASHDB_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define HASH_DB_FILE ".mmake_hashes"
+#define INITIAL_HASHDB_SIZE 256
+#define HASH_BUFFER_SIZE (64 * 1024)
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief What is known about one file.
+ */
+typedef struct {
+    char *name;                /**< Name of the file, or NULL for an empty slot. */
+    uint64_t deps_hash;        /**< Combined prerequisite hashes at the last build, or 0. */
+    uint64_t content_hash;     /**< Hash of the contents. */
+    off_t size;                /**< Size of the file when it was hashed. */
+    struct timespec mtime;     /**< Modification time of the file when it was hashed. */
+    int hashed;                /**< Set when content_hash is the hash at size and mtime. */
+} hash_entry_t;
+
+/**
+ * @brief The database, an open addressing table of entries by name.
+ */
+typedef struct {
+    hash_entry_t *entries;     /**< The entries. */
+    size_t size;               /**< Number of slots, a power of two. */
+    size_t count;              /**< Number of entries. */
+    int changed;               /**< Set when the database has to be written. */
+} hashdb_t;
+
+/**
+ * @brief Loads the database from HASH_DB_FILE, or creates an empty one.
+ *
+ * @return The database.
+ */
+hashdb_t *hashdb_load(void);
+
+/**
+ * @brief Writes the database to HASH_DB_FILE if it has changed.
+ *
+ * The database is written to a temporary file, which is renamed over the old one.
+ *
+ * @param db The database.
+ */
+void hashdb_save(hashdb_t *db);
+
+/**
+ * @brief Finds the entry of a file, creating an empty one if there is none.
+ *
+ * @param db The database.
+ * @param name The name of the file.
+ * @return The entry, valid until the next entry is created.
+ */
+hash_entry_t *hashdb_entry(hashdb_t *db, const char *name);
+
+/**
+ * @brief Returns the content hash of a file, hashing it only if it has changed.
+ *
+ * @param db The database.
+ * @param name The name of the file.
+ * @param hash Set to the hash.
+ * @return 0 on success, -1 if the file cannot be read.
+ */
+int hashdb_file_hash(hashdb_t *db, const char *name, uint64_t *hash);
+
+/**
+ * @brief Updates a 64-bit FNV-1a hash with a block of bytes.
+ *
+ * @param hash The hash so far.
+ * @param data The bytes.
+ * @param size The number of bytes.
+ * @return The new hash.
+ */
+uint64_t fnv1a(uint64_t hash, const void *data, size_t size);
+
+/**
+ * @brief Frees the database.
+ *
+ * @param db The database.
+ */
+void hashdb_del(hashdb_t *db);
+
+#endif
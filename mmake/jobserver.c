@@ -0,0 +1,202 @@
+/**
+ * @file jobserver.c
+ *
+ * @brief Implementation of the GNU make compatible jobserver.
+ *
+ * This source file creates the token pipe and exports it in MAKEFLAGS, joins a jobserver
+ * that an outer make exported, and takes and gives back tokens.
+ *
+ * Error handling: A jobserver in MAKEFLAGS that cannot be used is reported via `stderr`;
+ * other failures exit the program.
+ *
+ * Memory management: The jobserver is freed using jobserver_close.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "jobserver.h"
+
+jobserver_t *jobserver_create(int jobs) {
+    jobserver_t *js = jobserver_new();
+    /* The pipe is inherited by the commands, so it is not close-on-exec. */
+    if (pipe(js->pipe_fds) == -1) {
+        perror("mmake: pipe");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < jobs - 1; i++) {
+        char token = JOBSERVER_TOKEN;
+        if (write(js->pipe_fds[1], &token, 1) != 1) {
+            perror("mmake: write");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", js->pipe_fds[0]);
+    js->read_fd = open_nonblocking(path);
+    js->write_fd = js->pipe_fds[1];
+    if (js->read_fd == -1) {
+        perror("mmake: jobserver");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Keep the other flags, but replace any jobserver of an outer make. */
+    const char *old = getenv("MAKEFLAGS");
+    size_t size = (old ? strlen(old) : 0) + 64;
+    char *flags = malloc(size);
+    if (!flags) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    int n = snprintf(flags, size, "-j%d " JOBSERVER_AUTH "%d,%d", jobs, js->pipe_fds[0], js->pipe_fds[1]);
+    while (old && *old) {
+        size_t word = strcspn(old, " ");
+        if (word > 0 && strncmp(old, "--jobserver", 11) != 0 && strncmp(old, "-j", 2) != 0) {
+            n += snprintf(flags + n, size - n, " %.*s", (int)word, old);
+        }
+        old += word;
+        old += strspn(old, " ");
+    }
+    if (setenv("MAKEFLAGS", flags, 1) == -1) {
+        perror("mmake: setenv");
+        exit(EXIT_FAILURE);
+    }
+    free(flags);
+    return js;
+}
+
+jobserver_t *jobserver_join(void) {
+    const char *makeflags = getenv("MAKEFLAGS");
+    int length;
+    const char *auth = makeflags ? find_jobserver_auth(makeflags, &length) : NULL;
+    if (!auth) {
+        return NULL;
+    }
+
+    char value[256];
+    if (length >= (int)sizeof(value)) {
+        fprintf(stderr, "mmake: warning: jobserver unavailable: using -j1\n");
+        return NULL;
+    }
+    memcpy(value, auth, length);
+    value[length] = '\0';
+
+    jobserver_t *js = jobserver_new();
+    int read_fd, write_fd;
+    if (strncmp(value, "fifo:", 5) == 0) {
+        js->read_fd = open_nonblocking(value + 5);
+        js->write_fd = open(value + 5, O_WRONLY | O_CLOEXEC);
+        js->owns_write_fd = 1;
+    } else if (sscanf(value, "%d,%d", &read_fd, &write_fd) == 2 && fcntl(read_fd, F_GETFD) != -1
+               && fcntl(write_fd, F_GETFD) != -1) {
+        /* The outer make's descriptors are shared, so a new one is opened to read from. */
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", read_fd);
+        js->read_fd = open_nonblocking(path);
+        js->write_fd = write_fd;
+    }
+    if (js->read_fd == -1 || js->write_fd == -1) {
+        fprintf(stderr, "mmake: warning: jobserver unavailable: using -j1\n");
+        jobserver_close(js);
+        return NULL;
+    }
+    return js;
+}
+
+int jobserver_acquire(jobserver_t *js) {
+    char token;
+    ssize_t n;
+    do {
+        n = read(js->read_fd, &token, 1);
+    } while (n == -1 && errno == EINTR);
+    if (n != 1) {
+        return 0;
+    }
+
+    if (js->token_count == js->token_capacity) {
+        js->token_capacity = js->token_capacity ? 2 * js->token_capacity : 16;
+        js->tokens = realloc(js->tokens, js->token_capacity);
+        if (!js->tokens) {
+            perror("mmake: realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    js->tokens[js->token_count++] = token;
+    return 1;
+}
+
+void jobserver_release(jobserver_t *js) {
+    char token = js->tokens[--js->token_count];
+    ssize_t n;
+    do {
+        n = write(js->write_fd, &token, 1);
+    } while (n == -1 && errno == EINTR);
+    if (n != 1) {
+        perror("mmake: jobserver");
+    }
+}
+
+int jobserver_fd(jobserver_t *js) {
+    return js->read_fd;
+}
+
+void jobserver_close(jobserver_t *js) {
+    while (js->token_count > 0) {
+        jobserver_release(js);
+    }
+    if (js->read_fd != -1) {
+        close(js->read_fd);
+    }
+    if (js->pipe_fds[0] != -1) {
+        close(js->pipe_fds[0]);
+        close(js->pipe_fds[1]);
+    } else if (js->owns_write_fd && js->write_fd != -1) {
+        close(js->write_fd);
+    }
+    free(js->tokens);
+    free(js);
+}
+
+const char *find_jobserver_auth(const char *makeflags, int *length) {
+    const char *found = NULL;
+    const char *p = makeflags;
+    while (*p) {
+        p += strspn(p, " ");
+        size_t word = strcspn(p, " ");
+        /* The last option counts, as in GNU make. */
+        if (strncmp(p, JOBSERVER_AUTH, strlen(JOBSERVER_AUTH)) == 0) {
+            found = p + strlen(JOBSERVER_AUTH);
+            *length = word - strlen(JOBSERVER_AUTH);
+        } else if (strncmp(p, JOBSERVER_FDS, strlen(JOBSERVER_FDS)) == 0) {
+            found = p + strlen(JOBSERVER_FDS);
+            *length = word - strlen(JOBSERVER_FDS);
+        }
+        p += word;
+    }
+    return found;
+}
+
+jobserver_t *jobserver_new(void) {
+    jobserver_t *js = calloc(1, sizeof(jobserver_t));
+    if (!js) {
+        perror("mmake: calloc");
+        exit(EXIT_FAILURE);
+    }
+    js->read_fd = -1;
+    js->write_fd = -1;
+    js->pipe_fds[0] = -1;
+    js->pipe_fds[1] = -1;
+    return js;
+}
+
+int open_nonblocking(const char *path) {
+    return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
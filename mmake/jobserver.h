@@ -0,0 +1,119 @@
+/**
+ * @file jobserver.h
+ *
+ * @brief GNU make compatible jobserver, shared with nested builds.
+ *
+ * A jobserver is a pipe that holds one token, a byte, per job that can run in addition
+ * to the one job every make may always run. The mmake that is given `-j N` creates the
+ * pipe with N - 1 tokens, and passes it to its commands in MAKEFLAGS, as
+ * `-jN --jobserver-auth=R,W`. A nested mmake, or GNU make or a compiler that runs
+ * parallel jobs, finds it there and takes a token from the pipe before it starts a job
+ * beyond its first, and writes the token back when the job is done. All of them then
+ * share one budget of N jobs. The named pipe form of GNU make 4.4,
+ * `--jobserver-auth=fifo:PATH`, is accepted as well.
+ *
+ * Tokens are read from a file description of the pipe that is opened anew and made
+ * non-blocking, so that mmake can wait for a token and for its own commands at once.
+ *
+ * Error handling: A jobserver in MAKEFLAGS that cannot be used is reported via `stderr`,
+ * and the build runs one job at a time; other failures exit the program.
+ *
+ * Memory management: The jobserver must be freed using jobserver_close.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#define JOBSERVER_TOKEN '+'
+#define JOBSERVER_AUTH "--jobserver-auth="
+#define JOBSERVER_FDS "--jobserver-fds="
+
+/**
+ * @brief A jobserver that this process created or joined.
+ */
+typedef struct {
+    int read_fd;        /**< Non-blocking descriptor to take tokens from. */
+    int write_fd;       /**< Descriptor to give tokens back to. */
+    int owns_write_fd;  /**< Set when write_fd was opened here, from a fifo. */
+    int pipe_fds[2];    /**< The pipe that this process created, or -1. */
+    char *tokens;       /**< The tokens that are held, to be written back as they were. */
+    int token_count;    /**< Number of tokens that are held. */
+    int token_capacity; /**< Allocated size of tokens. */
+} jobserver_t;
+
+/**
+ * @brief Creates a jobserver for `jobs` jobs and exports it in MAKEFLAGS.
+ *
+ * @param jobs The number of jobs, at least 2.
+ * @return The jobserver.
+ */
+jobserver_t *jobserver_create(int jobs);
+
+/**
+ * @brief Joins the jobserver that is named in MAKEFLAGS, if there is one.
+ *
+ * @return The jobserver, or NULL if MAKEFLAGS names none or it cannot be used.
+ */
+jobserver_t *jobserver_join(void);
+
+/**
+ * @brief Takes a token from the jobserver without blocking.
+ *
+ * @param js The jobserver.
+ * @return 1 if a token was taken, 0 if none is available.
+ */
+int jobserver_acquire(jobserver_t *js);
+
+/**
+ * @brief Gives a held token back to the jobserver.
+ *
+ * @param js The jobserver, which holds at least one token.
+ */
+void jobserver_release(jobserver_t *js);
+
+/**
+ * @brief Returns the descriptor that becomes readable when a token may be available.
+ *
+ * @param js The jobserver.
+ * @return The descriptor.
+ */
+int jobserver_fd(jobserver_t *js);
+
+/**
+ * @brief Gives back every held token and frees the jobserver.
+ *
+ * @param js The jobserver.
+ */
+void jobserver_close(jobserver_t *js);
+
+/**
+ * @brief Allocates a jobserver with no descriptors and no tokens.
+ *
+ * @return The jobserver.
+ */
+jobserver_t *jobserver_new(void);
+
+/**
+ * @brief Opens a pipe for reading as a new, non-blocking file description.
+ *
+ * Making a descriptor inherited from an outer make non-blocking would affect every
+ * process that shares it, so the pipe is opened again through its path.
+ *
+ * @param path The path of the pipe, such as /proc/self/fd/N.
+ * @return The descriptor, or -1 on failure.
+ */
+int open_nonblocking(const char *path);
+
+/**
+ * @brief Finds the value of the jobserver option in a MAKEFLAGS string.
+ *
+ * @param makeflags The value of MAKEFLAGS.
+ * @param length Set to the length of the value.
+ * @return The start of the value, or NULL if there is no jobserver option.
+ */
+const char *find_jobserver_auth(const char *makeflags, int *length);
+
+#endif
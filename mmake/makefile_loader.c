@@ -5,6 +5,9 @@
  * 
  * This source file implements functions for loading the makefile for the mmake program,
  * including handling default makefile names and parsing the makefile content.
+ * The parsed makefile is saved in a binary cache, GRAPH_CACHE_FILE, which later
+ * runs memory-map instead of parsing, as long as the makefile's path, size and
+ * modification time are the same.
  * 
  * Error handling: Errors in file operations or parsing result in error messages and program exit.
  * 
@@ -16,12 +19,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include "options.h"
 #include "makefile_loader.h"
 #include "parser.h"
 
 #define DEFAULT_MAKEFILE "mmakefile"
+#define GRAPH_CACHE_FILE ".mmake_graph"
 
 makefile *load_makefile(options_t *options) {
     const char *makefile_path;
@@ -38,6 +43,18 @@ makefile *load_makefile(options_t *options) {
         exit(EXIT_FAILURE);
     }
 
+    /* An unchanged makefile is loaded from the cache, without parsing it. Only regular
+     * files are cached, since a pipe's size and times do not identify its contents. */
+    struct stat st;
+    int cacheable = fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode);
+    if (cacheable) {
+        makefile *make = makefile_map(GRAPH_CACHE_FILE, makefile_path, &st);
+        if (make) {
+            fclose(fp);
+            return make;
+        }
+    }
+
     makefile *make = parse_makefile(fp);
     if (!make) {
         fprintf(stderr, "mmakefile: Could not parse %s\n", makefile_path);
@@ -46,6 +63,11 @@ makefile *load_makefile(options_t *options) {
     }
     fclose(fp);
 
+    /* The cache only saves time, so a cache that cannot be written is ignored. */
+    if (cacheable) {
+        makefile_save(make, GRAPH_CACHE_FILE, makefile_path, &st);
+    }
+
     return make; 
 }
 
@@ -4,7 +4,8 @@
  * @brief Command-line option parsing implementation for the mmake program.
  * 
  * This source file implements functions for parsing command-line options for the mmake program.
- * It handles options such as specifying a makefile, forcing builds, and setting silent mode.
+ * It handles options such as specifying a makefile, forcing builds, setting silent mode,
+ * the number of commands to run in parallel, content hash mode and build tracing.
  * 
  * Error handling: Errors during parsing are reported via `stderr`, and the program exits on critical failures.
  * 
@@ -23,14 +24,18 @@
 #include "options.h"
 
 void usage(const char *progname) {
-    fprintf(stderr, "Usage: %s [-f MAKEFILE] [-B] [-s] [TARGET ...]\n", progname);
+    fprintf(stderr, "Usage: %s [-f MAKEFILE] [-B] [-s] [-j JOBS] [-H] [--trace=FILE] [TARGET ...]\n", progname);
 }
 
 options_t parse_arguments(int argc, char *argv[]) {
-    options_t options = {0, 0, NULL, 0, NULL};
+    options_t options = {0, 0, NULL, 0, NULL, 0, 0, NULL};
+    static const struct option long_options[] = {
+        {"trace", required_argument, NULL, 'T'},
+        {NULL, 0, NULL, 0}
+    };
     int opt;
 
-    while ((opt = getopt(argc, argv, "f:Bs")) != -1) {
+    while ((opt = getopt_long(argc, argv, "f:Bsj:H", long_options, NULL)) != -1) {
         switch (opt) {
             case 'f':
                 options.makefile_name = strdup(optarg);
@@ -45,6 +50,22 @@ options_t parse_arguments(int argc, char *argv[]) {
             case 's':
                 options.silent = 1;
                 break;
+            case 'T':
+                options.trace_file = optarg;
+                break;
+            case 'H':
+                options.content_hash = 1;
+                break;
+            case 'j': {
+                char *end;
+                long jobs = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || jobs < 1 || jobs > MAX_JOBS) {
+                    fprintf(stderr, "mmake: Invalid number of jobs: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                options.jobs = (int)jobs;
+                break;
+            }
             default:
                 usage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -17,6 +17,8 @@
 #ifndef OPTIONS_H
 #define OPTIONS_H
 
+#define MAX_JOBS 4096
+
 /**
  * @brief Structure to hold command-line options.
  */
@@ -26,6 +28,9 @@ typedef struct {
     char *makefile_name; /**< Name of the makefile to use. */
     int target_count;    /**< Number of targets specified. */
     char **targets;      /**< Array of target names. */
+    int jobs;            /**< Largest number of commands running at the same time, 0 if not given. */
+    int content_hash;    /**< Flag to skip rebuilds when prerequisites have unchanged contents. */
+    char *trace_file;    /**< File to write a build trace to, or NULL. */
 } options_t;
 
 /**
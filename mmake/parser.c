@@ -15,20 +15,74 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "parser.h"
 
 
 /* ------------------------------- Constants ------------------------------- */
 
-#define MAX_RULES 256
-#define MAX_LINE 1024
-#define MAX_PREREQ 32
-#define MAX_CMD 32
+#define INITIAL_WORDS 64
+#define INITIAL_TABLE 64
+#define ARENA_BLOCK (64 * 1024)
+#define READ_CHUNK (64 * 1024)
+
+#define CACHE_MAGIC "MMKGRAPH"
+#define CACHE_VERSION 1
 
 /* ------------------------------ Structures ------------------------------- */
 
+/*
+ * Rules and word arrays are allocated from a list of blocks, which are freed 
+ * together with the makefile.
+ */
+struct arena_block {
+	struct arena_block *next;
+	size_t used;
+	size_t size;
+	max_align_t data[];
+};
+
 struct makefile {
 	struct rule *rules;
+	struct rule **table;	// Open addressing, first rule of each target
+	size_t table_size;
+	char **strings;		// Interned targets and prerequisites
+	size_t strings_size;
+	size_t n_strings;
+	char *map;		// Mapped cache that holds everything, or NULL
+	size_t map_size;
+	char *text;		// The makefile, with every word NUL-terminated
+	size_t text_size;
+	bool text_mapped;
+	struct arena_block *arena;
+	char **words;		// Words of the line being parsed
+	size_t words_size;
+};
+
+/*
+ * The cache starts with this header, followed by the slots and the strings. 
+ * The slots hold the rules, laid out as struct rule, the table and the 
+ * NULL-terminated prerequisite and command arrays, with every pointer stored 
+ * as an offset from the start of the cache, 0 for NULL. When the cache is 
+ * mapped, the base address is added to every slot, which turns them into the 
+ * pointers of a parsed makefile.
+ */
+struct cache_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t ptr_size;
+	uint64_t file_size;	// Key: size and modification time of the makefile
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint64_t total_size;
+	uint64_t n_rules;
+	uint64_t table_size;
+	uint64_t n_slots;
+	uint64_t path_off;	// Key: path of the makefile
 };
 
 struct rule {
@@ -41,43 +95,51 @@ struct rule {
 
 /* ------------------ Declarations of internal functions ------------------ */
 
-static rule *parse_rule(FILE *fp, bool *err);
-static char *extract_target(char **p, char *buf, FILE *fp, bool *err);
-static char *parse_prereqs(char **p, char **prereq, size_t *n_prereq);
-static char *advance_until_cmd(char *buf, FILE *fp);
-static size_t parse_cmd(char **cmd, char **p);
-static rule *create_rule(char *target, char **prereq, char **cmd);
-static char **dupe_str_array(size_t n, char **a);
-static char *next_line(char buf[MAX_LINE], FILE *fp);
-static char *parse_word(char **p, char *delim);
-static void skipwhite(char **p);
-static bool expect(char **p, char c);
-static bool is_blank_line(const char *s);
-static void free_arr(char **arr);
-static void del_rules(struct rule *rules);
-static void err0(bool *err);
-static void err1(char *target, bool *err);
-static void err2(char *prereq[], size_t n_prereq, char *target, bool *err);
-
+static bool load_text(makefile *m, FILE *fp);
+static rule *parse_rule(makefile *m, char **next, bool *err);
+static char *next_line(makefile *m, char **next, char **end, bool *newline);
+static size_t parse_words(makefile *m, char **p, char *end);
+static char *parse_word(char **p, char *end, const char *delim);
+static void skipwhite(char **p, char *end);
+static bool is_blank_line(const char *s, const char *end);
+static char **arena_words(makefile *m, size_t n);
+static void *arena_alloc(makefile *m, size_t size);
+static uint64_t hash_str(const char *s);
+static char *intern(makefile *m, char *s);
+static void index_rules(makefile *m);
+static size_t string_slot(makefile *m, const char *s);
+static size_t put_string(char *blob, size_t *pos, const char *s);
+static size_t count_words(char **words);
+static bool valid_cache(const char *base, size_t size);
+static bool in_area(uintptr_t off, size_t start, size_t end, size_t align);
 
 /* -------------------------- External functions -------------------------- */
 
 makefile *parse_makefile(FILE *fp)
 {
-	makefile *m = malloc(sizeof *m);
-	rule **tailp = &m->rules;
+	makefile *m = calloc(1, sizeof *m);
+	if (!load_text(m, fp)) {
+		makefile_del(m);
+		return NULL;
+	}
 
+	rule **tailp = &m->rules;
+	char *next = m->text;
 	bool err = false;
-	while ((*tailp = parse_rule(fp, &err)) != NULL) {
+	while ((*tailp = parse_rule(m, &next, &err)) != NULL) {
 		tailp = &(*tailp)->next;
 	}
 	*tailp = NULL;
+	free(m->words);
+	m->words = NULL;
 
 	if (m->rules == NULL || err) {
 		makefile_del(m);
 		return NULL;
 	}
 
+	index_rules(m);
+
 	return m;
 }
 
@@ -90,12 +152,11 @@ const char *makefile_default_target(makefile *m)
 
 rule *makefile_rule(makefile *m, const char *target)
 {
-	rule *i = m->rules;
-	while (i != NULL){
-		if (strcmp(i->target, target) == 0) {
-			return i;
+	size_t mask = m->table_size - 1;
+	for (size_t i = hash_str(target) & mask; m->table[i]; i = (i + 1) & mask) {
+		if (strcmp(m->table[i]->target, target) == 0) {
+			return m->table[i];
 		}
-		i = i->next;
 	}
 
 	return NULL;
@@ -114,401 +175,716 @@ char **rule_cmd(rule *rule)
 }
 
 
-void makefile_del(makefile *make)
+makefile *makefile_map(const char *cache_path, const char *path, 
+                       const struct stat *st)
 {
-	del_rules(make->rules);
-	free(make);
-}
-
-
-/* -------------------------- Internal functions -------------------------- */
-
-/**
- * Parse a rule.
- *
- * @param fp    File to read from.
- * @param err   Pointer to flag which gets set to true on error.
- * @return      A parsed rule or NULL.
- */
-static rule *parse_rule(FILE *fp, bool *err)
-{
-	// Buffer variables
-	char buf[MAX_LINE];
-	char *p;
-
-	// Variables to fill
-	char *prereq[MAX_PREREQ];
-	size_t n_prereq;
-	char *cmd[MAX_CMD];
-	
-	char *target = extract_target(&p, buf, fp, err);
-	if (target == NULL) {
+	int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return NULL;
+	}
+	struct stat cache_st;
+	if (fstat(fd, &cache_st) == -1 
+	    || (size_t)cache_st.st_size <= sizeof(struct cache_header)) {
+		close(fd);
 		return NULL;
 	}
+	size_t size = cache_st.st_size;
 
-	p = parse_prereqs(&p, prereq, &n_prereq);
-	if(p == NULL)
-	{
-		err2(prereq, n_prereq, target, err);
+	// Private and writable, so that the slots can be turned into pointers
+	char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
 		return NULL;
 	}
 
-	p = advance_until_cmd(buf, fp);
-	if(p == NULL)
-	{
-		err2(prereq, n_prereq, target, err);
+	struct cache_header *h = (struct cache_header *)base;
+	uintptr_t *slots = (uintptr_t *)(base + sizeof *h);
+	if (memcmp(h->magic, CACHE_MAGIC, sizeof h->magic) != 0 
+	    || h->version != CACHE_VERSION || h->ptr_size != sizeof(void *) 
+	    || h->total_size != size || base[size - 1] != '\0' 
+	    || h->file_size != (uint64_t)st->st_size 
+	    || h->mtime_sec != st->st_mtim.tv_sec 
+	    || h->mtime_nsec != st->st_mtim.tv_nsec 
+	    || !valid_cache(base, size) 
+	    || strcmp(base + h->path_off, path) != 0) {
+		munmap(base, size);
 		return NULL;
 	}
 
-	size_t n_words = parse_cmd(cmd, &p);
+	for (size_t i = 0; i < h->n_slots; i++) {
+		if (slots[i] != 0) {
+			slots[i] += (uintptr_t)base;
+		}
+	}
 
-	rule *r = create_rule(target, dupe_str_array(n_prereq, prereq), 
-	                      dupe_str_array(n_words, cmd));
+	makefile *m = calloc(1, sizeof *m);
+	m->rules = (struct rule *)slots;
+	m->table = (struct rule **)(m->rules + h->n_rules);
+	m->table_size = h->table_size;
+	m->map = base;
+	m->map_size = size;
 
-	return r;
+	return m;
 }
 
 
-/**
- * Extract target from next line in fp, updates p to point to the first 
- * non-blank character after ':' in buf. Also reads in a full line to buf from fp.
- * 
- * @param p   Pointer that keeps info about the current place in line.
- * @param buf Buffer that should be filled with one line from fp.
- * @param fp  File pointer from where the next line should be red.
- * @param err Pointer to bool that keeps track if error occured.
- * @return    Target if line is as expected, NULL if error.
-*/
-static char *extract_target(char **p, char *buf, FILE *fp, bool *err)
+int makefile_save(makefile *m, const char *cache_path, const char *path, 
+                  const struct stat *st)
 {
-	// read line with target and prerequisites
-	if ((*p = next_line(buf, fp)) == NULL) {
-		return NULL;
+	struct cache_header h;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, CACHE_MAGIC, sizeof h.magic);
+	h.version = CACHE_VERSION;
+	h.ptr_size = sizeof(void *);
+	h.file_size = st->st_size;
+	h.mtime_sec = st->st_mtim.tv_sec;
+	h.mtime_nsec = st->st_mtim.tv_nsec;
+	h.table_size = m->table_size;
+
+	// Sizes of the slots and the strings
+	size_t string_bytes = strlen(path) + 1;
+	for (size_t i = 0; i < m->strings_size; i++) {
+		if (m->strings[i] != NULL) {
+			string_bytes += strlen(m->strings[i]) + 1;
+		}
 	}
-	
-	// line cannot begin with whitespace
-	if (isspace(**p))
-	{
-		err0(err);
-		return NULL;
+	size_t n_arrays = 0;
+	for (rule *r = m->rules; r != NULL; r = r->next) {
+		h.n_rules++;
+		n_arrays += count_words(r->prereq) + count_words(r->cmd) + 2;
+		for (size_t i = 0; r->cmd[i] != NULL; i++) {
+			string_bytes += strlen(r->cmd[i]) + 1;
+		}
+	}
+	h.n_slots = h.n_rules * (sizeof(struct rule) / sizeof(uintptr_t)) 
+	    + h.table_size + n_arrays;
+	size_t slots_start = sizeof h;
+	size_t pos = slots_start + h.n_slots * sizeof(uintptr_t);
+	h.total_size = pos + string_bytes;
+
+	char *blob = calloc(1, h.total_size);
+	uintptr_t *slots = (uintptr_t *)(blob + slots_start);
+	uintptr_t *str_off = calloc(m->strings_size, sizeof *str_off);
+	if (blob == NULL || str_off == NULL) {
+		free(blob);
+		free(str_off);
+		return -1;
 	}
 
-	char *target = parse_word(p, ":");
-
-	skipwhite(p);
-
-	if (!expect(p, ':'))
-	{
-		err1(target, err);
-		return NULL;
+	// The interned names, stored once
+	for (size_t i = 0; i < m->strings_size; i++) {
+		if (m->strings[i] != NULL) {
+			str_off[i] = put_string(blob, &pos, m->strings[i]);
+		}
 	}
+	h.path_off = put_string(blob, &pos, path);
+
+	// The rules, as struct rule, followed by the table and the arrays
+	struct rule *rules = (struct rule *)slots;
+	uintptr_t *table = (uintptr_t *)(rules + h.n_rules);
+	uintptr_t *array = table + h.table_size;
+	size_t mask = h.table_size - 1;
+	size_t k = 0;
+	for (rule *r = m->rules; r != NULL; r = r->next, k++) {
+		struct rule *c = &rules[k];
+		c->target = (char *)str_off[string_slot(m, r->target)];
+		c->prereq = (char **)(slots_start + (array - slots) * sizeof *slots);
+		for (size_t i = 0; r->prereq[i] != NULL; i++) {
+			*array++ = str_off[string_slot(m, r->prereq[i])];
+		}
+		*array++ = 0;
+		c->cmd = (char **)(slots_start + (array - slots) * sizeof *slots);
+		for (size_t i = 0; r->cmd[i] != NULL; i++) {
+			*array++ = put_string(blob, &pos, r->cmd[i]);
+		}
+		*array++ = 0;
+		c->next = r->next != NULL ? 
+		    (rule *)(slots_start + (k + 1) * sizeof *c) : NULL;
+
+		// As in index_rules, the first rule of a target is kept
+		size_t i = hash_str(r->target) & mask;
+		while (table[i] != 0 && rules[table[i] - 1].target != c->target) {
+			i = (i + 1) & mask;
+		}
+		if (table[i] == 0) {
+			table[i] = k + 1;
+		}
+	}
+	for (size_t i = 0; i < h.table_size; i++) {
+		if (table[i] != 0) {
+			table[i] = slots_start + (table[i] - 1) * sizeof *rules;
+		}
+	}
+	memcpy(blob, &h, sizeof h);
+	free(str_off);
+
+	size_t tmp_size = strlen(cache_path) + sizeof ".tmp";
+	char *tmp_path = malloc(tmp_size);
+	snprintf(tmp_path, tmp_size, "%s.tmp", cache_path);
+	FILE *fp = fopen(tmp_path, "w");
+	int ret = -1;
+	if (fp != NULL) {
+		size_t written = fwrite(blob, 1, h.total_size, fp);
+		if (fclose(fp) == 0 && written == h.total_size 
+		    && rename(tmp_path, cache_path) == 0) {
+			ret = 0;
+		} else {
+			unlink(tmp_path);
+		}
+	}
+	free(tmp_path);
+	free(blob);
+
+	return ret;
+}
 
-	skipwhite(p);
 
-	return target;
+void makefile_del(makefile *make)
+{
+	if (make->map != NULL) {
+		munmap(make->map, make->map_size);
+		free(make);
+		return;
+	}
+	// The names point into the text and everything else into the arena
+	while (make->arena != NULL) {
+		struct arena_block *next = make->arena->next;
+		free(make->arena);
+		make->arena = next;
+	}
+	if (make->text_mapped) {
+		munmap(make->text, make->text_size + 1);
+	} else {
+		free(make->text);
+	}
+	free(make->words);
+	free(make->strings);
+	free(make->table);
+	free(make);
 }
 
 
+/* -------------------------- Internal functions -------------------------- */
+
 /**
- * Parse prerequisites and andvance p to end of line
- * 
- * @param prereq    Array to fill with prerequisites, should be previously 
- *                  allocated.
- * @param n_prereq  Pointer to number of prerequisites that is filled with 
- *                  number of prerequisites.
- * @param p         Pointer to place in string that is updated to end of line.
- * @return          Pointer to end of line in buffer, NULL if error. 
-*/
-static char *parse_prereqs(char **p, char **prereq, size_t *n_prereq)
+ * Read the whole makefile into m->text, followed by a NUL. A regular file is 
+ * memory-mapped over the start of an anonymous mapping one byte larger, so 
+ * that the byte after the file lies either in the zero-filled tail of the 
+ * file's last page or in the anonymous page that follows. The mapping is 
+ * private, so words can be NUL-terminated where they are.
+ *
+ * @param m     The makefile that owns the text.
+ * @param fp    The file to read, at its start.
+ * @return      True on success, false otherwise.
+ */
+static bool load_text(makefile *m, FILE *fp)
 {
-	*n_prereq = 0; 
-	while (*n_prereq < MAX_PREREQ
-			&& (prereq[*n_prereq] = parse_word(p, "")) != NULL) {
-		(*n_prereq)++;
-		skipwhite(p);
+	int fd = fileno(fp);
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		m->text_size = st.st_size;
+		void *area = mmap(NULL, m->text_size + 1, PROT_READ | PROT_WRITE, 
+		                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED) {
+			return false;
+		}
+		if (mmap(area, m->text_size, PROT_READ | PROT_WRITE, 
+		         MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(area, m->text_size + 1);
+			return false;
+		}
+		m->text = area;
+		m->text_mapped = true;
+		m->text[m->text_size] = '\0';
+		return true;
 	}
 
-	if (!expect(p, '\n'))
-	{
-		return NULL;
+	// Pipes and other files are read into a buffer that grows as needed
+	size_t capacity = READ_CHUNK;
+	m->text = malloc(capacity);
+	size_t n;
+	while ((n = fread(m->text + m->text_size, 1, 
+	                  capacity - m->text_size - 1, fp)) > 0) {
+		m->text_size += n;
+		if (capacity - m->text_size - 1 == 0) {
+			capacity *= 2;
+			m->text = realloc(m->text, capacity);
+		}
 	}
+	m->text[m->text_size] = '\0';
 
-	return *p; 
+	return !ferror(fp);
 }
 
 
 /**
- * Advance until start of a command by reaing next row in fp.
- * 
- * @param buf   Pointer to the buffer to fill, must be allocated before.
- * @param fp    File pointer to the file that should be red .
- * @return      Pointer to place in buf where command starts, NULL if error.
-*/
-static char *advance_until_cmd(char *buf, FILE *fp)
+ * Parse a rule: a line with the target, a ':' and the prerequisites, followed 
+ * by a line with the command, which begins with a tab. The names and words 
+ * are NUL-terminated in the text, and the rule and its arrays are allocated 
+ * in the arena.
+ *
+ * @param m     The makefile that the rule belongs to.
+ * @param next  Pointer to the start of the next line, which is updated.
+ * @param err   Pointer to flag which gets set to true on error.
+ * @return      A parsed rule or NULL.
+ */
+static rule *parse_rule(makefile *m, char **next, bool *err)
 {
-	char *p;
-	if ((p = next_line(buf, fp)) == NULL)
-	{
+	char *end;
+	bool newline;
+
+	// read line with target and prerequisites
+	char *p = next_line(m, next, &end, &newline);
+	if (p == NULL) {
 		return NULL;
 	}
 
-	// command has to begin with tab
-	if (!expect(&p, '\t'))
-	{
+	// line cannot begin with whitespace
+	char *target = isspace(*p) ? NULL : parse_word(&p, end, ":");
+	if (target != NULL) {
+		skipwhite(&p, end);
+	}
+	if (target == NULL || p == end || *p != ':') {
+		*err = true;
 		return NULL;
 	}
+	*p++ = '\0';
 
-	skipwhite(&p);
-
-	return p;
-}
-
-
-/**
- * Parse a command and insert words into **cmd.
- * 
- * @param cmd     Array of words in a command that is previous allocated.
- * @param p       Pointer to current adress in the line to parse.
- * @return        Number of words that is parsed in command, ie the length of the array cmd. 
-*/
-static size_t parse_cmd(char **cmd, char **p)
-{
-	size_t n_words = 0;
-	while (n_words < MAX_CMD && (cmd[n_words] = parse_word(p, "")) != NULL) {
-		n_words++;
-		skipwhite(p);
+	size_t n_prereq = parse_words(m, &p, end);
+	if (!newline) {
+		*err = true;
+		return NULL;
+	}
+	for (size_t i = 0; i < n_prereq; i++) {
+		m->words[i] = intern(m, m->words[i]);
 	}
 
-	return n_words;
-}
+	rule *r = arena_alloc(m, sizeof *r);
+	r->target = intern(m, target);
+	r->prereq = arena_words(m, n_prereq);
 
+	// command has to begin with tab
+	p = next_line(m, next, &end, &newline);
+	if (p == NULL || *p != '\t') {
+		*err = true;
+		return NULL;
+	}
+	p++;
 
-/**
- * Creates a rule given a target, a prereq string and a cmd_str.
- * 
- * @param target	Target in makefile.
- * @param prereq	Pointer to array with prerequisites.
- * @param cmd		Pointer to commands to run.
- * @return 			A rule that is allocated.
- * @note 			Rule must be freed when not needed anymore.
-*/
-static rule *create_rule(char *target, char **prereq, char **cmd)
-{
-	rule *r = malloc(sizeof *r);
-	r->target = target;
-	r->prereq = prereq;
-	r->cmd = cmd;
+	r->cmd = arena_words(m, parse_words(m, &p, end));
 
 	return r;
 }
 
 
 /**
- * Duplicate an array of strings.
- *
- * @param n     Size of array to duplicate.
- * @param a     Array to duplicate.
- * @return      NULL-terminated array which should be freed using free.
+ * Find the next line that is not blank, and NUL-terminate it.
+ * 
+ * @param m         The makefile being parsed.
+ * @param next      Pointer to where to look for the line, which is advanced 
+ *                  past it.
+ * @param end       Set to the end of the line.
+ * @param newline   Set to true if the line ended with a newline.
+ * @return          The start of the line, or NULL at the end of the text.
  */
-static char **dupe_str_array(size_t n, char **a)
+static char *next_line(makefile *m, char **next, char **end, bool *newline)
 {
-	char **ret = malloc((n + 1) * sizeof *ret);
-
-	for (size_t i = 0; i < n; i++) {
-		ret[i] = a[i];
+	char *limit = m->text + m->text_size;
+	while (*next < limit) {
+		char *line = *next;
+		char *nl = memchr(line, '\n', limit - line);
+		*newline = nl != NULL;
+		*end = *newline ? nl : limit;
+		*next = *newline ? nl + 1 : limit;
+		if (!is_blank_line(line, *end)) {
+			**end = '\0';
+			return line;
+		}
 	}
-	ret[n] = NULL;
 
-	return ret;
+	return NULL;
 }
 
 
 /**
- * Fills buf with the next line from fp. Returns buf if a line was read and
- * NULL otherwise.
+ * Parse the whitespace-separated words up to the end of a line into m->words, 
+ * which grows as needed.
  * 
- * @param buf   The buffer with the contents of the next line.
- * @param fp    The file to read.
- * @return      The buffer.
+ * @param m     The makefile being parsed.
+ * @param p     Pointer to the place in the line, which is advanced to its end.
+ * @param end   The end of the line.
+ * @return      The number of words.
  */
-static char *next_line(char buf[MAX_LINE], FILE *fp)
+static size_t parse_words(makefile *m, char **p, char *end)
 {
-	do {
-		if (fgets(buf, MAX_LINE, fp) == NULL) {
-			return NULL;
+	size_t n = 0;
+	char *word;
+
+	skipwhite(p, end);
+	while ((word = parse_word(p, end, "")) != NULL) {
+		if (n == m->words_size) {
+			m->words_size = n ? 2 * n : INITIAL_WORDS;
+			m->words = realloc(m->words, m->words_size * sizeof *m->words);
 		}
-	} while (is_blank_line(buf));
+		m->words[n++] = word;
+		skipwhite(p, end);
+	}
 
-	return buf;
+	return n;
 }
 
 
 /**
  * Parse a word and update p to point to the first character after the word.
- * The word is delimited by whitespace and any character in delim. The
- * returned string should be freed using free.
+ * The word is delimited by whitespace, the end of the line and any character 
+ * in delim. A word that ends with whitespace is NUL-terminated in place, and 
+ * one at the end of the line already is; a word that ends with a character in 
+ * delim has to be terminated by the caller.
  * 
- * @param p     A pointer to the first character after the word.
+ * @param p     Pointer to the start of the word, which is updated.
+ * @param end   The end of the line, which is NUL.
  * @param delim A string of delimeters.
- * @return      A string with the word.
+ * @return      The word, or NULL if there is none.
  */
-static char *parse_word(char **p, char *delim)
+static char *parse_word(char **p, char *end, const char *delim)
 {
-	size_t n = 0;
-	while (!isspace((*p)[n]) && strchr(delim, (*p)[n]) == NULL) {
-		n++;
+	char *q = *p;
+	while (q < end && !isspace(*q) && strchr(delim, *q) == NULL) {
+		q++;
 	}
 
-	if (n == 0) {
+	if (q == *p) {
 		return NULL;
 	}
 
-	char *word = strndup(*p, n);
-	*p += n;
+	char *word = *p;
+	if (q < end && isspace(*q)) {
+		*q++ = '\0';
+	}
+	*p = q;
 
 	return word;
 }
 
 
 /**
- * Advance pointer to the next character which is not a space, stops at
- * newline.
+ * Advance pointer to the next character which is not a space, stops at the 
+ * end of the line.
  * 
  * @param p     The pointer to a character.
+ * @param end   The end of the line.
  */
-static void skipwhite(char **p)
+static void skipwhite(char **p, char *end)
 {
-	while (isspace(**p) && **p != '\n') {
+	while (*p < end && isspace(**p)) {
 		(*p)++;
 	}
 }
 
 
 /**
- * Check that the character pointed to by p is c, and increment p if it is.
+ * Check if line is blank.
  * 
- * @param p    The pointer to a character.
- * @param c    The character to compare with.
- * @return     True if equal, false otherwise.
+ * @param s     The start of the line.
+ * @param end   The end of the line.
+ * @return      True if line is blank, false otherwise.
  */
-static bool expect(char **p, char c)
+static bool is_blank_line(const char *s, const char *end)
 {
-	if (**p != c) {
-		return false;
+	while (s < end) {
+		if (!isspace(*s)) {
+			return false;
+		}
+		s++;
 	}
 
-	(*p)++;
-
 	return true;
 }
 
 
 /**
- * Check if line is blank.
+ * Copy the words of m->words into a NULL-terminated array in the arena.
  * 
- * @param s    The string (line) to check.
- * @return     True if line is blank, false otherwise.
+ * @param m     The makefile being parsed.
+ * @param n     The number of words.
+ * @return      The array.
  */
-static bool is_blank_line(const char *s) 
+static char **arena_words(makefile *m, size_t n)
 {
-	size_t i = 0;
-	while (s[i] != '\0'){
-		if (!isspace(s[i])) {
-			return false;
+	char **words = arena_alloc(m, (n + 1) * sizeof *words);
+	if (n > 0) {
+		memcpy(words, m->words, n * sizeof *words);
+	}
+	words[n] = NULL;
+
+	return words;
+}
+
+
+/**
+ * Allocate memory from the arena of a makefile. A new block is started when 
+ * the current one is full; a request larger than a block gets its own.
+ * 
+ * @param m     The makefile that owns the arena.
+ * @param size  The number of bytes.
+ * @return      The memory, aligned for any type.
+ */
+static void *arena_alloc(makefile *m, size_t size)
+{
+	size_t units = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t);
+	struct arena_block *b = m->arena;
+	if (b == NULL || b->size - b->used < units) {
+		size_t block_units = ARENA_BLOCK / sizeof(max_align_t);
+		if (units > block_units) {
+			block_units = units;
 		}
-		i++;
+		b = malloc(sizeof *b + block_units * sizeof(max_align_t));
+		b->next = m->arena;
+		b->used = 0;
+		b->size = block_units;
+		m->arena = b;
 	}
 
-	return true;
+	void *mem = &b->data[b->used];
+	b->used += units;
+
+	return mem;
 }
 
+
 /**
- * Free an array until NULL found
- * @param arr   Array to free
-*/
-static void free_arr(char **arr)
+ * Hash a string with 64-bit FNV-1a.
+ * 
+ * @param s   The string.
+ * @return    The hash.
+ */
+static uint64_t hash_str(const char *s)
 {
-	size_t i = 0;
-	while (arr[i] != NULL){
-		free(arr[i]);
-		i++;
+	uint64_t h = 14695981039346656037ULL;
+	while (*s != '\0') {
+		h ^= (unsigned char)*s++;
+		h *= 1099511628211ULL;
 	}
+
+	return h;
 }
 
 /**
- * Recursively delete a list of rules.
+ * Intern a string: return the stored copy of an equal string, or store s. 
+ * The table is open addressing and doubles when half full.
  * 
- * @param rules   The rules to delete.
+ * @param m   The makefile that owns the table.
+ * @param s   A string in the text of the makefile.
+ * @return    The interned string.
  */
-static void del_rules(struct rule *rules) 
+static char *intern(makefile *m, char *s)
 {
-	if (rules == NULL) {
-		return;
+	if (2 * (m->n_strings + 1) > m->strings_size) {
+		size_t old_size = m->strings_size;
+		char **old = m->strings;
+
+		m->strings_size = old_size ? 2 * old_size : INITIAL_TABLE;
+		m->strings = calloc(m->strings_size, sizeof *m->strings);
+		size_t mask = m->strings_size - 1;
+		for (size_t i = 0; i < old_size; i++) {
+			if (old[i] == NULL) {
+				continue;
+			}
+			size_t j = hash_str(old[i]) & mask;
+			while (m->strings[j] != NULL) {
+				j = (j + 1) & mask;
+			}
+			m->strings[j] = old[i];
+		}
+		free(old);
 	}
 
-	free(rules->target);
+	size_t mask = m->strings_size - 1;
+	size_t i = hash_str(s) & mask;
+	while (m->strings[i] != NULL) {
+		if (strcmp(m->strings[i], s) == 0) {
+			return m->strings[i];
+		}
+		i = (i + 1) & mask;
+	}
+	m->strings[i] = s;
+	m->n_strings++;
 
-	free_arr(rules->prereq);	
-	free(rules->prereq);
+	return s;
+}
 
-	free_arr(rules->cmd);
-	free(rules->cmd);
+/**
+ * Build the table of rules by target. As with a linear search, the first 
+ * rule of a target is the one that is found.
+ * 
+ * @param m   The makefile.
+ */
+static void index_rules(makefile *m)
+{
+	size_t n_rules = 0;
+	for (rule *r = m->rules; r != NULL; r = r->next) {
+		n_rules++;
+	}
 
-	del_rules(rules->next);
+	m->table_size = INITIAL_TABLE;
+	while (m->table_size < 2 * n_rules) {
+		m->table_size *= 2;
+	}
+	m->table = calloc(m->table_size, sizeof *m->table);
 
-	free(rules);
+	size_t mask = m->table_size - 1;
+	for (rule *r = m->rules; r != NULL; r = r->next) {
+		size_t i = hash_str(r->target) & mask;
+		while (m->table[i] != NULL && m->table[i]->target != r->target) {
+			i = (i + 1) & mask;
+		}
+		if (m->table[i] == NULL) {
+			m->table[i] = r;
+		}
+	}
 }
 
 
-/* ------------------------ Internal error handling ------------------------ */
+/**
+ * Find the slot of an interned string in the table of strings.
+ * 
+ * @param m   The makefile that owns the strings.
+ * @param s   An interned string.
+ * @return    The index of the string in m->strings.
+ */
+static size_t string_slot(makefile *m, const char *s)
+{
+	size_t mask = m->strings_size - 1;
+	size_t i = hash_str(s) & mask;
+	while (m->strings[i] != s) {
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
 
 /**
- * Sets err to true, lowest order of error cleanup
+ * Copy a string into the cache and advance the position past it.
  * 
- * @note There exists 3 levels of error cleanup, err0, err1, and err2. 
- * When err2 is called, it means that err2 is performed, then err1, and lastly err0.
- * If err0 is called, only err0 is executed.
- * @param err Pointer to bool with error
- * @return
-*/
-static void err0(bool *err)
+ * @param blob  The cache being written.
+ * @param pos   Pointer to the position of the next string.
+ * @param s     The string.
+ * @return      The offset of the copy.
+ */
+static size_t put_string(char *blob, size_t *pos, const char *s)
 {
-	*err = true;
+	size_t off = *pos;
+	size_t n = strlen(s) + 1;
+	memcpy(blob + off, s, n);
+	*pos += n;
+
+	return off;
 }
 
 /**
- * Middle order of cleanup, frees target and calls err0()
+ * Count the words of a NULL-terminated array.
  * 
- * @note There exists 3 levels of error cleanup, err0, err1, and err2. 
- * When err2 is called, it means that err2 is performed, then err1, and lastly err0.
- * If err0 is called, only err0 is executed.
- * @param target    Allocated target to free
- * @param err       Pointer to bool that tells if error occured
- * @return
-*/
-static void err1(char *target, bool *err)
+ * @param words The array.
+ * @return      The number of words.
+ */
+static size_t count_words(char **words)
 {
-	free(target);
-	err0(err);
+	size_t n = 0;
+	while (words[n] != NULL) {
+		n++;
+	}
+
+	return n;
 }
 
+
 /**
- * Highest order of cleanup, frees prereqs and calls err1()
+ * Check that the layout of a cache is the one makefile_save writes, so that 
+ * every slot, once turned into a pointer, points at what it should inside 
+ * the mapping.
+ * 
+ * The rules must be chained in order, the table must be a power of two with 
+ * at least one empty slot per rule, every rule and table slot must point at 
+ * a rule, array or string, and every array slot at a string. The last slot 
+ * must be 0, so that every array ends inside the slots.
  * 
- * @note There exists 3 levels of error cleanup, err0, err1, and err2. 
- * When err2 is called, it means that err2 is performed, then err1, and lastly err0.
- * If err0 is called, only err0 is executed.
- * @param prereq    Allocated array of prereqs to free
- * @param n_prereq  Number of elements in prereq to free
- * @param target    Allocated target to free
- * @param err       Pointer to bool that tells if error occured
- * @return
-*/
-static void err2(char *prereq[], size_t n_prereq, char *target, bool *err)
+ * @param base   The mapped cache, at least a header long.
+ * @param size   The size of the cache.
+ * @return       true if the cache can be used, false otherwise.
+ */
+static bool valid_cache(const char *base, size_t size)
 {
-	for (size_t i = 0; i < n_prereq; i++) {
-		free(prereq[i]);
+	const struct cache_header *h = (const struct cache_header *)base;
+	const uintptr_t *slots = (const uintptr_t *)(base + sizeof *h);
+	const size_t rule_slots = sizeof(struct rule) / sizeof *slots;
+
+	// The areas, each within the one before
+	if (h->n_slots > (size - sizeof *h) / sizeof *slots 
+	    || h->n_rules == 0 || h->n_rules > h->n_slots / rule_slots 
+	    || h->table_size > h->n_slots - h->n_rules * rule_slots 
+	    || h->table_size < 2 * h->n_rules 
+	    || (h->table_size & (h->table_size - 1)) != 0 
+	    || h->n_slots == h->n_rules * rule_slots + h->table_size 
+	    || slots[h->n_slots - 1] != 0) {
+		return false;
 	}
-	err1(target, err);
+	size_t rules_start = sizeof *h;
+	size_t table_start = rules_start + h->n_rules * sizeof(struct rule);
+	size_t arrays_start = table_start + h->table_size * sizeof *slots;
+	size_t strings_start = rules_start + h->n_slots * sizeof *slots;
+	if (!in_area(h->path_off, strings_start, size, 1)) {
+		return false;
+	}
+
+	const struct rule *rules = (const struct rule *)slots;
+	for (size_t k = 0; k < h->n_rules; k++) {
+		uintptr_t next = k + 1 < h->n_rules ? 
+		    rules_start + (k + 1) * sizeof(struct rule) : 0;
+		if (!in_area((uintptr_t)rules[k].target, strings_start, size, 1) 
+		    || !in_area((uintptr_t)rules[k].prereq, arrays_start, 
+		                strings_start, sizeof *slots) 
+		    || !in_area((uintptr_t)rules[k].cmd, arrays_start, 
+		                strings_start, sizeof *slots) 
+		    || (uintptr_t)rules[k].next != next) {
+			return false;
+		}
+	}
+
+	// Fewer used table slots than rules, so that every lookup ends
+	const uintptr_t *table = (const uintptr_t *)(rules + h->n_rules);
+	size_t used = 0;
+	for (size_t i = 0; i < h->table_size; i++) {
+		if (table[i] == 0) {
+			continue;
+		}
+		if (!in_area(table[i], rules_start, table_start, 
+		             sizeof(struct rule)) || ++used > h->n_rules) {
+			return false;
+		}
+	}
+
+	const uintptr_t *array = table + h->table_size;
+	for (const uintptr_t *a = array; a < slots + h->n_slots; a++) {
+		if (*a != 0 && !in_area(*a, strings_start, size, 1)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Check that an offset in a cache lies inside an area and is aligned.
+ * 
+ * @param off     The offset from the start of the cache.
+ * @param start   The offset of the area, relative to which off is aligned.
+ * @param end     The offset just past the area.
+ * @param align   The required alignment.
+ * @return        true if the offset lies inside the area, false otherwise.
+ */
+static bool in_area(uintptr_t off, size_t start, size_t end, size_t align)
+{
+	return off >= start && off < end && (off - start) % align == 0;
 }
 
@@ -14,6 +14,7 @@
 #define PARSER_H
 
 #include <stdio.h>
+#include <sys/stat.h>
 
 typedef struct makefile makefile;
 typedef struct rule rule;
@@ -75,6 +76,37 @@ const char **rule_prereq(rule *rule);
 char **rule_cmd(rule *rule);
 
 
+/**
+ * Load a makefile from a binary cache written by makefile_save. The cache is 
+ * memory-mapped, and the rules and names are used where they are in the 
+ * mapping, so nothing is parsed. The cache is only used if it was written for 
+ * the makefile at path with the size and modification time in st; otherwise, 
+ * or if it cannot be read, NULL is returned. The structure is freed using 
+ * makefile_del.
+ *
+ * @param cache_path    The path of the cache.
+ * @param path          The path of the makefile.
+ * @param st            The status of the makefile.
+ * @return              A pointer to a structure of the type makefile, or NULL.
+ */
+makefile *makefile_map(const char *cache_path, const char *path, 
+                       const struct stat *st);
+
+
+/**
+ * Write the binary cache of a parsed makefile, for makefile_map. The cache is 
+ * written to a temporary file, which is renamed over the old one.
+ *
+ * @param make          A pointer to a structure of the type makefile.
+ * @param cache_path    The path of the cache.
+ * @param path          The path of the makefile.
+ * @param st            The status of the makefile.
+ * @return              0 on success, -1 if the cache could not be written.
+ */
+int makefile_save(makefile *make, const char *cache_path, const char *path, 
+                  const struct stat *st);
+
+
 /**
  * Free the memory of a structure of the type makefile. This will also 
  * deallocate the memory for rules returned by makefile_rule.
@@ -0,0 +1,650 @@
+/**
+ * @file scheduler.c
+ *
+ * @brief Implementation of the dependency graph and the parallel scheduler.
+ *
+ * This source file builds a node for every target that is reachable from the requested
+ * targets with an iterative depth-first walk, counts for each node how many of its
+ * prerequisites are not done, and runs
+ * the commands of ready nodes, at most `jobs` at a time, reaping them as they finish.
+ *
+ * Error handling: Errors result in error messages; running commands are waited for
+ * before the program exits.
+ *
+ * Memory management: The graph is freed using graph_del.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "scheduler.h"
+#include "utils.h"
+#include "command.h"
+
+graph_t *graph_create(makefile *make, char **targets, int target_count) {
+    graph_t *graph = calloc(1, sizeof(graph_t));
+    if (!graph) {
+        perror("mmake: calloc");
+        exit(EXIT_FAILURE);
+    }
+    graph->make = make;
+    graph->capacity = INITIAL_NODE_CAPACITY;
+    graph->nodes = malloc(graph->capacity * sizeof(node_t));
+    graph->index_size = INITIAL_INDEX_SIZE;
+    graph->index = malloc(graph->index_size * sizeof(int));
+    if (!graph->nodes || !graph->index) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(graph->index, -1, graph->index_size * sizeof(int));
+
+    for (int i = 0; i < target_count; i++) {
+        graph_add_target(graph, targets[i]);
+    }
+
+    graph->ready = malloc(graph->count * sizeof(int));
+    if (!graph->ready) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < graph->count; i++) {
+        if (graph->nodes[i].waiting == 0) {
+            ready_push(graph, i);
+        }
+    }
+    return graph;
+}
+
+int graph_add_target(graph_t *graph, const char *name) {
+    int root = graph_find(graph, name);
+    if (root != -1) {
+        return root;
+    }
+
+    int capacity = INITIAL_STACK_CAPACITY;
+    frame_t *stack = malloc(capacity * sizeof(frame_t));
+    if (!stack) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    root = graph_new_node(graph, name);
+    stack[0].node = root;
+    stack[0].next = 0;
+    int depth = 1;
+
+    while (depth > 0) {
+        frame_t *frame = &stack[depth - 1];
+        node_t *node = &graph->nodes[frame->node];
+        const char **prereqs = node->rule ? rule_prereq(node->rule) : NULL;
+        if (!prereqs || !prereqs[frame->next]) {
+            node->order = graph->next_order++;
+            node->state = NODE_WAITING;
+            depth--;
+            continue;
+        }
+
+        const char *prereq_name = prereqs[frame->next++];
+        int prereq = graph_find(graph, prereq_name);
+        if (prereq != -1) {
+            if (graph->nodes[prereq].state == NODE_IN_PROGRESS) {
+                report_cycle(graph, stack, depth, prereq);
+            }
+            graph_add_edge(graph, frame->node, prereq);
+            continue;
+        }
+
+        prereq = graph_new_node(graph, prereq_name);
+        graph_add_edge(graph, frame->node, prereq);
+        if (depth == capacity) {
+            capacity *= 2;
+            frame_t *grown = realloc(stack, capacity * sizeof(frame_t));
+            if (!grown) {
+                perror("mmake: realloc");
+                exit(EXIT_FAILURE);
+            }
+            stack = grown;
+        }
+        stack[depth].node = prereq;
+        stack[depth].next = 0;
+        depth++;
+    }
+
+    free(stack);
+    return root;
+}
+
+int graph_new_node(graph_t *graph, const char *name) {
+    if (graph->count == graph->capacity) {
+        graph->capacity *= 2;
+        node_t *nodes = realloc(graph->nodes, graph->capacity * sizeof(node_t));
+        if (!nodes) {
+            perror("mmake: realloc");
+            exit(EXIT_FAILURE);
+        }
+        graph->nodes = nodes;
+    }
+    int index = graph->count++;
+    node_t *node = &graph->nodes[index];
+    memset(node, 0, sizeof(node_t));
+    node->name = name;
+    node->rule = makefile_rule(graph->make, name);
+    node->state = NODE_IN_PROGRESS;
+    node->order = -1;
+    if (node->rule) {
+        int count = 0;
+        for (const char **p = rule_prereq(node->rule); *p; p++) {
+            count++;
+        }
+        node->prereqs = malloc((count ? count : 1) * sizeof(int));
+        if (!node->prereqs) {
+            perror("mmake: malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    graph_index_node(graph, index);
+    return index;
+}
+
+void graph_add_edge(graph_t *graph, int index, int prereq) {
+    node_t *dep = &graph->nodes[prereq];
+    if (dep->dependent_count == dep->dependent_capacity) {
+        dep->dependent_capacity = dep->dependent_capacity ? dep->dependent_capacity * 2 : 4;
+        int *dependents = realloc(dep->dependents, dep->dependent_capacity * sizeof(int));
+        if (!dependents) {
+            perror("mmake: realloc");
+            exit(EXIT_FAILURE);
+        }
+        dep->dependents = dependents;
+    }
+    dep->dependents[dep->dependent_count++] = index;
+
+    node_t *node = &graph->nodes[index];
+    node->prereqs[node->prereq_count++] = prereq;
+    node->waiting++;
+}
+
+void report_cycle(graph_t *graph, frame_t *stack, int depth, int prereq) {
+    int start = 0;
+    while (stack[start].node != prereq) {
+        start++;
+    }
+    fprintf(stderr, "mmake: Circular dependency: ");
+    for (int i = start; i < depth; i++) {
+        fprintf(stderr, "%s -> ", graph->nodes[stack[i].node].name);
+    }
+    fprintf(stderr, "%s\n", graph->nodes[prereq].name);
+    exit(EXIT_FAILURE);
+}
+
+int graph_find(graph_t *graph, const char *name) {
+    int mask = graph->index_size - 1;
+    for (int i = hash_name(name) & mask; graph->index[i] != -1; i = (i + 1) & mask) {
+        const char *other = graph->nodes[graph->index[i]].name;
+        if (other == name || strcmp(other, name) == 0) {
+            return graph->index[i];
+        }
+    }
+    return -1;
+}
+
+void graph_index_node(graph_t *graph, int index) {
+    if (2 * graph->count > graph->index_size) {
+        free(graph->index);
+        graph->index_size *= 2;
+        graph->index = malloc(graph->index_size * sizeof(int));
+        if (!graph->index) {
+            perror("mmake: malloc");
+            exit(EXIT_FAILURE);
+        }
+        memset(graph->index, -1, graph->index_size * sizeof(int));
+        /* The new node is entered with the others. */
+        for (int i = 0; i < graph->count; i++) {
+            int mask = graph->index_size - 1;
+            int j = hash_name(graph->nodes[i].name) & mask;
+            while (graph->index[j] != -1) {
+                j = (j + 1) & mask;
+            }
+            graph->index[j] = i;
+        }
+        return;
+    }
+
+    int mask = graph->index_size - 1;
+    int j = hash_name(graph->nodes[index].name) & mask;
+    while (graph->index[j] != -1) {
+        j = (j + 1) & mask;
+    }
+    graph->index[j] = index;
+}
+
+unsigned long long hash_name(const char *name) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int graph_build(graph_t *graph, options_t *options) {
+    graph->running = malloc(options->jobs * sizeof(int));
+    graph->pollfds = malloc((options->jobs + 1) * sizeof(struct pollfd));
+    if (!graph->running || !graph->pollfds) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    while (graph->ready_count > 0 || graph->running_count > 0) {
+        int need_token = 0;
+        while (!graph->failed && graph->ready_count > 0 && graph->running_count < options->jobs) {
+            /* Every job but the first needs a token of the jobserver. */
+            if (graph->jobserver && graph->running_count > graph->jobserver->token_count
+                && !jobserver_acquire(graph->jobserver)) {
+                need_token = 1;
+                break;
+            }
+            int index = ready_pop(graph);
+            int ret = start_node(graph, index, options);
+            if (ret == 0) {
+                finish_node(graph, index);
+            } else if (ret == -1) {
+                graph->failed = 1;
+            }
+        }
+        if (graph->running_count == 0) {
+            if (graph->failed) {
+                break;
+            }
+            continue;
+        }
+        int ret = need_token ? wait_for_token(graph) : reap_node(graph);
+        if (ret != 0) {
+            graph->failed = 1;
+        }
+        release_tokens(graph, graph->running_count - 1);
+    }
+
+    release_tokens(graph, 0);
+    if (graph->hashes) {
+        hashdb_save(graph->hashes);
+    }
+    if (graph->trace) {
+        trace_write(graph->trace, graph);
+        print_critical_path(graph);
+    }
+    if (graph->failed) {
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+int start_node(graph_t *graph, int index, options_t *options) {
+    node_t *node = &graph->nodes[index];
+    double check_start = graph->trace ? trace_now(graph->trace) : 0;
+    int build = check_node(graph, index, options);
+    if (graph->trace) {
+        node->check_start = check_start;
+        node->check_end = trace_now(graph->trace);
+    }
+    if (build == -1) {
+        return -1;
+    }
+    if (build == 0) {
+        node->state = NODE_UP_TO_DATE;
+        return 0;
+    }
+
+    char **cmd = rule_cmd(node->rule);
+    if (!cmd || !cmd[0]) {
+        wait_for_running(graph);
+        handle_no_command(node->name);
+    }
+    int stage_count;
+    char ***stages = split_pipeline(cmd, &stage_count);
+    if (!stages) {
+        fprintf(stderr, "mmake: Empty pipeline stage in command for target '%s'\n", node->name);
+        return -1;
+    }
+    if (!options->silent) {
+        print_command(cmd);
+    }
+    node->pids = malloc(stage_count * sizeof(pid_t));
+    node->pidfds = malloc(stage_count * sizeof(int));
+    if (!node->pids || !node->pidfds) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    if (graph->trace) {
+        node->start = trace_now(graph->trace);
+    }
+
+    /* Flush the printed command, so that it comes before the command's output. */
+    fflush(stdout);
+    node->stage_failed = start_pipeline(stages, stage_count, node->pids) != 0;
+    node->exit_status = node->stage_failed ? 127 : 0;
+    free(stages);
+    node->stage_count = stage_count;
+    node->stages_left = 0;
+    for (int i = 0; i < stage_count; i++) {
+        node->pidfds[i] = -1;
+        if (node->pids[i] == -1) {
+            node->pids[i] = 0;
+            continue;
+        }
+        node->pidfds[i] = open_pidfd(node->pids[i]);
+        node->stages_left++;
+    }
+    if (node->stages_left == 0) {
+        return -1;
+    }
+    node->pid = node->pids[0] ? node->pids[0] : node->pids[stage_count - 1];
+    node->state = NODE_RUNNING;
+    graph->running[graph->running_count++] = index;
+    return 1;
+}
+
+int check_node(graph_t *graph, int index, options_t *options) {
+    node_t *node = &graph->nodes[index];
+    if (!node->rule) {
+        if (time_is_set(node_mtime(graph, index))) {
+            return 0;
+        }
+        wait_for_running(graph);
+        handle_missing_rule(node->name);
+    }
+    return node_needs_build(graph, index, options);
+}
+
+struct timespec node_mtime(graph_t *graph, int index) {
+    node_t *node = &graph->nodes[index];
+    if (!node->mtime_valid) {
+        node->mtime = get_mod_time(node->name);
+        node->mtime_valid = 1;
+    }
+    return node->mtime;
+}
+
+int node_needs_build(graph_t *graph, int index, options_t *options) {
+    if (options->force_build) {
+        return 1;
+    }
+
+    struct timespec target_time = node_mtime(graph, index);
+    if (!time_is_set(target_time)) {
+        return 1;
+    }
+
+    node_t *node = &graph->nodes[index];
+    int newer = 0;
+    for (int i = 0; i < node->prereq_count; i++) {
+        struct timespec prereq_time = node_mtime(graph, node->prereqs[i]);
+        if (!time_is_set(prereq_time)) {
+            fprintf(stderr, "mmake: Prerequisite '%s' for target '%s' does not exist\n",
+                    graph->nodes[node->prereqs[i]].name, node->name);
+            return -1;
+        }
+        if (compare_times(prereq_time, target_time) > 0) {
+            newer = 1;
+        }
+    }
+    if (!newer || !graph->content_hash) {
+        return newer;
+    }
+
+    /* A prerequisite was touched; rebuild only if the contents differ from the last build. */
+    uint64_t hash;
+    if (node_deps_hash(graph, index, &hash) != 0) {
+        return 1;
+    }
+    return hashdb_entry(graph->hashes, node->name)->deps_hash != hash;
+}
+
+int node_deps_hash(graph_t *graph, int index, uint64_t *hash) {
+    node_t *node = &graph->nodes[index];
+    uint64_t h = FNV_OFFSET;
+    for (int i = 0; i < node->prereq_count; i++) {
+        uint64_t file_hash;
+        if (hashdb_file_hash(graph->hashes, graph->nodes[node->prereqs[i]].name, &file_hash) != 0) {
+            return -1;
+        }
+        h = fnv1a(h, &file_hash, sizeof(file_hash));
+    }
+    /* 0 means that the target has not been built. */
+    *hash = h ? h : 1;
+    return 0;
+}
+
+void record_deps_hash(graph_t *graph, int index) {
+    uint64_t hash = 0;
+    if (graph->content_hash && node_deps_hash(graph, index, &hash) != 0) {
+        hash = 0;
+    }
+    hash_entry_t *entry = hashdb_entry(graph->hashes, graph->nodes[index].name);
+    if (entry->deps_hash != hash) {
+        entry->deps_hash = hash;
+        graph->hashes->changed = 1;
+    }
+}
+
+void finish_node(graph_t *graph, int index) {
+    node_t *node = &graph->nodes[index];
+    graph->done_count++;
+    for (int i = 0; i < node->dependent_count; i++) {
+        node_t *dependent = &graph->nodes[node->dependents[i]];
+        if (--dependent->waiting == 0) {
+            ready_push(graph, node->dependents[i]);
+        }
+    }
+}
+
+int reap_node(graph_t *graph) {
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    do {
+        pid = wait4(-1, &status, 0, &usage);
+    } while (pid == -1 && errno == EINTR);
+    if (pid == -1) {
+        perror("mmake: wait4");
+        return -1;
+    }
+
+    for (int i = 0; i < graph->running_count; i++) {
+        int index = graph->running[i];
+        node_t *node = &graph->nodes[index];
+        int stage = find_stage(node, pid);
+        if (stage == -1) {
+            continue;
+        }
+        node->pids[stage] = 0;
+        if (node->pidfds[stage] != -1) {
+            close(node->pidfds[stage]);
+            node->pidfds[stage] = -1;
+        }
+        add_usage(&node->usage, &usage);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            if (!node->stage_failed) {
+                node->exit_status = stage_status(status);
+            }
+            node->stage_failed = 1;
+        }
+        if (--node->stages_left > 0) {
+            return 0;
+        }
+
+        graph->running[i] = graph->running[--graph->running_count];
+        if (graph->trace) {
+            node->end = trace_now(graph->trace);
+        }
+        if (node->stage_failed) {
+            return -1;
+        }
+        /* The command has changed the target, so its cached time is stale. */
+        node->state = NODE_BUILT;
+        node->mtime_valid = 0;
+        if (graph->hashes) {
+            record_deps_hash(graph, index);
+        }
+        finish_node(graph, index);
+        return 0;
+    }
+    return 0;
+}
+
+int find_stage(node_t *node, pid_t pid) {
+    for (int i = 0; i < node->stage_count; i++) {
+        if (node->pids[i] == pid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void add_usage(struct rusage *total, const struct rusage *usage) {
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+void wait_for_running(graph_t *graph) {
+    graph->failed = 1;
+    while (graph->running_count > 0) {
+        reap_node(graph);
+    }
+    release_tokens(graph, 0);
+}
+
+int wait_for_token(graph_t *graph) {
+    struct pollfd *fds = graph->pollfds;
+    fds[0].fd = jobserver_fd(graph->jobserver);
+    fds[0].events = POLLIN;
+    for (int i = 0; i < graph->running_count; i++) {
+        /* A node is done when its first running stage is, and every stage before it. */
+        node_t *node = &graph->nodes[graph->running[i]];
+        int stage = 0;
+        while (node->pids[stage] == 0) {
+            stage++;
+        }
+        fds[i + 1].fd = node->pidfds[stage];
+        fds[i + 1].events = POLLIN;
+        if (fds[i + 1].fd == -1) {
+            /* Without pidfds, a token is only waited for by waiting for a command. */
+            return reap_node(graph);
+        }
+    }
+
+    if (poll(fds, graph->running_count + 1, -1) == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("mmake: poll");
+        return -1;
+    }
+    for (int i = 1; i <= graph->running_count; i++) {
+        if (fds[i].revents) {
+            return reap_node(graph);
+        }
+    }
+    return 0;
+}
+
+void release_tokens(graph_t *graph, int keep) {
+    if (!graph->jobserver) {
+        return;
+    }
+    if (keep < 0) {
+        keep = 0;
+    }
+    while (graph->jobserver->token_count > keep) {
+        jobserver_release(graph->jobserver);
+    }
+}
+
+int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+void ready_push(graph_t *graph, int index) {
+    int i = graph->ready_count++;
+    int order = graph->nodes[index].order;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (graph->nodes[graph->ready[parent]].order <= order) {
+            break;
+        }
+        graph->ready[i] = graph->ready[parent];
+        i = parent;
+    }
+    graph->ready[i] = index;
+}
+
+int ready_pop(graph_t *graph) {
+    int top = graph->ready[0];
+    int last = graph->ready[--graph->ready_count];
+    int order = graph->nodes[last].order;
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= graph->ready_count) {
+            break;
+        }
+        if (child + 1 < graph->ready_count
+            && graph->nodes[graph->ready[child + 1]].order < graph->nodes[graph->ready[child]].order) {
+            child++;
+        }
+        if (graph->nodes[graph->ready[child]].order >= order) {
+            break;
+        }
+        graph->ready[i] = graph->ready[child];
+        i = child;
+    }
+    if (graph->ready_count > 0) {
+        graph->ready[i] = last;
+    }
+    return top;
+}
+
+void graph_del(graph_t *graph) {
+    for (int i = 0; i < graph->count; i++) {
+        free(graph->nodes[i].dependents);
+        free(graph->nodes[i].prereqs);
+        free(graph->nodes[i].pids);
+        free(graph->nodes[i].pidfds);
+    }
+    free(graph->nodes);
+    free(graph->index);
+    free(graph->ready);
+    free(graph->running);
+    free(graph->pollfds);
+    if (graph->hashes) {
+        hashdb_del(graph->hashes);
+    }
+    if (graph->trace) {
+        trace_del(graph->trace);
+    }
+    if (graph->jobserver) {
+        jobserver_close(graph->jobserver);
+    }
+    free(graph);
+}
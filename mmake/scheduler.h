@@ -0,0 +1,372 @@
+/**
+ * @file scheduler.h
+ *
+ * @brief Dependency graph and parallel scheduler for building targets.
+ *
+ * This header file declares the graph that is built from the rules of the makefile,
+ * with one node per target that is reachable from the requested targets, and the
+ * scheduler that builds it. A node is ready when all its prerequisites are done.
+ * Ready nodes are kept in a queue ordered by their position in a depth-first
+ * post-order of the graph, and up to `jobs` commands run at the same time. Children
+ * are reaped with waitpid(-1) in the order they finish. With one job, the nodes are
+ * therefore built in exactly the order of a recursive, depth-first build.
+ *
+ * Every target is visited once, however many targets share it as a prerequisite, and
+ * the graph is walked with an explicit stack, so deep chains do not exhaust the call
+ * stack; a prerequisite that is reached again while it is being visited closes a cycle,
+ * which is reported with the path around it. The modification time of a node is read
+ * with stat once, with nanoseconds, and cached until the node's own command has run.
+ *
+ * With `-H`, a target whose prerequisites are newer than it is looked up in the content
+ * hash database: if the prerequisites have the same contents as when the target was
+ * last built, it is up to date.
+ *
+ * With a jobserver, every command beyond the first also needs a token. When none is
+ * available, mmake waits, via poll on the jobserver and on pidfds of its running
+ * commands, for whichever comes first: a token or one of its commands finishing.
+ * Tokens are given back as soon as fewer commands run.
+ *
+ * A command whose words include `|` is a pipeline, whose stages are started through
+ * mexec's pipeline library, connected by pipes and without a shell. The node is done
+ * when all its stages are, and has failed if any of them has.
+ *
+ * When a command fails, or a target cannot be made, no new commands are started;
+ * the commands that are already running are waited for, and the program exits.
+ *
+ * Error handling: Functions report errors via `stderr` and exit on critical failures.
+ *
+ * Memory management: The graph must be freed using graph_del.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include "parser.h"
+#include "options.h"
+#include "hashdb.h"
+#include "trace.h"
+#include "jobserver.h"
+
+#define INITIAL_NODE_CAPACITY 64
+#define INITIAL_INDEX_SIZE 128
+
+#define INITIAL_STACK_CAPACITY 64
+
+/**
+ * @brief The state of a target during a run.
+ */
+typedef enum {
+    NODE_UNVISITED,      /**< Not reached yet. */
+    NODE_IN_PROGRESS,    /**< On the stack; its prerequisites are being visited. */
+    NODE_WAITING,        /**< Visited; waiting for its prerequisites or for a free job. */
+    NODE_RUNNING,        /**< Its command is running. */
+    NODE_BUILT,          /**< Its command has run. */
+    NODE_UP_TO_DATE      /**< It did not need to be built. */
+} node_state_t;
+
+/**
+ * @brief A target in the dependency graph.
+ */
+typedef struct {
+    const char *name;    /**< Name of the target. */
+    rule *rule;          /**< Rule for the target, or NULL if it has none. */
+    node_state_t state;  /**< The target's state. */
+    int *prereqs;        /**< Nodes of the prerequisites, in the order of the rule. */
+    int prereq_count;    /**< Number of prerequisites. */
+    struct timespec mtime; /**< Cached modification time, zero if the file does not exist. */
+    int mtime_valid;     /**< Set when mtime has been read and is still current. */
+    int *dependents;     /**< Nodes that have this node as a prerequisite. */
+    int dependent_count; /**< Number of dependents. */
+    int dependent_capacity; /**< Allocated size of dependents. */
+    int waiting;         /**< Number of prerequisites that are not done yet. */
+    int order;           /**< Position in the depth-first post-order, or -1 while being visited. */
+    pid_t pid;           /**< PID of the command's first stage, or 0 if it has not been started. */
+    pid_t *pids;         /**< PIDs of the stages of the command, 0 once reaped. */
+    int *pidfds;         /**< Descriptors of the running stages, or -1. */
+    int stage_count;     /**< Number of stages of the command. */
+    int stages_left;     /**< Number of stages that have not been reaped. */
+    int stage_failed;    /**< Set when a stage could not be executed or has failed. */
+    int exit_status;     /**< Status of the first stage that failed, as from stage_status, or 0. */
+    struct rusage usage; /**< Resource usage of the command, summed over its stages. */
+    double check_start;  /**< With a trace, when the timestamps began to be checked. */
+    double check_end;    /**< With a trace, when the check was done, or 0 if it was not made. */
+    double start;        /**< With a trace, when the command was started. */
+    double end;          /**< With a trace, when the command was reaped, or 0 if it did not run. */
+} node_t;
+
+/**
+ * @brief A node on the stack of the depth-first walk, and its next prerequisite.
+ */
+typedef struct {
+    int node;            /**< The node. */
+    int next;            /**< Index of the next prerequisite to visit. */
+} frame_t;
+
+/**
+ * @brief The dependency graph and the state of the scheduler.
+ */
+typedef struct graph {
+    makefile *make;      /**< The makefile that the graph was built from. */
+    node_t *nodes;       /**< The nodes. */
+    int count;           /**< Number of nodes. */
+    int capacity;        /**< Allocated size of nodes. */
+    int *index;          /**< Open addressing table of node indices by name, -1 when empty. */
+    int index_size;      /**< Size of index, a power of two at least twice count. */
+    int next_order;      /**< Post-order position of the next finished visit. */
+    int *ready;          /**< Binary heap of ready nodes, ordered by post-order. */
+    int ready_count;     /**< Number of ready nodes. */
+    int *running;        /**< Nodes whose commands are running. */
+    int running_count;   /**< Number of running commands. */
+    int done_count;      /**< Number of nodes that are done. */
+    int failed;          /**< Set when a command has failed. */
+    hashdb_t *hashes;    /**< Content hash database with `-H` or when one exists, or NULL. */
+    int content_hash;    /**< Set with `-H`, when hashes decides rebuilds. */
+    trace_t *trace;      /**< Trace with `--trace`, or NULL. */
+    jobserver_t *jobserver; /**< Jobserver that limits the jobs, or NULL. */
+    struct pollfd *pollfds; /**< Descriptors to wait on for a token or a command. */
+} graph_t;
+
+/**
+ * @brief Builds the dependency graph of the given targets.
+ *
+ * @param make The makefile structure containing rules.
+ * @param targets The names of the targets to build.
+ * @param target_count The number of targets.
+ * @return The graph, with the nodes without prerequisites in the ready queue.
+ */
+graph_t *graph_create(makefile *make, char **targets, int target_count);
+
+/**
+ * @brief Adds a target and, depth first, its prerequisites to the graph.
+ *
+ * Targets that already are in the graph are not visited again. A cycle is reported,
+ * and makes the program exit.
+ *
+ * @param graph The graph.
+ * @param name The name of the target.
+ * @return The index of the target's node.
+ */
+int graph_add_target(graph_t *graph, const char *name);
+
+/**
+ * @brief Creates the node of a target that is reached for the first time.
+ *
+ * @param graph The graph.
+ * @param name The name of the target.
+ * @return The index of the new node, which is in progress.
+ */
+int graph_new_node(graph_t *graph, const char *name);
+
+/**
+ * @brief Records that a node has another node as a prerequisite.
+ *
+ * @param graph The graph.
+ * @param index The index of the dependent node.
+ * @param prereq The index of the prerequisite.
+ */
+void graph_add_edge(graph_t *graph, int index, int prereq);
+
+/**
+ * @brief Reports a cycle found by the depth-first walk, and exits the program.
+ *
+ * @param graph The graph.
+ * @param stack The stack of the walk.
+ * @param depth The number of frames on the stack.
+ * @param prereq The prerequisite that is already on the stack.
+ */
+void report_cycle(graph_t *graph, frame_t *stack, int depth, int prereq);
+
+/**
+ * @brief Returns the modification time of a node, calling stat only if it is not cached.
+ *
+ * @param graph The graph.
+ * @param index The index of the node.
+ * @return The modification time, or a zero time if the file does not exist.
+ */
+struct timespec node_mtime(graph_t *graph, int index);
+
+/**
+ * @brief Checks if a ready node is up to date, and exits if it cannot be made.
+ *
+ * @param graph The graph.
+ * @param index The index of the node.
+ * @param options The options structure containing command-line options.
+ * @return 1 if the target needs to be built, 0 otherwise, or -1 if a prerequisite does not exist.
+ */
+int check_node(graph_t *graph, int index, options_t *options);
+
+/**
+ * @brief Determines if a node needs to be built, using the cached modification times.
+ *
+ * @param graph The graph.
+ * @param index The index of the node, which has a rule.
+ * @param options The options structure containing command-line options.
+ * @return 1 if the target needs to be built, 0 otherwise, or -1 if a prerequisite does not exist.
+ */
+int node_needs_build(graph_t *graph, int index, options_t *options);
+
+/**
+ * @brief Combines the content hashes of a node's prerequisites, in order.
+ *
+ * @param graph The graph, which has a content hash database.
+ * @param index The index of the node.
+ * @param hash Set to the combined hash, which is never 0.
+ * @return 0 on success, -1 if a prerequisite cannot be read.
+ */
+int node_deps_hash(graph_t *graph, int index, uint64_t *hash);
+
+/**
+ * @brief Records the contents of a node's prerequisites after its command has succeeded.
+ *
+ * Without `-H`, the recorded hash is cleared instead, so that a later build with `-H` does not
+ * trust a hash from before this build.
+ *
+ * @param graph The graph, which has a content hash database.
+ * @param index The index of the node.
+ */
+void record_deps_hash(graph_t *graph, int index);
+
+/**
+ * @brief Finds the node of a target.
+ *
+ * The parser interns the names of targets and prerequisites, so names are first
+ * compared by pointer.
+ *
+ * @param graph The graph.
+ * @param name The name of the target.
+ * @return The index of the node, or -1 if the target has no node.
+ */
+int graph_find(graph_t *graph, const char *name);
+
+/**
+ * @brief Enters a new node in the index, doubling the index when it is half full.
+ *
+ * @param graph The graph.
+ * @param index The index of the node.
+ */
+void graph_index_node(graph_t *graph, int index);
+
+/**
+ * @brief Hashes the name of a target with 64-bit FNV-1a.
+ *
+ * @param name The name.
+ * @return The hash.
+ */
+unsigned long long hash_name(const char *name);
+
+/**
+ * @brief Builds every node of the graph, running at most `options->jobs` commands at once.
+ *
+ * @param graph The graph.
+ * @param options The options structure containing command-line options.
+ * @return 0 on success; on failure the program exits.
+ */
+int graph_build(graph_t *graph, options_t *options);
+
+/**
+ * @brief Checks whether a ready node needs to be built, and starts its command if so.
+ *
+ * @param graph The graph.
+ * @param index The index of the node.
+ * @param options The options structure containing command-line options.
+ * @return 1 if a command was started, 0 if the node is done, -1 on failure.
+ */
+int start_node(graph_t *graph, int index, options_t *options);
+
+/**
+ * @brief Marks a node as done and moves the dependents that became ready to the ready queue.
+ *
+ * @param graph The graph.
+ * @param index The index of the node.
+ */
+void finish_node(graph_t *graph, int index);
+
+/**
+ * @brief Waits for one running command and finishes its node.
+ *
+ * @param graph The graph.
+ * @return 0 if the command succeeded, -1 if it failed.
+ */
+int reap_node(graph_t *graph);
+
+/**
+ * @brief Finds the stage of a node's command that a child is.
+ *
+ * @param node The node.
+ * @param pid The PID of the child.
+ * @return The index of the stage, or -1 if the child is not one of the node's.
+ */
+int find_stage(node_t *node, pid_t pid);
+
+/**
+ * @brief Adds the resource usage of a stage to that of its command.
+ *
+ * The times, page faults and context switches are summed; the largest resident set is kept.
+ *
+ * @param total The usage of the command.
+ * @param usage The usage of the stage.
+ */
+void add_usage(struct rusage *total, const struct rusage *usage);
+
+/**
+ * @brief Waits for all running commands, without starting new ones.
+ *
+ * @param graph The graph.
+ */
+void wait_for_running(graph_t *graph);
+
+/**
+ * @brief Waits until a jobserver token may be available or a running command finishes.
+ *
+ * @param graph The graph, which has a jobserver and running commands.
+ * @return 0 unless a command that finished has failed, -1 then.
+ */
+int wait_for_token(graph_t *graph);
+
+/**
+ * @brief Gives back the jobserver tokens that the running commands do not need.
+ *
+ * @param graph The graph.
+ * @param keep The number of tokens to keep.
+ */
+void release_tokens(graph_t *graph, int keep);
+
+/**
+ * @brief Opens a pidfd for a child, so that its end can be polled for.
+ *
+ * @param pid The PID of the child.
+ * @return The pidfd, or -1 if pidfds are not available.
+ */
+int open_pidfd(pid_t pid);
+
+/**
+ * @brief Adds a node to the ready queue.
+ *
+ * @param graph The graph.
+ * @param index The index of the node.
+ */
+void ready_push(graph_t *graph, int index);
+
+/**
+ * @brief Removes the ready node that comes first in post-order.
+ *
+ * @param graph The graph.
+ * @return The index of the node.
+ */
+int ready_pop(graph_t *graph);
+
+/**
+ * @brief Frees the graph.
+ *
+ * @param graph The graph.
+ */
+void graph_del(graph_t *graph);
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * @file trace.c
+ *
+ * @brief Implementation of build tracing and the critical path.
+ *
+ * This source file writes the timestamps and resource usage that the scheduler recorded
+ * in the nodes as Chrome trace events, one complete ("X") event per check and per
+ * command, and finds the critical path by a pass over the nodes in post-order.
+ *
+ * Error handling: A trace file that cannot be written is reported via `stderr`.
+ *
+ * Memory management: The trace is freed using trace_del.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "scheduler.h"
+
+trace_t *trace_create(const char *path) {
+    trace_t *trace = malloc(sizeof(trace_t));
+    if (!trace) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    trace->path = strdup(path);
+    if (!trace->path) {
+        perror("mmake: strdup");
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &trace->start);
+    return trace;
+}
+
+double trace_now(trace_t *trace) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - trace->start.tv_sec) * 1e6 + (now.tv_nsec - trace->start.tv_nsec) / 1e3;
+}
+
+void trace_write(trace_t *trace, graph_t *graph) {
+    FILE *fp = fopen(trace->path, "w");
+    if (!fp) {
+        perror(trace->path);
+        return;
+    }
+
+    int pid = getpid();
+    fprintf(fp, "{\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"mmake\"}}",
+            pid, pid);
+    for (int i = 0; i < graph->count; i++) {
+        node_t *node = &graph->nodes[i];
+        if (node->check_end > 0) {
+            fprintf(fp, ",\n{\"name\":");
+            write_json_string(fp, node->name);
+            fprintf(fp, ",\"cat\":\"check\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    node->check_start, node->check_end - node->check_start, pid, pid);
+        }
+        if (node->end > 0) {
+            const struct rusage *ru = &node->usage;
+            fprintf(fp, ",\n{\"name\":");
+            write_json_string(fp, node->name);
+            fprintf(fp, ",\"cat\":\"command\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"command\":", node->start, node->end - node->start, pid, (int)node->pid);
+            char **cmd = rule_cmd(node->rule);
+            fputc('"', fp);
+            for (int j = 0; cmd[j]; j++) {
+                if (j > 0) {
+                    fputc(' ', fp);
+                }
+                write_json_chars(fp, cmd[j]);
+            }
+            fputc('"', fp);
+            fprintf(fp, ",\"exit_status\":%d,\"user_ms\":%.3f,\"sys_ms\":%.3f,\"max_rss_kb\":%ld,"
+                    "\"minor_faults\":%ld,\"major_faults\":%ld,\"voluntary_switches\":%ld,"
+                    "\"involuntary_switches\":%ld}}",
+                    node->exit_status, ru->ru_utime.tv_sec * 1e3 + ru->ru_utime.tv_usec / 1e3,
+                    ru->ru_stime.tv_sec * 1e3 + ru->ru_stime.tv_usec / 1e3, ru->ru_maxrss, ru->ru_minflt,
+                    ru->ru_majflt, ru->ru_nvcsw, ru->ru_nivcsw);
+        }
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (fclose(fp) != 0) {
+        perror(trace->path);
+    }
+}
+
+void print_critical_path(graph_t *graph) {
+    if (graph->count == 0) {
+        return;
+    }
+    /* by_order[k] is the node at post-order position k; longest[i] ends with node i. */
+    int *by_order = malloc(graph->count * sizeof(int));
+    int *via = malloc(graph->count * sizeof(int));
+    double *longest = malloc(graph->count * sizeof(double));
+    if (!by_order || !via || !longest) {
+        perror("mmake: malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < graph->count; i++) {
+        by_order[graph->nodes[i].order] = i;
+    }
+
+    int last = by_order[0];
+    for (int k = 0; k < graph->count; k++) {
+        int i = by_order[k];
+        node_t *node = &graph->nodes[i];
+        via[i] = -1;
+        longest[i] = 0;
+        for (int j = 0; j < node->prereq_count; j++) {
+            int prereq = node->prereqs[j];
+            if (longest[prereq] > longest[i]) {
+                longest[i] = longest[prereq];
+                via[i] = prereq;
+            }
+        }
+        if (node->end > 0) {
+            longest[i] += node->end - node->start;
+        }
+        if (longest[i] > longest[last]) {
+            last = i;
+        }
+    }
+
+    /* Walk back from the end of the path, then print it in build order. */
+    int length = 0;
+    for (int i = last; i != -1 && longest[i] > 0; i = via[i]) {
+        by_order[length++] = i;
+    }
+    fprintf(stderr, "mmake: Critical path: %.3f s\n", longest[last] / 1e6);
+    for (int k = length - 1; k >= 0; k--) {
+        node_t *node = &graph->nodes[by_order[k]];
+        double duration = node->end > 0 ? node->end - node->start : 0;
+        fprintf(stderr, "  %10.3f s  %s\n", duration / 1e6, node->name);
+    }
+
+    free(by_order);
+    free(via);
+    free(longest);
+}
+
+void write_json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    write_json_chars(fp, s);
+    fputc('"', fp);
+}
+
+void write_json_chars(FILE *fp, const char *s) {
+    for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(fp, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(fp, "\\u%04x", *c);
+        } else {
+            fputc(*c, fp);
+        }
+    }
+}
+
+void trace_del(trace_t *trace) {
+    free(trace->path);
+    free(trace);
+}
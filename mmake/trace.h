@@ -0,0 +1,96 @@
+/**
+ * @file trace.h
+ *
+ * @brief Build tracing in Chrome trace event format, and the critical path.
+ *
+ * With `--trace=FILE`, the scheduler records for every target when its timestamps were
+ * checked and when its command ran, and the resource usage of the command. After the run,
+ * the events are written to FILE as a Chrome trace, which can be opened in
+ * chrome://tracing or Perfetto: the checks are on the row of mmake itself, and each
+ * command is on the row of its process. The critical path, the chain of prerequisites
+ * whose commands together took the longest, is printed to `stderr`.
+ *
+ * Times are in microseconds since the trace was created, from the monotonic clock.
+ *
+ * Error handling: A trace file that cannot be written is reported via `stderr`.
+ *
+ * Memory management: The trace must be freed using trace_del.
+ *
+ * @author Emil Engvall
+ * @date 31-10-2024
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <time.h>
+
+struct graph;
+
+/**
+ * @brief An open trace.
+ */
+typedef struct trace {
+    char *path;              /**< Path of the trace file. */
+    struct timespec start;   /**< When the trace was created. */
+} trace_t;
+
+/**
+ * @brief Creates a trace that is written to a file.
+ *
+ * @param path The path of the trace file.
+ * @return The trace.
+ */
+trace_t *trace_create(const char *path);
+
+/**
+ * @brief Returns the time since the trace was created.
+ *
+ * @param trace The trace.
+ * @return The time in microseconds.
+ */
+double trace_now(trace_t *trace);
+
+/**
+ * @brief Writes the events of every node of a graph to the trace file.
+ *
+ * @param trace The trace.
+ * @param graph The graph, after it has been built.
+ */
+void trace_write(trace_t *trace, struct graph *graph);
+
+/**
+ * @brief Prints the critical path of a graph to `stderr`.
+ *
+ * The length of a path is the sum of the durations of its commands. Nodes are visited
+ * in post-order, so a node's prerequisites are done before the node.
+ *
+ * @param graph The graph, after it has been built.
+ */
+void print_critical_path(struct graph *graph);
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ *
+ * @param fp The file to write to.
+ * @param s The string.
+ */
+void write_json_string(FILE *fp, const char *s);
+
+/**
+ * @brief Writes the characters of a string escaped for a JSON string literal, without quotes.
+ *
+ * @param fp The file to write to.
+ * @param s The string.
+ */
+void write_json_chars(FILE *fp, const char *s);
+
+/**
+ * @brief Frees the trace.
+ *
+ * @param trace The trace.
+ */
+void trace_del(trace_t *trace);
+
+#endif
@@ -4,8 +4,8 @@
  * @brief Utility function implementations for the mmake program.
  * 
  * This source file implements utility functions declared in `utils.h`, providing functionality for
- * checking file existence, retrieving modification times, determining if a build is needed,
- * executing commands, printing commands, building prerequisites, and handling error conditions.
+ * checking file existence, retrieving modification times, starting commands, printing commands,
+ * and handling error conditions.
  * 
  * Error handling: Functions report errors via `stderr` and exit the program on critical failures.
  * 
@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <string.h>
 
 #include "options.h"
 #include "makefile_loader.h"
@@ -33,72 +34,63 @@ int file_exists(const char *path) {
     return (stat(path, &st) == 0);
 }
 
-time_t get_mod_time(const char *path) {
+struct timespec get_mod_time(const char *path) {
     struct stat st;
     if (stat(path, &st) == -1) {
-        return 0;
+        return (struct timespec){0, 0};
     }
-    return st.st_mtime;
+    return st.st_mtim;
 }
 
-int needs_build(makefile *make, const char *target_name, options_t *options) {
-    if (options->force_build) {
-        return 1;
-    }
+int time_is_set(struct timespec time) {
+    return time.tv_sec != 0 || time.tv_nsec != 0;
+}
 
-    time_t target_time = get_mod_time(target_name);
-    if (target_time == 0) {
-        return 1;
+int compare_times(struct timespec a, struct timespec b) {
+    if (a.tv_sec != b.tv_sec) {
+        return a.tv_sec < b.tv_sec ? -1 : 1;
     }
-
-    rule *r = makefile_rule(make, target_name);
-    if (!r) {
-        return 0;
+    if (a.tv_nsec != b.tv_nsec) {
+        return a.tv_nsec < b.tv_nsec ? -1 : 1;
     }
+    return 0;
+}
 
-    const char **prereqs = rule_prereq(r);
-    for (const char **p = prereqs; *p; p++) {
-        const char *prereq = *p;
-        time_t prereq_time = get_mod_time(prereq);
-
-        if (prereq_time == 0) {
-            fprintf(stderr, "mmake: Prerequisite '%s' for target '%s' does not exist\n", prereq, target_name);
-            exit(EXIT_FAILURE);
-        }
-
-        if (prereq_time > target_time) {
-            return 1;
+char ***split_pipeline(char **cmd, int *stage_count) {
+    int words = 0;
+    int count = 1;
+    for (char **c = cmd; *c; c++) {
+        words++;
+        if (strcmp(*c, PIPELINE_SEPARATOR) == 0) {
+            count++;
         }
     }
-    return 0;
-}
 
-int execute_command(char **cmd) {
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("mmake: fork");
-        return -1;
-    } else if (pid == 0) {
-        execvp(cmd[0], cmd);
-        perror("mmake: execvp");
+    /* The stage arrays, followed by their words, each stage ended by NULL in place of a `|`. */
+    char ***stages = malloc(count * sizeof(char **) + (words + 1) * sizeof(char *));
+    if (!stages) {
+        perror("mmake: malloc");
         exit(EXIT_FAILURE);
-    } else {
-        int status;
-        if (waitpid(pid, &status, 0) == -1) {
-            perror("mmake: waitpid");
-            return -1;
-        }
-        if (WIFEXITED(status)) {
-            if (WEXITSTATUS(status) != EXIT_SUCCESS) {
-                exit(EXIT_FAILURE); 
+    }
+    char **argv = (char **)(stages + count);
+    int stage = 0;
+    stages[0] = argv;
+    for (int i = 0; i <= words; i++) {
+        if (i == words || strcmp(cmd[i], PIPELINE_SEPARATOR) == 0) {
+            if (argv + i == stages[stage]) {
+                free(stages);
+                return NULL;
+            }
+            argv[i] = NULL;
+            if (i < words) {
+                stages[++stage] = argv + i + 1;
             }
-        } else if (WIFSIGNALED(status)) {
-            exit(EXIT_FAILURE);
         } else {
-            exit(EXIT_FAILURE);
+            argv[i] = cmd[i];
         }
     }
-    return 0;
+    *stage_count = count;
+    return stages;
 }
 
 void print_command(char **cmd) {
@@ -111,17 +103,6 @@ void print_command(char **cmd) {
     printf("\n");
 }
 
-int build_prerequisites(makefile *make, rule *r, options_t *options) {
-    const char **prereqs = rule_prereq(r);
-    for (const char **p = prereqs; *p; p++) {
-        if (process_target(make, *p, options) != 0) {
-            return -1;
-        }
-    }
-    return 0;
-}
-
-
 void handle_missing_rule(const char *target_name) {
     fprintf(stderr, "mmake: No rule to make target '%s'\n", target_name);
     exit(EXIT_FAILURE);
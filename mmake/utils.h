@@ -4,8 +4,8 @@
  * @brief Utility functions for the mmake program.
  * 
  * This header file declares utility functions used throughout the mmake program, such as
- * checking file existence, retrieving modification times, determining if a build is needed,
- * executing commands, printing commands, building prerequisites, and handling error scenarios.
+ * checking file existence, retrieving modification times, starting commands, printing commands,
+ * and handling error scenarios.
  * 
  * Error handling: Functions report errors via `stderr` and may exit the program on critical failures.
  * 
@@ -19,9 +19,12 @@
 #define UTILS_H
 
 #include <time.h>
+#include <sys/types.h>
 #include "parser.h"
 #include "options.h"
 
+#define PIPELINE_SEPARATOR "|"
+
 /**
  * @brief Checks if a file exists at the given path.
  * 
@@ -31,47 +34,49 @@
 int file_exists(const char *path);
 
 /**
- * @brief Retrieves the modification time of a file.
+ * @brief Retrieves the modification time of a file, with nanoseconds.
  * 
  * @param path The file path to check.
- * @return The modification time as `time_t`, or 0 if the file doesn't exist.
+ * @return The modification time, or a zero time if the file doesn't exist.
  */
-time_t get_mod_time(const char *path);
+struct timespec get_mod_time(const char *path);
 
 /**
- * @brief Determines if the target needs to be built.
+ * @brief Checks if a modification time is set, that is, if the file exists.
  * 
- * @param make The makefile structure containing rules.
- * @param target_name The name of the target to check.
- * @param options The options structure containing command-line options.
- * @return 1 if the target needs to be built, 0 otherwise.
+ * @param time The modification time.
+ * @return Non-zero if the time is set, zero otherwise.
  */
-int needs_build(makefile *make, const char *target_name, options_t *options);
+int time_is_set(struct timespec time);
 
 /**
- * @brief Executes a command using `execvp`.
+ * @brief Compares two modification times.
  * 
- * @param cmd The command array to execute.
- * @return 0 on success, -1 on failure.
+ * @param a The first time.
+ * @param b The second time.
+ * @return Negative, zero or positive as `a` is earlier than, equal to or later than `b`.
  */
-int execute_command(char **cmd);
+int compare_times(struct timespec a, struct timespec b);
 
 /**
- * @brief Prints a command to `stdout`.
+ * @brief Splits a command into the stages of a pipeline, at the words that are `|`.
  * 
- * @param cmd The command array to print.
+ * The stages point to the words of the command, which must outlive them. A command
+ * without `|` is a pipeline with one stage.
+ * 
+ * @param cmd The command array.
+ * @param stage_count Set to the number of stages.
+ * @return The NULL-terminated argument arrays of the stages, in one allocation that is
+ *         freed with free, or NULL if a stage is empty.
  */
-void print_command(char **cmd);
+char ***split_pipeline(char **cmd, int *stage_count);
 
 /**
- * @brief Builds all prerequisites for a given rule.
+ * @brief Prints a command to `stdout`.
  * 
- * @param make The makefile structure containing rules.
- * @param r The rule whose prerequisites need to be built.
- * @param options The options structure containing command-line options.
- * @return 0 on success, -1 on failure.
+ * @param cmd The command array to print.
  */
-int build_prerequisites(makefile *make, rule *r, options_t *options);
+void print_command(char **cmd);
 
 /**
  * @brief Handles the error when a rule is missing for a target.